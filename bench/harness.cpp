@@ -0,0 +1,501 @@
+// ========================== Includes ==========================
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+// Headless benchmark harness, linked into a chapter's main.cpp with -Wl,--wrap for every SDL call below (see the Makefile).
+// It swaps in the dummy video/audio drivers and the software renderer, feeds the main loop scripted input,
+// ends it after a fixed number of frames and writes the frame times, allocations and renderer calls as JSON.
+// Needs GNU ld and glibc (for --wrap and the __libc_ allocator), which is what CI runs on.
+
+// ========================== Constants and Enums ==========================
+// defaults, BENCH_FRAMES in the environment overrides
+const int BENCH_DEFAULT_FRAMES = 600;
+
+// a key goes down every this many frames and comes back up half way to the next one
+const int BENCH_KEY_INTERVAL = 30;
+
+// the keys the chapters react to, pressed in turn
+const SDL_Keycode BENCH_KEYS[] = {SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT, SDLK_1, SDLK_2, SDLK_3, SDLK_4, SDLK_9, SDLK_0, SDLK_RETURN, SDLK_s, SDLK_p, SDLK_q, SDLK_w, SDLK_a, SDLK_e, SDLK_d};
+const int BENCH_KEY_COUNT = sizeof(BENCH_KEYS) / sizeof(BENCH_KEYS[0]);
+
+// the mouse sweeps this area until the first frame tells us the real window size
+const int BENCH_DEFAULT_MOUSE_WIDTH = 640;
+const int BENCH_DEFAULT_MOUSE_HEIGHT = 480;
+
+// renderer and blit calls that get counted
+enum BenchCall
+{
+	CALL_RENDER_CLEAR,
+	CALL_RENDER_COPY,
+	CALL_RENDER_COPY_EX,
+	CALL_RENDER_GEOMETRY,
+	CALL_RENDER_FILL_RECT,
+	CALL_RENDER_FILL_RECTS,
+	CALL_RENDER_DRAW_RECT,
+	CALL_RENDER_DRAW_LINE,
+	CALL_RENDER_DRAW_LINES,
+	CALL_RENDER_DRAW_POINT,
+	CALL_RENDER_DRAW_POINTS,
+	CALL_BLIT_SURFACE,
+	CALL_BLIT_SCALED,
+	CALL_TOTAL
+};
+
+const char* BENCH_CALL_NAMES[CALL_TOTAL] = {"SDL_RenderClear", "SDL_RenderCopy", "SDL_RenderCopyEx", "SDL_RenderGeometry", "SDL_RenderFillRect", "SDL_RenderFillRects",
+	"SDL_RenderDrawRect", "SDL_RenderDrawLine", "SDL_RenderDrawLines", "SDL_RenderDrawPoint", "SDL_RenderDrawPoints", "SDL_BlitSurface", "SDL_BlitScaled"};
+
+// ========================== Global Variables ==========================
+// allocations from every thread, SDL and the libraries included
+std::atomic<long long> gAllocations(0);
+std::atomic<long long> gAllocatedBytes(0);
+
+// allocation totals when the first frame was presented, the rest count as per frame
+long long gStartupAllocations = -1;
+long long gStartupBytes = 0;
+
+// renderer calls made in the main loop
+long long gCalls[CALL_TOTAL];
+
+// frames presented (or polled through, for chapters that never present again) and how long each took
+int gFrames = 0;
+int gTargetFrames = BENCH_DEFAULT_FRAMES;
+std::vector<Uint64> gFrameCounts;
+Uint64 gLastFrame = 0;
+bool gPresentedSinceLastPoll = false;
+
+// the area the scripted mouse sweeps, the window's size once it has presented
+int gMouseWidth = BENCH_DEFAULT_MOUSE_WIDTH;
+int gMouseHeight = BENCH_DEFAULT_MOUSE_HEIGHT;
+bool gMouseSized = false;
+
+// scripted input waiting for the main loop
+std::vector<SDL_Event> gScript;
+int gScriptNext = 0;
+int gScriptedEvents = 0;
+
+// the thread that called SDL_Init, the only one whose delays are skipped
+SDL_threadID gMainThread = 0;
+
+// the report only goes out once
+bool gReported = false;
+
+// ========================== Allocator Interposition ==========================
+extern "C"
+{
+	void* __libc_malloc(size_t size);
+	void* __libc_calloc(size_t count, size_t size);
+	void* __libc_realloc(void* pointer, size_t size);
+
+	void* malloc(size_t size)
+	{
+		++gAllocations;
+		gAllocatedBytes += size;
+		return __libc_malloc(size);
+	}
+
+	void* calloc(size_t count, size_t size)
+	{
+		++gAllocations;
+		gAllocatedBytes += count * size;
+		return __libc_calloc(count, size);
+	}
+
+	void* realloc(void* pointer, size_t size)
+	{
+		++gAllocations;
+		gAllocatedBytes += size;
+		return __libc_realloc(pointer, size);
+	}
+}
+
+// ========================== Function Definitions ==========================
+// queues the input for the frame about to start
+void scriptFrame(int frame)
+{
+	gScript.clear();
+	gScriptNext = 0;
+
+	SDL_Event e;
+	if (frame >= gTargetFrames)
+	{
+		memset(&e, 0, sizeof(e));
+		e.type = SDL_QUIT;
+		gScript.push_back(e);
+		return;
+	}
+
+	// a mouse wandering over the window, clicking now and then
+	memset(&e, 0, sizeof(e));
+	e.type = SDL_MOUSEMOTION;
+	e.motion.x = (frame * 7) % gMouseWidth;
+	e.motion.y = (frame * 5) % gMouseHeight;
+	e.motion.xrel = 7;
+	e.motion.yrel = 5;
+	gScript.push_back(e);
+	if (frame % BENCH_KEY_INTERVAL == BENCH_KEY_INTERVAL / 3)
+	{
+		memset(&e, 0, sizeof(e));
+		e.type = frame / BENCH_KEY_INTERVAL % 2 == 0 ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+		e.button.button = SDL_BUTTON_LEFT;
+		e.button.state = e.type == SDL_MOUSEBUTTONDOWN ? SDL_PRESSED : SDL_RELEASED;
+		e.button.clicks = 1;
+		e.button.x = (frame * 7) % gMouseWidth;
+		e.button.y = (frame * 5) % gMouseHeight;
+		gScript.push_back(e);
+	}
+
+	// each key in turn, held for half the interval
+	int phase = frame % BENCH_KEY_INTERVAL;
+	if (phase == 0 || phase == BENCH_KEY_INTERVAL / 2)
+	{
+		memset(&e, 0, sizeof(e));
+		e.type = phase == 0 ? SDL_KEYDOWN : SDL_KEYUP;
+		e.key.state = phase == 0 ? SDL_PRESSED : SDL_RELEASED;
+		e.key.keysym.sym = BENCH_KEYS[frame / BENCH_KEY_INTERVAL % BENCH_KEY_COUNT];
+		e.key.keysym.scancode = SDL_GetScancodeFromKey(e.key.keysym.sym);
+		gScript.push_back(e);
+	}
+}
+
+// closes out one frame, call on every present with the window that presented (NULL for idle frames)
+void endFrame(SDL_Window* window)
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+
+	// the chapters range from 300x800 to 1280x720, sweep the whole of this one from the first frame it presents
+	if (window != NULL && !gMouseSized)
+	{
+		int width = 0;
+		int height = 0;
+		SDL_GetWindowSize(window, &width, &height);
+		if (width > 0 && height > 0)
+		{
+			gMouseWidth = width;
+			gMouseHeight = height;
+		}
+		gMouseSized = true;
+	}
+
+	if (gFrames == 0)
+	{
+		// everything before the first frame is loading
+		gStartupAllocations = gAllocations;
+		gStartupBytes = gAllocatedBytes;
+		memset(gCalls, 0, sizeof(gCalls));
+	}
+	else
+	{
+		gFrameCounts.push_back(now - gLastFrame);
+	}
+	gLastFrame = now;
+	++gFrames;
+
+	scriptFrame(gFrames);
+}
+
+// prints a percentile of the frame times in milliseconds
+double percentileMs(std::vector<Uint64>& sorted, double percentile)
+{
+	if (sorted.empty())
+	{
+		return 0.0;
+	}
+	int index = std::min((int)sorted.size() - 1, (int)(percentile / 100.0 * sorted.size()));
+	return sorted[index] * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+void writeReport()
+{
+	if (gReported)
+	{
+		return;
+	}
+	gReported = true;
+
+	const char* name = getenv("BENCH_NAME");
+	const char* path = getenv("BENCH_OUT");
+	FILE* out = path != NULL ? fopen(path, "w") : stdout;
+	if (out == NULL)
+	{
+		printf("Unable to write benchmark report %s!\n", path);
+		return;
+	}
+
+	std::vector<Uint64> sorted(gFrameCounts);
+	std::sort(sorted.begin(), sorted.end());
+	Uint64 total = 0;
+	for (int i = 0; i < (int)sorted.size(); ++i)
+	{
+		total += sorted[i];
+	}
+	double meanMs = sorted.empty() ? 0.0 : total * 1000.0 / SDL_GetPerformanceFrequency() / sorted.size();
+
+	long long startupAllocations = gStartupAllocations < 0 ? (long long)gAllocations : gStartupAllocations;
+	long long startupBytes = gStartupAllocations < 0 ? (long long)gAllocatedBytes : gStartupBytes;
+	long long loopAllocations = gAllocations - startupAllocations;
+	long long loopBytes = gAllocatedBytes - startupBytes;
+	int intervals = std::max(1, (int)sorted.size());
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"chapter\": \"%s\",\n", name != NULL ? name : "chapter");
+	fprintf(out, "  \"frames\": %d,\n", gFrames);
+	fprintf(out, "  \"scripted_events\": %d,\n", gScriptedEvents);
+	fprintf(out, "  \"frame_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n",
+		meanMs, percentileMs(sorted, 50), percentileMs(sorted, 90), percentileMs(sorted, 99), sorted.empty() ? 0.0 : percentileMs(sorted, 100));
+	fprintf(out, "  \"allocations\": {\"startup\": %lld, \"startup_bytes\": %lld, \"loop\": %lld, \"loop_bytes\": %lld, \"per_frame\": %.2f},\n",
+		startupAllocations, startupBytes, loopAllocations, loopBytes, (double)loopAllocations / intervals);
+	fprintf(out, "  \"renderer_calls\": {");
+	long long calls = 0;
+	for (int i = 0; i < CALL_TOTAL; ++i)
+	{
+		fprintf(out, "%s\"%s\": %lld", i == 0 ? "" : ", ", BENCH_CALL_NAMES[i], gCalls[i]);
+		calls += gCalls[i];
+	}
+	fprintf(out, "},\n");
+	fprintf(out, "  \"renderer_calls_per_frame\": %.2f\n", (double)calls / intervals);
+	fprintf(out, "}\n");
+
+	if (out != stdout)
+	{
+		fclose(out);
+	}
+}
+
+// ========================== Wrapped SDL Functions ==========================
+extern "C"
+{
+	int __real_SDL_Init(Uint32 flags);
+	void __real_SDL_Quit();
+	SDL_Renderer* __real_SDL_CreateRenderer(SDL_Window* window, int index, Uint32 flags);
+	int __real_SDL_PollEvent(SDL_Event* e);
+	int __real_SDL_WaitEvent(SDL_Event* e);
+	int __real_SDL_WaitEventTimeout(SDL_Event* e, int timeout);
+	void __real_SDL_Delay(Uint32 ms);
+	void __real_SDL_RenderPresent(SDL_Renderer* renderer);
+	int __real_SDL_UpdateWindowSurface(SDL_Window* window);
+	int __real_SDL_UpdateWindowSurfaceRects(SDL_Window* window, const SDL_Rect* rects, int count);
+	int __real_SDL_RenderClear(SDL_Renderer* renderer);
+	int __real_SDL_RenderCopy(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* source, const SDL_Rect* dest);
+	int __real_SDL_RenderCopyEx(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* source, const SDL_Rect* dest, const double angle, const SDL_Point* center, const SDL_RendererFlip flip);
+	int __real_SDL_RenderGeometry(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Vertex* vertices, int vertexCount, const int* indices, int indexCount);
+	int __real_SDL_RenderFillRect(SDL_Renderer* renderer, const SDL_Rect* rect);
+	int __real_SDL_RenderFillRects(SDL_Renderer* renderer, const SDL_Rect* rects, int count);
+	int __real_SDL_RenderDrawRect(SDL_Renderer* renderer, const SDL_Rect* rect);
+	int __real_SDL_RenderDrawLine(SDL_Renderer* renderer, int x1, int y1, int x2, int y2);
+	int __real_SDL_RenderDrawLines(SDL_Renderer* renderer, const SDL_Point* points, int count);
+	int __real_SDL_RenderDrawPoint(SDL_Renderer* renderer, int x, int y);
+	int __real_SDL_RenderDrawPoints(SDL_Renderer* renderer, const SDL_Point* points, int count);
+	int __real_SDL_UpperBlit(SDL_Surface* source, const SDL_Rect* sourceRect, SDL_Surface* dest, SDL_Rect* destRect);
+	int __real_SDL_UpperBlitScaled(SDL_Surface* source, const SDL_Rect* sourceRect, SDL_Surface* dest, SDL_Rect* destRect);
+
+	int __wrap_SDL_Init(Uint32 flags)
+	{
+		// no display or sound card on the build machines
+		setenv("SDL_VIDEODRIVER", "dummy", 1);
+		setenv("SDL_AUDIODRIVER", "dummy", 1);
+		gMainThread = SDL_ThreadID();
+
+		const char* frames = getenv("BENCH_FRAMES");
+		if (frames != NULL && atoi(frames) > 0)
+		{
+			gTargetFrames = atoi(frames);
+		}
+		scriptFrame(0);
+
+		return __real_SDL_Init(flags);
+	}
+
+	void __wrap_SDL_Quit()
+	{
+		writeReport();
+		__real_SDL_Quit();
+	}
+
+	SDL_Renderer* __wrap_SDL_CreateRenderer(SDL_Window* window, int index, Uint32 flags)
+	{
+		// software and unthrottled, so the numbers are the CPU cost of the frame
+		return __real_SDL_CreateRenderer(window, index, SDL_RENDERER_SOFTWARE | (flags & SDL_RENDERER_TARGETTEXTURE));
+	}
+
+	int __wrap_SDL_PollEvent(SDL_Event* e)
+	{
+		// scripted input first, then whatever the dummy driver has
+		if (gScriptNext < (int)gScript.size())
+		{
+			*e = gScript[gScriptNext++];
+			++gScriptedEvents;
+			return 1;
+		}
+
+		int pending = __real_SDL_PollEvent(e);
+		if (pending == 0)
+		{
+			// a loop that only polls still needs frames to end on
+			if (!gPresentedSinceLastPoll)
+			{
+				endFrame(NULL);
+			}
+			gPresentedSinceLastPoll = false;
+		}
+		return pending;
+	}
+
+	int __wrap_SDL_WaitEvent(SDL_Event* e)
+	{
+		// the dummy driver never sends anything, so an empty queue ends the frame and the next one's script is served
+		while (true)
+		{
+			if (gScriptNext < (int)gScript.size())
+			{
+				if (e != NULL)
+				{
+					*e = gScript[gScriptNext++];
+					++gScriptedEvents;
+				}
+				return 1;
+			}
+
+			if (__real_SDL_PollEvent(e) != 0)
+			{
+				return 1;
+			}
+			if (!gPresentedSinceLastPoll)
+			{
+				endFrame(NULL);
+			}
+			gPresentedSinceLastPoll = false;
+		}
+	}
+
+	int __wrap_SDL_WaitEventTimeout(SDL_Event* e, int)
+	{
+		// idle frames are measured without the wait, the next poll ends them
+		if (gScriptNext < (int)gScript.size())
+		{
+			if (e != NULL)
+			{
+				*e = gScript[gScriptNext++];
+				++gScriptedEvents;
+			}
+			return 1;
+		}
+		return __real_SDL_PollEvent(e);
+	}
+
+	void __wrap_SDL_Delay(Uint32 ms)
+	{
+		// the chapters that cap with SDL_Delay are measured without the waiting,
+		// chapter 21's pacer also spins and is switched off by running it with --uncapped (see the Makefile).
+		// worker threads (chapter 18's music decoder) still sleep, or they would busy-poll a core for the whole run
+		if (SDL_ThreadID() != gMainThread)
+		{
+			__real_SDL_Delay(ms);
+		}
+	}
+
+	void __wrap_SDL_RenderPresent(SDL_Renderer* renderer)
+	{
+		__real_SDL_RenderPresent(renderer);
+		gPresentedSinceLastPoll = true;
+		endFrame(SDL_RenderGetWindow(renderer));
+	}
+
+	int __wrap_SDL_UpdateWindowSurface(SDL_Window* window)
+	{
+		int result = __real_SDL_UpdateWindowSurface(window);
+		gPresentedSinceLastPoll = true;
+		endFrame(window);
+		return result;
+	}
+
+	int __wrap_SDL_UpdateWindowSurfaceRects(SDL_Window* window, const SDL_Rect* rects, int count)
+	{
+		int result = __real_SDL_UpdateWindowSurfaceRects(window, rects, count);
+		gPresentedSinceLastPoll = true;
+		endFrame(window);
+		return result;
+	}
+
+	int __wrap_SDL_RenderClear(SDL_Renderer* renderer)
+	{
+		++gCalls[CALL_RENDER_CLEAR];
+		return __real_SDL_RenderClear(renderer);
+	}
+
+	int __wrap_SDL_RenderCopy(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* source, const SDL_Rect* dest)
+	{
+		++gCalls[CALL_RENDER_COPY];
+		return __real_SDL_RenderCopy(renderer, texture, source, dest);
+	}
+
+	int __wrap_SDL_RenderCopyEx(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* source, const SDL_Rect* dest, const double angle, const SDL_Point* center, const SDL_RendererFlip flip)
+	{
+		++gCalls[CALL_RENDER_COPY_EX];
+		return __real_SDL_RenderCopyEx(renderer, texture, source, dest, angle, center, flip);
+	}
+
+	int __wrap_SDL_RenderGeometry(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Vertex* vertices, int vertexCount, const int* indices, int indexCount)
+	{
+		++gCalls[CALL_RENDER_GEOMETRY];
+		return __real_SDL_RenderGeometry(renderer, texture, vertices, vertexCount, indices, indexCount);
+	}
+
+	int __wrap_SDL_RenderFillRect(SDL_Renderer* renderer, const SDL_Rect* rect)
+	{
+		++gCalls[CALL_RENDER_FILL_RECT];
+		return __real_SDL_RenderFillRect(renderer, rect);
+	}
+
+	int __wrap_SDL_RenderFillRects(SDL_Renderer* renderer, const SDL_Rect* rects, int count)
+	{
+		++gCalls[CALL_RENDER_FILL_RECTS];
+		return __real_SDL_RenderFillRects(renderer, rects, count);
+	}
+
+	int __wrap_SDL_RenderDrawRect(SDL_Renderer* renderer, const SDL_Rect* rect)
+	{
+		++gCalls[CALL_RENDER_DRAW_RECT];
+		return __real_SDL_RenderDrawRect(renderer, rect);
+	}
+
+	int __wrap_SDL_RenderDrawLine(SDL_Renderer* renderer, int x1, int y1, int x2, int y2)
+	{
+		++gCalls[CALL_RENDER_DRAW_LINE];
+		return __real_SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
+	}
+
+	int __wrap_SDL_RenderDrawLines(SDL_Renderer* renderer, const SDL_Point* points, int count)
+	{
+		++gCalls[CALL_RENDER_DRAW_LINES];
+		return __real_SDL_RenderDrawLines(renderer, points, count);
+	}
+
+	int __wrap_SDL_RenderDrawPoint(SDL_Renderer* renderer, int x, int y)
+	{
+		++gCalls[CALL_RENDER_DRAW_POINT];
+		return __real_SDL_RenderDrawPoint(renderer, x, y);
+	}
+
+	int __wrap_SDL_RenderDrawPoints(SDL_Renderer* renderer, const SDL_Point* points, int count)
+	{
+		++gCalls[CALL_RENDER_DRAW_POINTS];
+		return __real_SDL_RenderDrawPoints(renderer, points, count);
+	}
+
+	int __wrap_SDL_UpperBlit(SDL_Surface* source, const SDL_Rect* sourceRect, SDL_Surface* dest, SDL_Rect* destRect)
+	{
+		++gCalls[CALL_BLIT_SURFACE];
+		return __real_SDL_UpperBlit(source, sourceRect, dest, destRect);
+	}
+
+	int __wrap_SDL_UpperBlitScaled(SDL_Surface* source, const SDL_Rect* sourceRect, SDL_Surface* dest, SDL_Rect* destRect)
+	{
+		++gCalls[CALL_BLIT_SCALED];
+		return __real_SDL_UpperBlitScaled(source, sourceRect, dest, destRect);
+	}
+}
@@ -1,11 +1,181 @@
 // Use SDL and Standard IO
 #include <SDL2/SDL.h>
 #include <stdio.h>
+#include <vector>
+#include <algorithm>
 
 // screen dimension constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+// longest an idle frame sleeps waiting for an event
+const int DAMAGE_IDLE_WAIT_MS = 16;
+
+// Keeps track of what changed on the window surface so only that gets shown
+class LDamageTracker
+{
+	private:
+		// a blit that is still intact on the window surface
+		struct Blit
+		{
+			SDL_Surface* source;
+			SDL_Rect sourceRect;
+			SDL_Rect destRect;
+			bool scaled;
+		};
+
+		SDL_Window* mWindow;
+		SDL_Surface* mSurface;
+
+		// what's on the surface, and the parts of it the window hasn't been shown yet
+		std::vector<Blit> mOnScreen;
+		std::vector<SDL_Rect> mDamage;
+
+		static bool sameRect(const SDL_Rect& a, const SDL_Rect& b)
+		{
+			return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+		}
+
+		// grows a to cover b
+		static void unionRect(SDL_Rect* a, const SDL_Rect& b)
+		{
+			int right = std::max(a->x + a->w, b.x + b.w);
+			int bottom = std::max(a->y + a->h, b.y + b.h);
+			a->x = std::min(a->x, b.x);
+			a->y = std::min(a->y, b.y);
+			a->w = right - a->x;
+			a->h = bottom - a->y;
+		}
+
+		// overlapping or touching rects become one, so the window gets a few big copies instead of many slivers
+		void mergeDamage()
+		{
+			bool merged = true;
+			while (merged)
+			{
+				merged = false;
+				for (int i = 0; i < (int)mDamage.size() && !merged; ++i)
+				{
+					for (int j = i + 1; j < (int)mDamage.size(); ++j)
+					{
+						SDL_Rect grown = {mDamage[i].x - 1, mDamage[i].y - 1, mDamage[i].w + 2, mDamage[i].h + 2};
+						if (SDL_HasIntersection(&grown, &mDamage[j]))
+						{
+							unionRect(&mDamage[i], mDamage[j]);
+							mDamage.erase(mDamage.begin() + j);
+							merged = true;
+							break;
+						}
+					}
+				}
+			}
+		}
+
+	public:
+		// inits variables
+		LDamageTracker()
+		{
+			mWindow = NULL;
+			mSurface = NULL;
+		}
+
+		// Starts tracking the window's surface, all of it needs showing
+		void setWindow(SDL_Window* window)
+		{
+			mWindow = window;
+			mSurface = SDL_GetWindowSurface(window);
+			mOnScreen.clear();
+			damageAll();
+		}
+
+		// Blits onto the window surface, scaled to fill destRect if asked, and remembers the rect as changed
+		// the same blit as the one already there is skipped, NULL rects mean the whole surface
+		int blit(SDL_Surface* source, const SDL_Rect* sourceRect, const SDL_Rect* destRect, bool scaled = false)
+		{
+			Blit next;
+			next.source = source;
+			next.sourceRect.x = 0;
+			next.sourceRect.y = 0;
+			next.sourceRect.w = source->w;
+			next.sourceRect.h = source->h;
+			if (sourceRect != NULL)
+			{
+				next.sourceRect = *sourceRect;
+			}
+			next.destRect.x = 0;
+			next.destRect.y = 0;
+			next.destRect.w = scaled ? mSurface->w : next.sourceRect.w;
+			next.destRect.h = scaled ? mSurface->h : next.sourceRect.h;
+			if (destRect != NULL)
+			{
+				next.destRect.x = destRect->x;
+				next.destRect.y = destRect->y;
+				if (scaled)
+				{
+					next.destRect.w = destRect->w;
+					next.destRect.h = destRect->h;
+				}
+			}
+			next.scaled = scaled;
+
+			// nothing would change
+			for (int i = 0; i < (int)mOnScreen.size(); ++i)
+			{
+				const Blit& shown = mOnScreen[i];
+				if (shown.source == source && shown.scaled == scaled && sameRect(shown.sourceRect, next.sourceRect) && sameRect(shown.destRect, next.destRect))
+				{
+					return 0;
+				}
+			}
+
+			// SDL clips the rect it's given to what it actually wrote
+			SDL_Rect written = next.destRect;
+			int result = scaled ? SDL_BlitScaled(source, &next.sourceRect, mSurface, &written) : SDL_BlitSurface(source, &next.sourceRect, mSurface, &written);
+			if (result < 0)
+			{
+				printf("Unable to blit! SDL_Error: %s\n", SDL_GetError());
+				return result;
+			}
+
+			// anything this covered any part of isn't intact anymore
+			for (int i = (int)mOnScreen.size() - 1; i >= 0; --i)
+			{
+				if (SDL_HasIntersection(&mOnScreen[i].destRect, &written))
+				{
+					mOnScreen.erase(mOnScreen.begin() + i);
+				}
+			}
+			mOnScreen.push_back(next);
+			if (written.w > 0 && written.h > 0)
+			{
+				mDamage.push_back(written);
+			}
+			return result;
+		}
+
+		// Marks the whole window as needing to be shown again, for when the system lost what it showed
+		void damageAll()
+		{
+			SDL_Rect all = {0, 0, mSurface->w, mSurface->h};
+			mDamage.clear();
+			mDamage.push_back(all);
+		}
+
+		// Shows the changed parts of the surface on the window, false if nothing changed and nothing was shown
+		bool present()
+		{
+			if (mDamage.empty())
+			{
+				return false;
+			}
+
+			mergeDamage();
+			SDL_UpdateWindowSurfaceRects(mWindow, &mDamage[0], mDamage.size());
+			mDamage.clear();
+			return true;
+		}
+};
+
 // Declare some functions to be filled in later
 // loads up SDL and creates window
 bool init();
@@ -27,6 +197,9 @@ SDL_Surface* gScreenSurface = NULL;
 // The surface that contains the image we are going to render
 SDL_Surface* gXOut = NULL;
 
+// Everything drawn on the window surface goes through here
+LDamageTracker gDamage;
+
 
 // Start function implementations
 bool init()
@@ -53,6 +226,7 @@ bool init()
 		{
 		  // Get the window surface
 		  gScreenSurface = SDL_GetWindowSurface(gWindow);
+		  gDamage.setWindow(gWindow);
 		}
 	}
 	
@@ -121,13 +295,21 @@ int main( int argc, char* args[])
 				{
 					quit = true;
 				}
+				// the window lost what it was showing
+				else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_EXPOSED)
+				{
+					gDamage.damageAll();
+				}
 			}
 		
-			// apply the image
-			SDL_BlitSurface( gXOut, NULL, gScreenSurface, NULL);
+			// apply the image, skipped when it's already there
+			gDamage.blit(gXOut, NULL, NULL);
 
-			// update the surface
-			SDL_UpdateWindowSurface(gWindow);
+			// update what changed, or sleep until something happens
+			if (!gDamage.present())
+			{
+				SDL_WaitEventTimeout(NULL, DAMAGE_IDLE_WAIT_MS);
+			}
 		}
 	}
 
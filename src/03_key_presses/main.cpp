@@ -2,6 +2,10 @@
 #include <SDL2/SDL.h>
 #include <stdio.h>
 #include <string>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
 
 // ========================== Constants and Enums ==========================
 const int SCREEN_WIDTH = 640;
@@ -18,6 +22,227 @@ enum KeyPressSurfaces
 	KEY_PRESS_SURFACE_TOTAL
 };
 
+// longest an idle frame sleeps waiting for an event
+const int DAMAGE_IDLE_WAIT_MS = 16;
+
+// Damage benchmark constants, a key press every half second at 60 fps
+const int DAMAGE_BENCH_FRAMES = 300;
+const int DAMAGE_BENCH_KEY_INTERVAL = 30;
+
+// ========================== Damage Tracker Class (with implementation) ==========================
+class LDamageTracker
+{
+	private:
+		// a blit that is still intact on the window surface
+		struct Blit
+		{
+			SDL_Surface* source;
+			SDL_Rect sourceRect;
+			SDL_Rect destRect;
+			bool scaled;
+		};
+
+		SDL_Window* mWindow;
+		SDL_Surface* mSurface;
+
+		// what's on the surface, and the parts of it the window hasn't been shown yet
+		std::vector<Blit> mOnScreen;
+		std::vector<SDL_Rect> mDamage;
+
+		// off means every blit happens and every present is the whole window, like before
+		bool mEnabled;
+
+		// frames, frames that presented something, and bytes blitted and presented
+		Uint64 mFrames;
+		Uint64 mPresentedFrames;
+		Uint64 mBlitBytes;
+		Uint64 mPresentBytes;
+
+		static bool sameRect(const SDL_Rect& a, const SDL_Rect& b)
+		{
+			return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+		}
+
+		// grows a to cover b
+		static void unionRect(SDL_Rect* a, const SDL_Rect& b)
+		{
+			int right = std::max(a->x + a->w, b.x + b.w);
+			int bottom = std::max(a->y + a->h, b.y + b.h);
+			a->x = std::min(a->x, b.x);
+			a->y = std::min(a->y, b.y);
+			a->w = right - a->x;
+			a->h = bottom - a->y;
+		}
+
+		// overlapping or touching rects become one, so the window gets a few big copies instead of many slivers
+		void mergeDamage()
+		{
+			bool merged = true;
+			while (merged)
+			{
+				merged = false;
+				for (int i = 0; i < (int)mDamage.size() && !merged; ++i)
+				{
+					for (int j = i + 1; j < (int)mDamage.size(); ++j)
+					{
+						SDL_Rect grown = {mDamage[i].x - 1, mDamage[i].y - 1, mDamage[i].w + 2, mDamage[i].h + 2};
+						if (SDL_HasIntersection(&grown, &mDamage[j]))
+						{
+							unionRect(&mDamage[i], mDamage[j]);
+							mDamage.erase(mDamage.begin() + j);
+							merged = true;
+							break;
+						}
+					}
+				}
+			}
+		}
+
+	public:
+		// inits variables
+		LDamageTracker()
+		{
+			mWindow = NULL;
+			mSurface = NULL;
+			mEnabled = true;
+			mFrames = 0;
+			mPresentedFrames = 0;
+			mBlitBytes = 0;
+			mPresentBytes = 0;
+		}
+
+		// Starts tracking the window's surface, all of it needs showing
+		void setWindow(SDL_Window* window)
+		{
+			mWindow = window;
+			mSurface = SDL_GetWindowSurface(window);
+			mOnScreen.clear();
+			damageAll();
+		}
+
+		void setEnabled(bool enabled)
+		{
+			mEnabled = enabled;
+		}
+
+		// Blits onto the window surface, scaled to fill destRect if asked, and remembers the rect as changed
+		// the same blit as the one already there is skipped, NULL rects mean the whole surface
+		int blit(SDL_Surface* source, const SDL_Rect* sourceRect, const SDL_Rect* destRect, bool scaled = false)
+		{
+			Blit next;
+			next.source = source;
+			next.sourceRect.x = 0;
+			next.sourceRect.y = 0;
+			next.sourceRect.w = source->w;
+			next.sourceRect.h = source->h;
+			if (sourceRect != NULL)
+			{
+				next.sourceRect = *sourceRect;
+			}
+			next.destRect.x = 0;
+			next.destRect.y = 0;
+			next.destRect.w = scaled ? mSurface->w : next.sourceRect.w;
+			next.destRect.h = scaled ? mSurface->h : next.sourceRect.h;
+			if (destRect != NULL)
+			{
+				next.destRect.x = destRect->x;
+				next.destRect.y = destRect->y;
+				if (scaled)
+				{
+					next.destRect.w = destRect->w;
+					next.destRect.h = destRect->h;
+				}
+			}
+			next.scaled = scaled;
+
+			// nothing would change
+			for (int i = 0; mEnabled && i < (int)mOnScreen.size(); ++i)
+			{
+				const Blit& shown = mOnScreen[i];
+				if (shown.source == source && shown.scaled == scaled && sameRect(shown.sourceRect, next.sourceRect) && sameRect(shown.destRect, next.destRect))
+				{
+					return 0;
+				}
+			}
+
+			// SDL clips the rect it's given to what it actually wrote
+			SDL_Rect written = next.destRect;
+			int result = scaled ? SDL_BlitScaled(source, &next.sourceRect, mSurface, &written) : SDL_BlitSurface(source, &next.sourceRect, mSurface, &written);
+			if (result < 0)
+			{
+				printf("Unable to blit! SDL_Error: %s\n", SDL_GetError());
+				return result;
+			}
+			mBlitBytes += (Uint64)written.w * written.h * mSurface->format->BytesPerPixel;
+
+			// anything this covered any part of isn't intact anymore
+			for (int i = (int)mOnScreen.size() - 1; i >= 0; --i)
+			{
+				if (SDL_HasIntersection(&mOnScreen[i].destRect, &written))
+				{
+					mOnScreen.erase(mOnScreen.begin() + i);
+				}
+			}
+			mOnScreen.push_back(next);
+			if (written.w > 0 && written.h > 0)
+			{
+				mDamage.push_back(written);
+			}
+			return result;
+		}
+
+		// Marks the whole window as needing to be shown again, for when the system lost what it showed
+		void damageAll()
+		{
+			SDL_Rect all = {0, 0, mSurface->w, mSurface->h};
+			mDamage.clear();
+			mDamage.push_back(all);
+		}
+
+		// Shows the changed parts of the surface on the window, false if nothing changed and nothing was shown
+		bool present()
+		{
+			++mFrames;
+			if (!mEnabled)
+			{
+				damageAll();
+			}
+			if (mDamage.empty())
+			{
+				return false;
+			}
+
+			mergeDamage();
+			for (int i = 0; i < (int)mDamage.size(); ++i)
+			{
+				mPresentBytes += (Uint64)mDamage[i].w * mDamage[i].h * mSurface->format->BytesPerPixel;
+			}
+			if (mEnabled)
+			{
+				SDL_UpdateWindowSurfaceRects(mWindow, &mDamage[0], mDamage.size());
+			}
+			else
+			{
+				SDL_UpdateWindowSurface(mWindow);
+			}
+
+			mDamage.clear();
+			++mPresentedFrames;
+			return true;
+		}
+
+		void printStats()
+		{
+			if (mFrames == 0)
+			{
+				return;
+			}
+			printf("%s: %llu frames, %llu presented, %.1f KB blitted and %.1f KB presented per frame\n", mEnabled ? "damage tracking" : "full redraw",
+				(unsigned long long)mFrames, (unsigned long long)mPresentedFrames, mBlitBytes / 1024.0 / mFrames, mPresentBytes / 1024.0 / mFrames);
+		}
+};
+
+
 
 // ========================== Function Delcarations ==========================
 // loads up SDL and creates window
@@ -32,6 +257,9 @@ void close();
 // Loads individual image
 SDL_Surface* loadSurface(std::string path);
 
+// Queues the scripted key press for a frame of the damage benchmark, if it has one
+void pushBenchKey(int frame);
+
 // ========================== Global Variables ==========================
 // The window we are going to render to
 SDL_Window* gWindow = NULL;
@@ -45,6 +273,9 @@ SDL_Surface* gCurrentSurface = NULL;
 // The images that correspond to a key press
 SDL_Surface* gKeyPressSurfaces[KEY_PRESS_SURFACE_TOTAL];
 
+// Everything drawn on the window surface goes through here
+LDamageTracker gDamage;
+
 // ========================== Function Definitions ==========================
 bool init()
 {
@@ -70,6 +301,7 @@ bool init()
 		{
 		  // Get the window surface
 		  gScreenSurface = SDL_GetWindowSurface(gWindow);
+		  gDamage.setWindow(gWindow);
 		}
 	}
 	
@@ -152,8 +384,39 @@ SDL_Surface* loadSurface(std::string path)
 
 	return loadedSurface;
 }
+void pushBenchKey(int frame)
+{
+	if (frame % DAMAGE_BENCH_KEY_INTERVAL != 0)
+	{
+		return;
+	}
+
+	// round the arrows and then some other key
+	SDL_Keycode keys[5] = {SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT, SDLK_SPACE};
+	SDL_Event e;
+	memset(&e, 0, sizeof(e));
+	e.type = SDL_KEYDOWN;
+	e.key.keysym.sym = keys[frame / DAMAGE_BENCH_KEY_INTERVAL % 5];
+	SDL_PushEvent(&e);
+}
+
 int main( int argc, char* args[])
 { 
+	// --damage-bench runs a scripted key press scene headless, --no-damage redraws everything every frame like before
+	int benchFrames = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(args[i], "--damage-bench") == 0)
+		{
+			benchFrames = DAMAGE_BENCH_FRAMES;
+			SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+		}
+		else if (strcmp(args[i], "--no-damage") == 0)
+		{
+			gDamage.setEnabled(false);
+		}
+	}
+
  	// start up SDL and create the window
 	if (!init())
 	{
@@ -176,9 +439,19 @@ int main( int argc, char* args[])
 		// Set the default image as the current surface
 		gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT];
 
+		// what the benchmark measures from
+		int frame = 0;
+		clock_t cpuStart = clock();
+		Uint64 wallStart = SDL_GetPerformanceCounter();
+
 		// The main loop of the game
 		while (!quit) 
 		{
+			if (benchFrames > 0)
+			{
+				pushBenchKey(frame);
+			}
+
 			// handle events on the queue
 			while (SDL_PollEvent(&e) != 0) 
 			{
@@ -188,6 +461,12 @@ int main( int argc, char* args[])
 					quit = true;
 				}
 
+				// the window lost what it was showing
+				else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_EXPOSED)
+				{
+					gDamage.damageAll();
+				}
+
 				// If the user presses a key
 				else if (e.type == SDL_KEYDOWN)
 				{
@@ -218,11 +497,28 @@ int main( int argc, char* args[])
 				}
 			}
 		
-			// apply the image
-			SDL_BlitSurface( gCurrentSurface, NULL, gScreenSurface, NULL);
+			// apply the image, skipped when it's already there
+			gDamage.blit(gCurrentSurface, NULL, NULL);
+
+			// update what changed, or sleep until something happens
+			if (!gDamage.present())
+			{
+				SDL_WaitEventTimeout(NULL, DAMAGE_IDLE_WAIT_MS);
+			}
 
-			// update the surface
-			SDL_UpdateWindowSurface(gWindow);
+			// the benchmark ends itself
+			if (benchFrames > 0 && ++frame >= benchFrames)
+			{
+				quit = true;
+			}
+		}
+
+		if (benchFrames > 0)
+		{
+			double wallSeconds = (SDL_GetPerformanceCounter() - wallStart) / (double)SDL_GetPerformanceFrequency();
+			double cpuSeconds = (clock() - cpuStart) / (double)CLOCKS_PER_SEC;
+			gDamage.printStats();
+			printf("%.2f s of CPU over %.2f s (%.0f%% of a core), %.3f ms of CPU per frame\n", cpuSeconds, wallSeconds, cpuSeconds * 100.0 / wallSeconds, cpuSeconds * 1000.0 / frame);
 		}
 	}
 
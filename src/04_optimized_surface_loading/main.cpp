@@ -2,6 +2,21 @@
 #include <SDL2/SDL.h>
 #include <stdio.h>
 #include <string>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// the row converter's SIMD paths are x86 only, everything else converts with the scalar code
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LOADER_X86 1
+#else
+#define LOADER_X86 0
+#endif
 
 // ========================== Constants and Enums ==========================
 const int SCREEN_WIDTH = 1280;
@@ -18,6 +33,328 @@ enum KeyPressSurfaces
 	KEY_PRESS_SURFACE_TOTAL
 };
 
+// longest an idle frame sleeps waiting for an event
+const int DAMAGE_IDLE_WAIT_MS = 16;
+
+// Damage benchmark constants, a key press every half second at 60 fps
+const int DAMAGE_BENCH_FRAMES = 300;
+const int DAMAGE_BENCH_KEY_INTERVAL = 30;
+
+// Scale benchmark constants
+const int SCALE_BENCH_BLITS = 200;
+
+// Load benchmark constants, 4K images
+const int LOAD_BENCH_IMAGES = 4;
+const int LOAD_BENCH_WIDTH = 3840;
+const int LOAD_BENCH_HEIGHT = 2160;
+const int LOAD_BENCH_ROUNDS = 3;
+
+// the row converter code paths, best one picked at runtime
+enum LConvertSimd
+{
+	CONVERT_SIMD_SCALAR,
+	CONVERT_SIMD_SSSE3,
+	CONVERT_SIMD_AVX2
+};
+
+// ========================== Damage Tracker Class (with implementation) ==========================
+class LDamageTracker
+{
+	private:
+		// a blit that is still intact on the window surface
+		struct Blit
+		{
+			SDL_Surface* source;
+			SDL_Rect sourceRect;
+			SDL_Rect destRect;
+			bool scaled;
+		};
+
+		SDL_Window* mWindow;
+		SDL_Surface* mSurface;
+
+		// what's on the surface, and the parts of it the window hasn't been shown yet
+		std::vector<Blit> mOnScreen;
+		std::vector<SDL_Rect> mDamage;
+
+		// off means every blit happens and every present is the whole window, like before
+		bool mEnabled;
+
+		// frames, frames that presented something, and bytes blitted and presented
+		Uint64 mFrames;
+		Uint64 mPresentedFrames;
+		Uint64 mBlitBytes;
+		Uint64 mPresentBytes;
+
+		static bool sameRect(const SDL_Rect& a, const SDL_Rect& b)
+		{
+			return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+		}
+
+		// grows a to cover b
+		static void unionRect(SDL_Rect* a, const SDL_Rect& b)
+		{
+			int right = std::max(a->x + a->w, b.x + b.w);
+			int bottom = std::max(a->y + a->h, b.y + b.h);
+			a->x = std::min(a->x, b.x);
+			a->y = std::min(a->y, b.y);
+			a->w = right - a->x;
+			a->h = bottom - a->y;
+		}
+
+		// overlapping or touching rects become one, so the window gets a few big copies instead of many slivers
+		void mergeDamage()
+		{
+			bool merged = true;
+			while (merged)
+			{
+				merged = false;
+				for (int i = 0; i < (int)mDamage.size() && !merged; ++i)
+				{
+					for (int j = i + 1; j < (int)mDamage.size(); ++j)
+					{
+						SDL_Rect grown = {mDamage[i].x - 1, mDamage[i].y - 1, mDamage[i].w + 2, mDamage[i].h + 2};
+						if (SDL_HasIntersection(&grown, &mDamage[j]))
+						{
+							unionRect(&mDamage[i], mDamage[j]);
+							mDamage.erase(mDamage.begin() + j);
+							merged = true;
+							break;
+						}
+					}
+				}
+			}
+		}
+
+	public:
+		// inits variables
+		LDamageTracker()
+		{
+			mWindow = NULL;
+			mSurface = NULL;
+			mEnabled = true;
+			mFrames = 0;
+			mPresentedFrames = 0;
+			mBlitBytes = 0;
+			mPresentBytes = 0;
+		}
+
+		// Starts tracking the window's surface, all of it needs showing
+		void setWindow(SDL_Window* window)
+		{
+			mWindow = window;
+			mSurface = SDL_GetWindowSurface(window);
+			mOnScreen.clear();
+			damageAll();
+		}
+
+		void setEnabled(bool enabled)
+		{
+			mEnabled = enabled;
+		}
+
+		// Blits onto the window surface, scaled to fill destRect if asked, and remembers the rect as changed
+		// the same blit as the one already there is skipped, NULL rects mean the whole surface
+		int blit(SDL_Surface* source, const SDL_Rect* sourceRect, const SDL_Rect* destRect, bool scaled = false)
+		{
+			Blit next;
+			next.source = source;
+			next.sourceRect.x = 0;
+			next.sourceRect.y = 0;
+			next.sourceRect.w = source->w;
+			next.sourceRect.h = source->h;
+			if (sourceRect != NULL)
+			{
+				next.sourceRect = *sourceRect;
+			}
+			next.destRect.x = 0;
+			next.destRect.y = 0;
+			next.destRect.w = scaled ? mSurface->w : next.sourceRect.w;
+			next.destRect.h = scaled ? mSurface->h : next.sourceRect.h;
+			if (destRect != NULL)
+			{
+				next.destRect.x = destRect->x;
+				next.destRect.y = destRect->y;
+				if (scaled)
+				{
+					next.destRect.w = destRect->w;
+					next.destRect.h = destRect->h;
+				}
+			}
+			next.scaled = scaled;
+
+			// nothing would change
+			for (int i = 0; mEnabled && i < (int)mOnScreen.size(); ++i)
+			{
+				const Blit& shown = mOnScreen[i];
+				if (shown.source == source && shown.scaled == scaled && sameRect(shown.sourceRect, next.sourceRect) && sameRect(shown.destRect, next.destRect))
+				{
+					return 0;
+				}
+			}
+
+			// SDL clips the rect it's given to what it actually wrote
+			SDL_Rect written = next.destRect;
+			int result = scaled ? SDL_BlitScaled(source, &next.sourceRect, mSurface, &written) : SDL_BlitSurface(source, &next.sourceRect, mSurface, &written);
+			if (result < 0)
+			{
+				printf("Unable to blit! SDL_Error: %s\n", SDL_GetError());
+				return result;
+			}
+			mBlitBytes += (Uint64)written.w * written.h * mSurface->format->BytesPerPixel;
+
+			// anything this covered any part of isn't intact anymore
+			for (int i = (int)mOnScreen.size() - 1; i >= 0; --i)
+			{
+				if (SDL_HasIntersection(&mOnScreen[i].destRect, &written))
+				{
+					mOnScreen.erase(mOnScreen.begin() + i);
+				}
+			}
+			mOnScreen.push_back(next);
+			if (written.w > 0 && written.h > 0)
+			{
+				mDamage.push_back(written);
+			}
+			return result;
+		}
+
+		// Marks the whole window as needing to be shown again, for when the system lost what it showed
+		void damageAll()
+		{
+			SDL_Rect all = {0, 0, mSurface->w, mSurface->h};
+			mDamage.clear();
+			mDamage.push_back(all);
+		}
+
+		// Shows the changed parts of the surface on the window, false if nothing changed and nothing was shown
+		bool present()
+		{
+			++mFrames;
+			if (!mEnabled)
+			{
+				damageAll();
+			}
+			if (mDamage.empty())
+			{
+				return false;
+			}
+
+			mergeDamage();
+			for (int i = 0; i < (int)mDamage.size(); ++i)
+			{
+				mPresentBytes += (Uint64)mDamage[i].w * mDamage[i].h * mSurface->format->BytesPerPixel;
+			}
+			if (mEnabled)
+			{
+				SDL_UpdateWindowSurfaceRects(mWindow, &mDamage[0], mDamage.size());
+			}
+			else
+			{
+				SDL_UpdateWindowSurface(mWindow);
+			}
+
+			mDamage.clear();
+			++mPresentedFrames;
+			return true;
+		}
+
+		void printStats()
+		{
+			if (mFrames == 0)
+			{
+				return;
+			}
+			printf("%s: %llu frames, %llu presented, %.1f KB blitted and %.1f KB presented per frame\n", mEnabled ? "damage tracking" : "full redraw",
+				(unsigned long long)mFrames, (unsigned long long)mPresentedFrames, mBlitBytes / 1024.0 / mFrames, mPresentBytes / 1024.0 / mFrames);
+		}
+};
+
+
+
+// ========================== Scaled Surface Cache Class (with implementation) ==========================
+// how a cached surface gets scaled, linear needs SDL 2.0.16
+enum LScaleFilter
+{
+	SCALE_FILTER_NEAREST,
+	SCALE_FILTER_LINEAR
+};
+
+class LScaledSurfaceCache
+{
+	private:
+		// one source scaled to one size with one filter
+		struct Entry
+		{
+			SDL_Surface* source;
+			int width;
+			int height;
+			LScaleFilter filter;
+			SDL_Surface* scaled;
+		};
+
+		std::vector<Entry> mEntries;
+
+	public:
+		// Frees the scaled surfaces
+		~LScaledSurfaceCache()
+		{
+			clear();
+		}
+
+		// Gets source scaled to width x height in format, scaling it the first time it's asked for
+		// the cache owns what it returns, it stays valid until clear
+		SDL_Surface* get(SDL_Surface* source, int width, int height, LScaleFilter filter, SDL_PixelFormat* format)
+		{
+			for (int i = 0; i < (int)mEntries.size(); ++i)
+			{
+				const Entry& entry = mEntries[i];
+				if (entry.source == source && entry.width == width && entry.height == height && entry.filter == filter)
+				{
+					return entry.scaled;
+				}
+			}
+
+			SDL_Surface* scaled = SDL_CreateRGBSurfaceWithFormat(0, width, height, format->BitsPerPixel, format->format);
+			if (scaled == NULL)
+			{
+				printf("Unable to create scaled surface! SDL_Error: %s\n", SDL_GetError());
+				return NULL;
+			}
+
+			// a straight copy of the pixels, not blended onto whatever the new surface starts as
+			SDL_BlendMode blendMode;
+			SDL_GetSurfaceBlendMode(source, &blendMode);
+			SDL_SetSurfaceBlendMode(source, SDL_BLENDMODE_NONE);
+			int result = filter == SCALE_FILTER_LINEAR ? SDL_SoftStretchLinear(source, NULL, scaled, NULL) : SDL_BlitScaled(source, NULL, scaled, NULL);
+			SDL_SetSurfaceBlendMode(source, blendMode);
+			if (result < 0)
+			{
+				printf("Unable to scale surface! SDL_Error: %s\n", SDL_GetError());
+				SDL_FreeSurface(scaled);
+				return NULL;
+			}
+
+			Entry entry = {source, width, height, filter, scaled};
+			mEntries.push_back(entry);
+			return scaled;
+		}
+
+		// Frees every scaled surface, for when the sizes or format they were made for change
+		void clear()
+		{
+			for (int i = 0; i < (int)mEntries.size(); ++i)
+			{
+				SDL_FreeSurface(mEntries[i].scaled);
+			}
+			mEntries.clear();
+		}
+
+		int getCount()
+		{
+			return mEntries.size();
+		}
+};
 
 // ========================== Function Delcarations ==========================
 // loads up SDL and creates window
@@ -29,9 +366,41 @@ bool loadMedia();
 // Frees media and shuts down SDL
 void close();
 
-// Loads individual image
+// Loads individual image in the screen format
 SDL_Surface* loadSurface(std::string path);
 
+// Loads an image and then converts it to the screen format, two surfaces at once
+SDL_Surface* loadSurfaceConverted(std::string path);
+
+// Loads a 24 bit BMP straight into a surface of a 32 bit format a row at a time, NULL if it can't
+SDL_Surface* loadBMPFused(std::string path, SDL_PixelFormat* format);
+
+// Converts a row of BGR file pixels to 32 bit ones with an opaque alpha, red and blue swapped if asked
+void convertRowBGR24(const Uint8* source, Uint32* dest, int width, bool swapRedBlue, LConvertSimd simd);
+void convertRowBGR24Scalar(const Uint8* source, Uint32* dest, int width, bool swapRedBlue);
+LConvertSimd getBestConvertSimd();
+
+// Queues the scripted key press for a frame of the damage benchmark, if it has one
+void pushBenchKey(int frame);
+
+// Compares scaling every blit with blitting from the scaled surface cache, in megapixels a second
+void runScaleBenchmark();
+
+// Highest memory use of this process so far
+long getPeakRssKb();
+
+// Writes a large 24 bit BMP for the load benchmark
+bool makeBenchImage(std::string path, int seed);
+
+// Whether two surfaces of the same format have the same colors
+bool sameColors(SDL_Surface* a, SDL_Surface* b);
+
+// Makes the load benchmark images if they're missing and checks both loaders agree on them
+bool prepareLoadBenchmark(std::vector<std::string>& paths);
+
+// Times loading large images both ways and how much memory each needs at its peak
+void runLoadBenchmark();
+
 // ========================== Global Variables ==========================
 // The window we are going to render to
 SDL_Window* gWindow = NULL;
@@ -45,6 +414,13 @@ SDL_Surface* gCurrentSurface = NULL;
 // The images that correspond to a key press
 SDL_Surface* gKeyPressSurfaces[KEY_PRESS_SURFACE_TOTAL];
 
+// Everything drawn on the window surface goes through here
+LDamageTracker gDamage;
+
+// The key press images scaled to the window, and how
+LScaledSurfaceCache gScaledSurfaces;
+LScaleFilter gScaleFilter = SCALE_FILTER_NEAREST;
+
 // ========================== Function Definitions ==========================
 bool init()
 {
@@ -60,7 +436,7 @@ bool init()
 	else
 	{
 		// Create the window
-		gWindow = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+		gWindow = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
 		if (gWindow == NULL)
 		{ 
 		  printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
@@ -70,6 +446,7 @@ bool init()
 		{
 		  // Get the window surface
 		  gScreenSurface = SDL_GetWindowSurface(gWindow);
+		  gDamage.setWindow(gWindow);
 		}
 	}
 	
@@ -126,6 +503,9 @@ bool loadMedia()
 
 void close()
 {
+	// the scaled copies first, they're keyed by the originals
+	gScaledSurfaces.clear();
+
 	// deallocate all surfaces
 	for (int i = 0; i < KEY_PRESS_SURFACE_TOTAL; ++i)
 	{
@@ -142,6 +522,18 @@ void close()
 }
 
 SDL_Surface* loadSurface(std::string path)
+{
+	// straight into the screen format when the loader knows the file, the old way when it doesn't
+	SDL_Surface* optimizedSurface = loadBMPFused(path, gScreenSurface->format);
+	if (optimizedSurface == NULL)
+	{
+		optimizedSurface = loadSurfaceConverted(path);
+	}
+
+	return optimizedSurface;
+}
+
+SDL_Surface* loadSurfaceConverted(std::string path)
 {
 	// The final optimized surface
 	SDL_Surface* optimizedSurface = NULL;
@@ -167,8 +559,419 @@ SDL_Surface* loadSurface(std::string path)
 
 	return optimizedSurface;
 }
+
+SDL_Surface* loadBMPFused(std::string path, SDL_PixelFormat* format)
+{
+	// 32 bit little endian destinations with red and blue in either order, alpha or not
+	bool swapRedBlue = format->Rmask == 0x000000FF && format->Bmask == 0x00FF0000;
+	bool sameOrder = format->Rmask == 0x00FF0000 && format->Bmask == 0x000000FF;
+	if (SDL_BYTEORDER != SDL_LIL_ENDIAN || format->BytesPerPixel != 4 || format->Gmask != 0x0000FF00 || (!swapRedBlue && !sameOrder))
+	{
+		return NULL;
+	}
+
+	SDL_RWops* file = SDL_RWFromFile(path.c_str(), "rb");
+	if (file == NULL)
+	{
+		return NULL;
+	}
+
+	// file header then the info header, only plain uncompressed 24 bit bitmaps
+	Uint8 header[54];
+	if (SDL_RWread(file, header, sizeof(header), 1) != 1 || header[0] != 'B' || header[1] != 'M')
+	{
+		SDL_RWclose(file);
+		return NULL;
+	}
+	Uint32 pixelOffset = header[10] | header[11] << 8 | header[12] << 16 | (Uint32)header[13] << 24;
+	Uint32 infoSize = header[14] | header[15] << 8 | header[16] << 16 | (Uint32)header[17] << 24;
+	Sint32 width = header[18] | header[19] << 8 | header[20] << 16 | (Uint32)header[21] << 24;
+	Sint32 height = header[22] | header[23] << 8 | header[24] << 16 | (Uint32)header[25] << 24;
+	Uint16 bitsPerPixel = header[28] | header[29] << 8;
+	Uint32 compression = header[30] | header[31] << 8 | header[32] << 16 | (Uint32)header[33] << 24;
+	if (infoSize < 40 || width <= 0 || height == 0 || bitsPerPixel != 24 || compression != 0)
+	{
+		SDL_RWclose(file);
+		return NULL;
+	}
+
+	// rows are stored bottom up unless the height is negative
+	bool topDown = height < 0;
+	height = topDown ? -height : height;
+
+	SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, format->format);
+	if (surface == NULL)
+	{
+		printf("Unable to create surface for %s! SDL_Error: %s\n", path.c_str(), SDL_GetError());
+		SDL_RWclose(file);
+		return NULL;
+	}
+
+	// one row of the file at a time, with room for the converters to read past the end
+	int rowBytes = (width * 3 + 3) & ~3;
+	std::vector<Uint8> row(rowBytes + 32);
+	LConvertSimd simd = getBestConvertSimd();
+	SDL_RWseek(file, pixelOffset, RW_SEEK_SET);
+	for (int y = 0; y < height; ++y)
+	{
+		if (SDL_RWread(file, &row[0], rowBytes, 1) != 1)
+		{
+			printf("Unable to read image %s! SDL_Error: %s\n", path.c_str(), SDL_GetError());
+			SDL_FreeSurface(surface);
+			SDL_RWclose(file);
+			return NULL;
+		}
+
+		int destY = topDown ? y : height - 1 - y;
+		Uint32* dest = (Uint32*)((Uint8*)surface->pixels + destY * surface->pitch);
+		convertRowBGR24(&row[0], dest, width, swapRedBlue, simd);
+	}
+
+	SDL_RWclose(file);
+	return surface;
+}
+
+void convertRowBGR24Scalar(const Uint8* source, Uint32* dest, int width, bool swapRedBlue)
+{
+	for (int x = 0; x < width; ++x)
+	{
+		Uint32 blue = source[x * 3];
+		Uint32 green = source[x * 3 + 1];
+		Uint32 red = source[x * 3 + 2];
+		dest[x] = swapRedBlue ? 0xFF000000 | blue << 16 | green << 8 | red : 0xFF000000 | red << 16 | green << 8 | blue;
+	}
+}
+
+#if LOADER_X86
+// four pixels from twelve bytes, with an opaque alpha byte put in
+__attribute__((target("ssse3")))
+int convertRowBGR24Ssse3(const Uint8* source, Uint32* dest, int width, bool swapRedBlue)
+{
+	const __m128i shuffle = swapRedBlue ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1) : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32(0xFF000000);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(source + x * 3));
+		_mm_storeu_si128((__m128i*)(dest + x), _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha));
+	}
+	return x;
+}
+
+// the same eight at a time, a twelve byte group in each lane
+__attribute__((target("avx2")))
+int convertRowBGR24Avx2(const Uint8* source, Uint32* dest, int width, bool swapRedBlue)
+{
+	const __m256i shuffle = swapRedBlue ? _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+		: _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i alpha = _mm256_set1_epi32(0xFF000000);
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		__m128i low = _mm_loadu_si128((const __m128i*)(source + x * 3));
+		__m128i high = _mm_loadu_si128((const __m128i*)(source + x * 3 + 12));
+		__m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+		_mm256_storeu_si256((__m256i*)(dest + x), _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+	}
+	return x;
+}
+#endif
+
+void convertRowBGR24(const Uint8* source, Uint32* dest, int width, bool swapRedBlue, LConvertSimd simd)
+{
+	// whole vectors first, the scalar code finishes the row
+	int done = 0;
+	switch (simd)
+	{
+		#if LOADER_X86
+		case CONVERT_SIMD_AVX2: done = convertRowBGR24Avx2(source, dest, width, swapRedBlue); break;
+		case CONVERT_SIMD_SSSE3: done = convertRowBGR24Ssse3(source, dest, width, swapRedBlue); break;
+		#endif
+		default: break;
+	}
+	convertRowBGR24Scalar(source + done * 3, dest + done, width - done, swapRedBlue);
+}
+
+LConvertSimd getBestConvertSimd()
+{
+	#if LOADER_X86
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return CONVERT_SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("ssse3"))
+	{
+		return CONVERT_SIMD_SSSE3;
+	}
+	#endif
+	return CONVERT_SIMD_SCALAR;
+}
+
+void pushBenchKey(int frame)
+{
+	if (frame % DAMAGE_BENCH_KEY_INTERVAL != 0)
+	{
+		return;
+	}
+
+	// round the arrows and then some other key
+	SDL_Keycode keys[5] = {SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT, SDLK_SPACE};
+	SDL_Event e;
+	memset(&e, 0, sizeof(e));
+	e.type = SDL_KEYDOWN;
+	e.key.keysym.sym = keys[frame / DAMAGE_BENCH_KEY_INTERVAL % 5];
+	SDL_PushEvent(&e);
+}
+
+void runScaleBenchmark()
+{
+	SDL_Surface* source = gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT];
+	SDL_Rect stretchedRect = {0, 0, gScreenSurface->w, gScreenSurface->h};
+	double megapixels = SCALE_BENCH_BLITS * (double)stretchedRect.w * stretchedRect.h / 1000000.0;
+	double frequency = (double)SDL_GetPerformanceFrequency();
+
+	// what every frame used to do
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < SCALE_BENCH_BLITS; ++i)
+	{
+		SDL_Rect rect = stretchedRect;
+		SDL_BlitScaled(source, NULL, gScreenSurface, &rect);
+	}
+	double seconds = (SDL_GetPerformanceCounter() - start) / frequency;
+	printf("SDL_BlitScaled %dx%d to %dx%d: %.1f megapixels/s\n", source->w, source->h, stretchedRect.w, stretchedRect.h, megapixels / seconds);
+
+	const char* filterNames[2] = {"nearest", "linear"};
+	for (int filter = SCALE_FILTER_NEAREST; filter <= SCALE_FILTER_LINEAR; ++filter)
+	{
+		// scaled once
+		LScaledSurfaceCache cache;
+		start = SDL_GetPerformanceCounter();
+		SDL_Surface* scaled = cache.get(source, stretchedRect.w, stretchedRect.h, (LScaleFilter)filter, gScreenSurface->format);
+		double scaleMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+		if (scaled == NULL)
+		{
+			continue;
+		}
+
+		// and then a plain copy every frame
+		start = SDL_GetPerformanceCounter();
+		for (int i = 0; i < SCALE_BENCH_BLITS; ++i)
+		{
+			SDL_Rect rect = stretchedRect;
+			SDL_BlitSurface(cache.get(source, stretchedRect.w, stretchedRect.h, (LScaleFilter)filter, gScreenSurface->format), NULL, gScreenSurface, &rect);
+		}
+		seconds = (SDL_GetPerformanceCounter() - start) / frequency;
+		printf("cached %-7s: scaled once in %.2f ms, then %.1f megapixels/s\n", filterNames[filter], scaleMs, megapixels / seconds);
+	}
+}
+
+long getPeakRssKb()
+{
+	// kilobytes on Linux, bytes on macOS
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;
+	#else
+	return usage.ru_maxrss;
+	#endif
+}
+
+bool makeBenchImage(std::string path, int seed)
+{
+	SDL_Surface* image = SDL_CreateRGBSurfaceWithFormat(0, LOAD_BENCH_WIDTH, LOAD_BENCH_HEIGHT, 24, SDL_PIXELFORMAT_BGR24);
+	if (image == NULL)
+	{
+		printf("Unable to create benchmark image! SDL_Error: %s\n", SDL_GetError());
+		return false;
+	}
+
+	// gradients with some noise, so no channel is flat
+	srand(seed);
+	for (int y = 0; y < image->h; ++y)
+	{
+		Uint8* row = (Uint8*)image->pixels + y * image->pitch;
+		for (int x = 0; x < image->w; ++x)
+		{
+			row[x * 3] = (Uint8)(x * 255 / image->w);
+			row[x * 3 + 1] = (Uint8)(y * 255 / image->h);
+			row[x * 3 + 2] = (Uint8)(rand() & 0xFF);
+		}
+	}
+
+	bool success = SDL_SaveBMP(image, path.c_str()) == 0;
+	if (!success)
+	{
+		printf("Unable to save benchmark image %s! SDL_Error: %s\n", path.c_str(), SDL_GetError());
+	}
+	SDL_FreeSurface(image);
+	return success;
+}
+
+bool sameColors(SDL_Surface* a, SDL_Surface* b)
+{
+	if (a == NULL || b == NULL || a->w != b->w || a->h != b->h)
+	{
+		return false;
+	}
+
+	// only the color bits, what ends up in an unused byte doesn't matter
+	Uint32 mask = a->format->Rmask | a->format->Gmask | a->format->Bmask;
+	for (int y = 0; y < a->h; ++y)
+	{
+		const Uint32* rowA = (const Uint32*)((const Uint8*)a->pixels + y * a->pitch);
+		const Uint32* rowB = (const Uint32*)((const Uint8*)b->pixels + y * b->pitch);
+		for (int x = 0; x < a->w; ++x)
+		{
+			if ((rowA[x] & mask) != (rowB[x] & mask))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool prepareLoadBenchmark(std::vector<std::string>& paths)
+{
+	// a set of large images, made on the first run
+	for (int i = 0; i < (int)paths.size(); ++i)
+	{
+		SDL_RWops* existing = SDL_RWFromFile(paths[i].c_str(), "rb");
+		if (existing != NULL)
+		{
+			SDL_RWclose(existing);
+		}
+		else if (!makeBenchImage(paths[i], i))
+		{
+			return false;
+		}
+	}
+
+	// both loaders have to come out with the same pixels, on the chapter's own images too
+	std::vector<std::string> checked = paths;
+	checked.push_back("media/press.bmp");
+	checked.push_back("media/up.bmp");
+	for (int i = 0; i < (int)checked.size(); ++i)
+	{
+		SDL_Surface* converted = loadSurfaceConverted(checked[i]);
+		SDL_Surface* fused = loadBMPFused(checked[i], gScreenSurface->format);
+		if (fused == NULL)
+		{
+			printf("The fused loader can't load %s into the screen format!\n", checked[i].c_str());
+			SDL_FreeSurface(converted);
+			return false;
+		}
+		if (!sameColors(converted, fused))
+		{
+			printf("%s doesn't load the same both ways!\n", checked[i].c_str());
+		}
+		SDL_FreeSurface(converted);
+		SDL_FreeSurface(fused);
+	}
+	return true;
+}
+
+void runLoadBenchmark()
+{
+	std::vector<std::string> paths;
+	for (int i = 0; i < LOAD_BENCH_IMAGES; ++i)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "load_bench_%d.bmp", i);
+		paths.push_back(name);
+	}
+
+	// the images are made and checked in a process of their own too: freeing 4K surfaces here would raise
+	// glibc's mmap threshold and leave their pages resident for both timed children to reuse
+	fflush(stdout);
+	pid_t checker = fork();
+	if (checker == 0)
+	{
+		bool prepared = prepareLoadBenchmark(paths);
+		fflush(stdout);
+		_exit(prepared ? 0 : 1);
+	}
+	else if (checker < 0)
+	{
+		printf("Unable to start the benchmark process!\n");
+		return;
+	}
+	int status = 0;
+	waitpid(checker, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		return;
+	}
+
+	// each loader in a process of its own, so the peak memory is only its own
+	const char* names[2] = {"SDL_LoadBMP + SDL_ConvertSurface", "fused load and convert"};
+	for (int fused = 0; fused < 2; ++fused)
+	{
+		fflush(stdout);
+		pid_t child = fork();
+		if (child == 0)
+		{
+			long baselineKb = getPeakRssKb();
+			Uint64 start = SDL_GetPerformanceCounter();
+			for (int round = 0; round < LOAD_BENCH_ROUNDS; ++round)
+			{
+				for (int i = 0; i < (int)paths.size(); ++i)
+				{
+					SDL_FreeSurface(fused ? loadBMPFused(paths[i], gScreenSurface->format) : loadSurfaceConverted(paths[i]));
+				}
+			}
+			double imageMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() / (LOAD_BENCH_ROUNDS * paths.size());
+
+			printf("%-33s %dx%d: %.2f ms per image, peak memory %.1f MB above where it started\n", names[fused], LOAD_BENCH_WIDTH, LOAD_BENCH_HEIGHT,
+				imageMs, (getPeakRssKb() - baselineKb) / 1024.0);
+			fflush(stdout);
+			_exit(0);
+		}
+		else if (child < 0)
+		{
+			printf("Unable to start the benchmark process!\n");
+			return;
+		}
+		waitpid(child, NULL, 0);
+	}
+}
+
 int main( int argc, char* args[])
 { 
+	// --damage-bench runs a scripted key press scene headless, --no-damage redraws everything every frame like before
+	// --scale-bench times scaled blits headless, --linear scales the images smoothly
+	// --load-bench times the old and fused image loaders headless
+	int benchFrames = 0;
+	bool scaleBench = false;
+	bool loadBench = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(args[i], "--damage-bench") == 0)
+		{
+			benchFrames = DAMAGE_BENCH_FRAMES;
+			SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+		}
+		else if (strcmp(args[i], "--scale-bench") == 0)
+		{
+			scaleBench = true;
+			SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+		}
+		else if (strcmp(args[i], "--load-bench") == 0)
+		{
+			loadBench = true;
+			SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+		}
+		else if (strcmp(args[i], "--linear") == 0)
+		{
+			gScaleFilter = SCALE_FILTER_LINEAR;
+		}
+		else if (strcmp(args[i], "--no-damage") == 0)
+		{
+			gDamage.setEnabled(false);
+		}
+	}
+
  	// start up SDL and create the window
 	if (!init())
 	{
@@ -181,6 +984,18 @@ int main( int argc, char* args[])
 		{
 			printf("Failed to load media!\n");
 		}
+		else if (scaleBench)
+		{
+			runScaleBenchmark();
+			close();
+			return 0;
+		}
+		else if (loadBench)
+		{
+			runLoadBenchmark();
+			close();
+			return 0;
+		}
 		
 		// main loop
 		bool quit = false;
@@ -191,9 +1006,19 @@ int main( int argc, char* args[])
 		// Set the default image as the current surface
 		gCurrentSurface = gKeyPressSurfaces[KEY_PRESS_SURFACE_DEFAULT];
 
+		// what the benchmark measures from
+		int frame = 0;
+		clock_t cpuStart = clock();
+		Uint64 wallStart = SDL_GetPerformanceCounter();
+
 		// The main loop of the game
 		while (!quit) 
 		{
+			if (benchFrames > 0)
+			{
+				pushBenchKey(frame);
+			}
+
 			// handle events on the queue
 			while (SDL_PollEvent(&e) != 0) 
 			{
@@ -203,6 +1028,20 @@ int main( int argc, char* args[])
 					quit = true;
 				}
 
+				// the window lost what it was showing
+				else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_EXPOSED)
+				{
+					gDamage.damageAll();
+				}
+
+				// a new size means a new window surface, and the scaled images are the wrong size
+				else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+				{
+					gScreenSurface = SDL_GetWindowSurface(gWindow);
+					gDamage.setWindow(gWindow);
+					gScaledSurfaces.clear();
+				}
+
 				// If the user presses a key
 				else if (e.type == SDL_KEYDOWN)
 				{
@@ -237,14 +1076,35 @@ int main( int argc, char* args[])
 			SDL_Rect stretchedRect;
 			stretchedRect.x = 0;
 			stretchedRect.y = 0;
-			stretchedRect.w = SCREEN_WIDTH;
-			stretchedRect.h = SCREEN_HEIGHT;
+			stretchedRect.w = gScreenSurface->w;
+			stretchedRect.h = gScreenSurface->h;
 
-			// apply the image
-			SDL_BlitScaled(gCurrentSurface, NULL, gScreenSurface, &stretchedRect);
+			// apply the image scaled once ahead of time, skipped when it's already there
+			SDL_Surface* scaledSurface = gScaledSurfaces.get(gCurrentSurface, stretchedRect.w, stretchedRect.h, gScaleFilter, gScreenSurface->format);
+			if (scaledSurface != NULL)
+			{
+				gDamage.blit(scaledSurface, NULL, &stretchedRect);
+			}
 
-			// update the surface
-			SDL_UpdateWindowSurface(gWindow);
+			// update what changed, or sleep until something happens
+			if (!gDamage.present())
+			{
+				SDL_WaitEventTimeout(NULL, DAMAGE_IDLE_WAIT_MS);
+			}
+
+			// the benchmark ends itself
+			if (benchFrames > 0 && ++frame >= benchFrames)
+			{
+				quit = true;
+			}
+		}
+
+		if (benchFrames > 0)
+		{
+			double wallSeconds = (SDL_GetPerformanceCounter() - wallStart) / (double)SDL_GetPerformanceFrequency();
+			double cpuSeconds = (clock() - cpuStart) / (double)CLOCKS_PER_SEC;
+			gDamage.printStats();
+			printf("%.2f s of CPU over %.2f s (%.0f%% of a core), %.3f ms of CPU per frame\n", cpuSeconds, wallSeconds, cpuSeconds * 100.0 / wallSeconds, cpuSeconds * 1000.0 / frame);
 		}
 	}
 
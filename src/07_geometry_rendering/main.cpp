@@ -3,14 +3,82 @@
 #include <SDL2/SDL_image.h>
 #include <stdio.h>
 #include <string>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
 
 // ========================== Constants and Enums ==========================
 const int SCREEN_WIDTH = 1280;
 const int SCREEN_HEIGHT = 720;
 
+// Stress mode constants
+const int STRESS_POINTS = 1000000;
+const int STRESS_RECTS = 100000;
+const int STRESS_RECT_SIZE = 8;
+const int STRESS_COLORS = 8;
+const int STRESS_FRAMES = 10;
+
+// ========================== Primitive Batch Class ==========================
+class LPrimitiveBatch
+{
+	public:
+		// initializes internal variables
+		LPrimitiveBatch();
+
+		// state for the primitives that follow, changing it flushes the run queued so far
+		void setColor(Uint8 red, Uint8 green, Uint8 blue, Uint8 alpha = 0xFF);
+		void setBlendMode(SDL_BlendMode blending);
+
+		// queues primitives in the current color
+		void drawPoint(int x, int y);
+		void drawLine(int x1, int y1, int x2, int y2);
+		void drawRect(const SDL_Rect& rect);
+		void fillRect(const SDL_Rect& rect);
+
+		// queues a filled rect with its own corner colors (top left, top right, bottom right, bottom left)
+		void fillRect(const SDL_Rect& rect, SDL_Color topLeft, SDL_Color topRight, SDL_Color bottomRight, SDL_Color bottomLeft);
+
+		// submits everything queued, one call per kind of primitive
+		void flush();
+
+		// flushes and updates the screen
+		void present();
+
+		// primitives and renderer calls of the last presented frame
+		int getPrimitivesLastFrame();
+		int getCallsLastFrame();
+
+	private:
+		// submits the solid color primitives or the colored geometry
+		void flushSolid();
+		void flushGeometry();
+
+		// run state
+		SDL_Color mColor;
+		SDL_BlendMode mBlendMode;
+
+		// solid color primitives of the current run
+		std::vector<SDL_Point> mPoints;
+		std::vector<SDL_Rect> mFillRects;
+
+		// lines are kept as polylines, a line starting where the last one ended extends it
+		std::vector<SDL_Point> mLinePoints;
+		std::vector<int> mLineStarts;
+
+		// per vertex colored triangles, these ignore the run color
+		std::vector<SDL_Vertex> mVertices;
+		std::vector<int> mIndices;
+
+		// counters for the frame in progress and the last presented one
+		int mPrimitives;
+		int mCalls;
+		int mPrimitivesLastFrame;
+		int mCallsLastFrame;
+};
+
 // ========================== Function Delcarations ==========================
-// loads up SDL and creates window
-bool init();
+// loads up SDL and creates window (software renderer for stress testing)
+bool init(bool softwareRenderer = false);
 
 // loads media
 bool loadMedia();
@@ -21,6 +89,9 @@ void close();
 // Loads individual image
 SDL_Texture* loadTexture(std::string path);
 
+// Draws a million points and 100k rects per frame with and without batching and reports the throughput
+void runStressTest();
+
 // ========================== Global Variables ==========================
 // The window we are going to render to
 SDL_Window* gWindow = NULL;
@@ -31,8 +102,222 @@ SDL_Renderer* gRenderer = NULL;
 // The current texture being displayed 
 SDL_Texture* gTexture = NULL;
 
+// Every primitive goes through here
+LPrimitiveBatch gPrimitiveBatch;
+
+// ========================== Primitive Batch Class Function Definitions ==========================
+LPrimitiveBatch::LPrimitiveBatch()
+{
+	// initialize
+	mColor.r = 0xFF;
+	mColor.g = 0xFF;
+	mColor.b = 0xFF;
+	mColor.a = 0xFF;
+	mBlendMode = SDL_BLENDMODE_NONE;
+	mPrimitives = 0;
+	mCalls = 0;
+	mPrimitivesLastFrame = 0;
+	mCallsLastFrame = 0;
+}
+
+void LPrimitiveBatch::setColor(Uint8 red, Uint8 green, Uint8 blue, Uint8 alpha)
+{
+	// same run, keep queueing
+	if (red == mColor.r && green == mColor.g && blue == mColor.b && alpha == mColor.a)
+	{
+		return;
+	}
+
+	flushSolid();
+	mColor.r = red;
+	mColor.g = green;
+	mColor.b = blue;
+	mColor.a = alpha;
+}
+
+void LPrimitiveBatch::setBlendMode(SDL_BlendMode blending)
+{
+	if (blending != mBlendMode)
+	{
+		flush();
+		mBlendMode = blending;
+	}
+}
+
+void LPrimitiveBatch::drawPoint(int x, int y)
+{
+	// keep the draw order with the colored geometry
+	if (!mVertices.empty())
+	{
+		flushGeometry();
+	}
+
+	SDL_Point point = {x, y};
+	mPoints.push_back(point);
+	++mPrimitives;
+}
+
+void LPrimitiveBatch::drawLine(int x1, int y1, int x2, int y2)
+{
+	if (!mVertices.empty())
+	{
+		flushGeometry();
+	}
+
+	// start a new polyline unless this one picks up where the last ended
+	bool connected = !mLinePoints.empty() && mLinePoints.back().x == x1 && mLinePoints.back().y == y1;
+	if (!connected)
+	{
+		SDL_Point start = {x1, y1};
+		mLineStarts.push_back(mLinePoints.size());
+		mLinePoints.push_back(start);
+	}
+
+	SDL_Point end = {x2, y2};
+	mLinePoints.push_back(end);
+	++mPrimitives;
+}
+
+void LPrimitiveBatch::drawRect(const SDL_Rect& rect)
+{
+	// a closed polyline, the same pixels SDL_RenderDrawRect touches
+	int right = rect.x + rect.w - 1;
+	int bottom = rect.y + rect.h - 1;
+	drawLine(rect.x, rect.y, right, rect.y);
+	drawLine(right, rect.y, right, bottom);
+	drawLine(right, bottom, rect.x, bottom);
+	drawLine(rect.x, bottom, rect.x, rect.y);
+
+	// four lines counted as one rect
+	mPrimitives -= 3;
+}
+
+void LPrimitiveBatch::fillRect(const SDL_Rect& rect)
+{
+	if (!mVertices.empty())
+	{
+		flushGeometry();
+	}
+
+	mFillRects.push_back(rect);
+	++mPrimitives;
+}
+
+void LPrimitiveBatch::fillRect(const SDL_Rect& rect, SDL_Color topLeft, SDL_Color topRight, SDL_Color bottomRight, SDL_Color bottomLeft)
+{
+	// solid primitives queued before this have to land first
+	flushSolid();
+
+	// two triangles sharing the diagonal
+	int first = mVertices.size();
+	SDL_Vertex vertex;
+	vertex.tex_coord.x = 0.0f;
+	vertex.tex_coord.y = 0.0f;
+
+	vertex.position.x = rect.x;
+	vertex.position.y = rect.y;
+	vertex.color = topLeft;
+	mVertices.push_back(vertex);
+
+	vertex.position.x = rect.x + rect.w;
+	vertex.color = topRight;
+	mVertices.push_back(vertex);
+
+	vertex.position.y = rect.y + rect.h;
+	vertex.color = bottomRight;
+	mVertices.push_back(vertex);
+
+	vertex.position.x = rect.x;
+	vertex.color = bottomLeft;
+	mVertices.push_back(vertex);
+
+	int quad[6] = {0, 1, 2, 0, 2, 3};
+	for (int i = 0; i < 6; ++i)
+	{
+		mIndices.push_back(first + quad[i]);
+	}
+	++mPrimitives;
+}
+
+void LPrimitiveBatch::flush()
+{
+	flushSolid();
+	flushGeometry();
+}
+
+void LPrimitiveBatch::flushSolid()
+{
+	if (mPoints.empty() && mLinePoints.empty() && mFillRects.empty())
+	{
+		return;
+	}
+
+	// one color set for the whole run
+	SDL_SetRenderDrawBlendMode(gRenderer, mBlendMode);
+	SDL_SetRenderDrawColor(gRenderer, mColor.r, mColor.g, mColor.b, mColor.a);
+
+	if (!mFillRects.empty())
+	{
+		SDL_RenderFillRects(gRenderer, &mFillRects[0], mFillRects.size());
+		mFillRects.clear();
+		++mCalls;
+	}
+
+	for (int i = 0; i < (int)mLineStarts.size(); ++i)
+	{
+		int end = i + 1 < (int)mLineStarts.size() ? mLineStarts[i + 1] : mLinePoints.size();
+		SDL_RenderDrawLines(gRenderer, &mLinePoints[mLineStarts[i]], end - mLineStarts[i]);
+		++mCalls;
+	}
+	mLinePoints.clear();
+	mLineStarts.clear();
+
+	if (!mPoints.empty())
+	{
+		SDL_RenderDrawPoints(gRenderer, &mPoints[0], mPoints.size());
+		mPoints.clear();
+		++mCalls;
+	}
+}
+
+void LPrimitiveBatch::flushGeometry()
+{
+	if (mVertices.empty())
+	{
+		return;
+	}
+
+	SDL_SetRenderDrawBlendMode(gRenderer, mBlendMode);
+	SDL_RenderGeometry(gRenderer, NULL, &mVertices[0], mVertices.size(), &mIndices[0], mIndices.size());
+	mVertices.clear();
+	mIndices.clear();
+	++mCalls;
+}
+
+void LPrimitiveBatch::present()
+{
+	flush();
+	SDL_RenderPresent(gRenderer);
+
+	// roll the counters over
+	mPrimitivesLastFrame = mPrimitives;
+	mCallsLastFrame = mCalls;
+	mPrimitives = 0;
+	mCalls = 0;
+}
+
+int LPrimitiveBatch::getPrimitivesLastFrame()
+{
+	return mPrimitivesLastFrame;
+}
+
+int LPrimitiveBatch::getCallsLastFrame()
+{
+	return mCallsLastFrame;
+}
+
 // ========================== Function Definitions ==========================
-bool init()
+bool init(bool softwareRenderer)
 {
 	// Initialization flag
 	bool success = true;
@@ -55,7 +340,7 @@ bool init()
 		else
 		{
 			// initialize the renderer for the window
-			gRenderer = SDL_CreateRenderer(gWindow, -1, SDL_RENDERER_ACCELERATED);
+			gRenderer = SDL_CreateRenderer(gWindow, -1, softwareRenderer ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED);
 			if (gRenderer == NULL)
 			{
 				printf("Renderer could not be initialized! SDL_Error: %s\n", SDL_GetError());
@@ -118,10 +403,101 @@ SDL_Texture* loadTexture(std::string path)
 	return newTexture;
 }
 
+void runStressTest()
+{
+	// the same scene for both runs, grouped by color like layered particles would be
+	std::vector<SDL_Point> points(STRESS_POINTS);
+	std::vector<SDL_Rect> rects(STRESS_RECTS);
+	SDL_Color colors[STRESS_COLORS];
+	srand(7);
+	for (int i = 0; i < STRESS_COLORS; ++i)
+	{
+		colors[i].r = rand() % 256;
+		colors[i].g = rand() % 256;
+		colors[i].b = rand() % 256;
+		colors[i].a = 0xFF;
+	}
+	for (int i = 0; i < STRESS_POINTS; ++i)
+	{
+		points[i].x = rand() % SCREEN_WIDTH;
+		points[i].y = rand() % SCREEN_HEIGHT;
+	}
+	for (int i = 0; i < STRESS_RECTS; ++i)
+	{
+		rects[i].x = rand() % (SCREEN_WIDTH - STRESS_RECT_SIZE);
+		rects[i].y = rand() % (SCREEN_HEIGHT - STRESS_RECT_SIZE);
+		rects[i].w = STRESS_RECT_SIZE;
+		rects[i].h = STRESS_RECT_SIZE;
+	}
+	int pointsPerColor = STRESS_POINTS / STRESS_COLORS;
+	int rectsPerColor = STRESS_RECTS / STRESS_COLORS;
+
+	// first one call per primitive with the color set every time, then batched
+	for (int run = 0; run < 2; ++run)
+	{
+		int calls = 0;
+		Uint64 start = SDL_GetPerformanceCounter();
+		for (int frame = 0; frame < STRESS_FRAMES; ++frame)
+		{
+			SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
+			SDL_RenderClear(gRenderer);
+
+			for (int i = 0; i < STRESS_RECTS; ++i)
+			{
+				SDL_Color color = colors[i / rectsPerColor % STRESS_COLORS];
+				if (run == 0)
+				{
+					SDL_SetRenderDrawColor(gRenderer, color.r, color.g, color.b, color.a);
+					SDL_RenderFillRect(gRenderer, &rects[i]);
+					++calls;
+				}
+				else
+				{
+					gPrimitiveBatch.setColor(color.r, color.g, color.b, color.a);
+					gPrimitiveBatch.fillRect(rects[i]);
+				}
+			}
+
+			for (int i = 0; i < STRESS_POINTS; ++i)
+			{
+				SDL_Color color = colors[i / pointsPerColor % STRESS_COLORS];
+				if (run == 0)
+				{
+					SDL_SetRenderDrawColor(gRenderer, color.r, color.g, color.b, color.a);
+					SDL_RenderDrawPoint(gRenderer, points[i].x, points[i].y);
+					++calls;
+				}
+				else
+				{
+					gPrimitiveBatch.setColor(color.r, color.g, color.b, color.a);
+					gPrimitiveBatch.drawPoint(points[i].x, points[i].y);
+				}
+			}
+
+			if (run == 0)
+			{
+				SDL_RenderPresent(gRenderer);
+			}
+			else
+			{
+				gPrimitiveBatch.present();
+				calls += gPrimitiveBatch.getCallsLastFrame();
+			}
+		}
+		double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+		printf("%-9s %d points + %d rects: %d calls/frame, %.3f ms/frame, %.1f M primitives/s\n", run == 1 ? "batched" : "unbatched",
+			STRESS_POINTS, STRESS_RECTS, calls / STRESS_FRAMES, seconds * 1000.0 / STRESS_FRAMES, (double)(STRESS_POINTS + STRESS_RECTS) * STRESS_FRAMES / seconds / 1000000.0);
+	}
+}
+
 int main( int argc, char* args[])
 { 
+	// --stress draws with the software renderer and exits
+	bool stress = argc > 1 && strcmp(args[1], "--stress") == 0;
+
  	// start up SDL and create the window
-	if (!init())
+	if (!init(stress))
 	{
 		printf("Failed to initialize!\n");
 	}
@@ -132,6 +508,12 @@ int main( int argc, char* args[])
 		{
 			printf("Failed to load media!\n");
 		}
+		else if (stress)
+		{
+			runStressTest();
+			close();
+			return 0;
+		}
 		
 		// main loop
 		bool quit = false;
@@ -159,27 +541,27 @@ int main( int argc, char* args[])
 
 			// Render red filled quad
 			SDL_Rect fillRect = {SCREEN_WIDTH / 4, SCREEN_HEIGHT / 4, SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2};
-			SDL_SetRenderDrawColor(gRenderer, 0xFF, 0x00, 0x00, 0xFF);
-			SDL_RenderFillRect(gRenderer, &fillRect);
+			gPrimitiveBatch.setColor(0xFF, 0x00, 0x00);
+			gPrimitiveBatch.fillRect(fillRect);
 
 			// Render green outlined quad
 			SDL_Rect outlineRect = {SCREEN_WIDTH / 6, SCREEN_HEIGHT / 6, SCREEN_WIDTH * 2 / 3, SCREEN_HEIGHT * 2 / 3};
-			SDL_SetRenderDrawColor(gRenderer, 0x00, 0xFF, 0x00, 0xFF);
-			SDL_RenderDrawRect(gRenderer, &outlineRect);
+			gPrimitiveBatch.setColor(0x00, 0xFF, 0x00);
+			gPrimitiveBatch.drawRect(outlineRect);
 
 			// Draw blue horizontal line
-			SDL_SetRenderDrawColor(gRenderer, 0x00, 0x00, 0xFF, 0xFF);
-			SDL_RenderDrawLine(gRenderer, 0, SCREEN_HEIGHT / 2, SCREEN_WIDTH, SCREEN_HEIGHT / 2);
+			gPrimitiveBatch.setColor(0x00, 0x00, 0xFF);
+			gPrimitiveBatch.drawLine(0, SCREEN_HEIGHT / 2, SCREEN_WIDTH, SCREEN_HEIGHT / 2);
 			
-			// Draw vertical line of yellow dots
-			SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0x00, 0xFF);
+			// Draw vertical line of yellow dots, all of them go out in one call
+			gPrimitiveBatch.setColor(0xFF, 0xFF, 0x00);
 			for (int i = 0; i < SCREEN_HEIGHT; i += 4)
 			{
-				SDL_RenderDrawPoint(gRenderer, SCREEN_WIDTH / 2, i);
+				gPrimitiveBatch.drawPoint(SCREEN_WIDTH / 2, i);
 			}
 
-			// Update the screen
-			SDL_RenderPresent(gRenderer);
+			// Submit the batches and update the screen
+			gPrimitiveBatch.present();
 		}
 	}
 
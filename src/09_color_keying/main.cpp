@@ -3,11 +3,40 @@
 #include <SDL2/SDL_image.h>
 #include <stdio.h>
 #include <string>
+#include <string.h>
+
+// the color key kernel's SIMD paths are SSE2/AVX2 on x86 and NEON on AArch64, everything else keys with the scalar code
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEY_X86 1
+#else
+#define KEY_X86 0
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define KEY_NEON 1
+#else
+#define KEY_NEON 0
+#endif
 
 // ========================== Constants and Enums ==========================
 const int SCREEN_WIDTH = 1280;
 const int SCREEN_HEIGHT = 720;
 
+// Color key benchmark constants, a 4K image
+const int KEY_BENCH_WIDTH = 3840;
+const int KEY_BENCH_HEIGHT = 2160;
+const int KEY_BENCH_ROUNDS = 20;
+
+// the color key kernel code paths, best one picked at runtime
+enum LKeySimd
+{
+	KEY_SIMD_SCALAR,
+	KEY_SIMD_SSE2,
+	KEY_SIMD_AVX2,
+	KEY_SIMD_NEON
+};
+
 // ========================== Texture Wrapper Class ==========================
 class LTexture 
 {
@@ -21,6 +50,16 @@ class LTexture
         // Loads image at specified path
         bool loadFromFile(std::string path);
 
+        // Loads an image as ARGB8888 with the cyan color key pixels already transparent, the caller frees it
+        static SDL_Surface* loadKeyedSurface(std::string path);
+
+        // Makes every color key pixel of an ARGB8888 surface transparent black in place, and has it blend
+        static void keySurface(SDL_Surface* surface, LKeySimd simd);
+
+        // the color key code paths
+        static LKeySimd getBestKeySimd();
+        static const char* getKeySimdName(LKeySimd simd);
+
         // deallocates the texture
         void free();
 
@@ -52,6 +91,144 @@ LTexture gFooTexture;
 LTexture gBackgroundTexture;
 
 // ========================== Texture Wrapper Class Function Definitions ==========================
+// The kernels clear every pixel of an ARGB8888 row whose color matches the key, alpha ignored the way SDL
+// compares it. Cleared pixels are transparent black, which reads the same straight or premultiplied.
+void keyRowScalar(Uint32* pixels, int width, Uint32 key)
+{
+	for (int x = 0; x < width; ++x)
+	{
+		if ((pixels[x] & 0x00FFFFFF) == key)
+		{
+			pixels[x] = 0;
+		}
+	}
+}
+
+#if KEY_X86
+__attribute__((target("sse2")))
+void keyRowSse2(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step: compare the color bits, then and the matches away
+	const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+	const __m128i keyColor = _mm_set1_epi32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		__m128i color = _mm_loadu_si128((const __m128i*)(pixels + x));
+		__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(color, colorMask), keyColor);
+		_mm_storeu_si128((__m128i*)(pixels + x), _mm_andnot_si128(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+
+__attribute__((target("avx2")))
+void keyRowAvx2(Uint32* pixels, int width, Uint32 key)
+{
+	// eight pixels a step
+	const __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+	const __m256i keyColor = _mm256_set1_epi32(key);
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		__m256i color = _mm256_loadu_si256((const __m256i*)(pixels + x));
+		__m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(color, colorMask), keyColor);
+		_mm256_storeu_si256((__m256i*)(pixels + x), _mm256_andnot_si256(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+#if KEY_NEON
+void keyRowNeon(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step, NEON is always there on AArch64
+	const uint32x4_t colorMask = vdupq_n_u32(0x00FFFFFF);
+	const uint32x4_t keyColor = vdupq_n_u32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		uint32x4_t color = vld1q_u32(pixels + x);
+		uint32x4_t keyed = vceqq_u32(vandq_u32(color, colorMask), keyColor);
+		vst1q_u32(pixels + x, vbicq_u32(color, keyed));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+SDL_Surface* LTexture::loadKeyedSurface(std::string path)
+{
+	SDL_Surface* loadedSurface = IMG_Load(path.c_str());
+	if (loadedSurface == NULL)
+	{
+		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		return NULL;
+	}
+
+	// one conversion to the format the kernels work on, which SDL would have done making the texture anyway
+	SDL_Surface* keyedSurface = SDL_ConvertSurfaceFormat(loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(loadedSurface);
+	if (keyedSurface == NULL)
+	{
+		printf("Unable to convert image %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+		return NULL;
+	}
+
+	// and one pass to key it
+	keySurface(keyedSurface, getBestKeySimd());
+	return keyedSurface;
+}
+
+void LTexture::keySurface(SDL_Surface* surface, LKeySimd simd)
+{
+	Uint32 key = SDL_MapRGB(surface->format, 0, 0xFF, 0xFF) & 0x00FFFFFF;
+	for (int y = 0; y < surface->h; ++y)
+	{
+		Uint32* row = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch);
+		switch (simd)
+		{
+			#if KEY_X86
+			case KEY_SIMD_AVX2: keyRowAvx2(row, surface->w, key); break;
+			case KEY_SIMD_SSE2: keyRowSse2(row, surface->w, key); break;
+			#endif
+			#if KEY_NEON
+			case KEY_SIMD_NEON: keyRowNeon(row, surface->w, key); break;
+			#endif
+			default: keyRowScalar(row, surface->w, key); break;
+		}
+	}
+
+	// converted RGB images start out unblended, and the keyed pixels only vanish when the texture blends
+	SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_BLEND);
+}
+
+LKeySimd LTexture::getBestKeySimd()
+{
+	#if KEY_X86
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return KEY_SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return KEY_SIMD_SSE2;
+	}
+	#elif KEY_NEON
+	return KEY_SIMD_NEON;
+	#endif
+	return KEY_SIMD_SCALAR;
+}
+
+const char* LTexture::getKeySimdName(LKeySimd simd)
+{
+	switch (simd)
+	{
+		case KEY_SIMD_AVX2: return "avx2";
+		case KEY_SIMD_SSE2: return "sse2";
+		case KEY_SIMD_NEON: return "neon";
+		default: return "scalar";
+	}
+}
+
 LTexture::LTexture()
 {
 	// initialize
@@ -74,17 +251,14 @@ bool LTexture::loadFromFile(std::string path)
 	// create the texture
 	SDL_Texture* newTexture = NULL;
 
-	// first create a surface 
-	SDL_Surface* newSurface= IMG_Load(path.c_str());
+	// first create a surface, with the color key already turned into alpha
+	SDL_Surface* newSurface = loadKeyedSurface(path);
 	if (newSurface == NULL)
 	{
-		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		printf("Could not load image %s!\n", path.c_str()); 
 	}
 	else
 	{
-		// color key the image we load
-		SDL_SetColorKey(newSurface, SDL_TRUE, SDL_MapRGB(newSurface->format, 0, 0xFF, 0xFF));
-
 		// create texture from surface pixels
 		newTexture = SDL_CreateTextureFromSurface(gRenderer, newSurface);
 		if (newTexture == NULL) 
@@ -148,6 +322,9 @@ void close();
 // Loads individual image
 SDL_Texture* loadTexture(std::string path);
 
+// Keys a generated 4K image through SDL's color key conversion and through each kernel, and compares the time
+void runKeyBenchmark();
+
 
 // ========================== Function Definitions ==========================
 bool init()
@@ -248,8 +425,122 @@ SDL_Texture* loadTexture(std::string path)
 	return newTexture;
 }
 
+void runKeyBenchmark()
+{
+	// 24 bit like the tutorial's PNGs: a gradient with cyan squares to key out
+	SDL_Surface* image = SDL_CreateRGBSurfaceWithFormat(0, KEY_BENCH_WIDTH, KEY_BENCH_HEIGHT, 24, SDL_PIXELFORMAT_RGB24);
+	if (image == NULL)
+	{
+		printf("Unable to create the benchmark image! SDL Error: %s\n", SDL_GetError());
+		return;
+	}
+	for (int y = 0; y < image->h; ++y)
+	{
+		Uint8* row = (Uint8*)image->pixels + y * image->pitch;
+		for (int x = 0; x < image->w; ++x)
+		{
+			bool keyed = (x / 64 + y / 64) % 3 == 0;
+			row[x * 3] = keyed ? 0 : x * 255 / image->w;
+			row[x * 3 + 1] = keyed ? 0xFF : y * 255 / image->h;
+			row[x * 3 + 2] = keyed ? 0xFF : (x ^ y) & 0xFF;
+		}
+	}
+	double pixels = (double)image->w * image->h;
+
+	// SDL's way: set the key and let the conversion to an alpha format turn it into alpha, as making the texture does
+	SDL_Surface* reference = NULL;
+	double sdlMs = 0.0;
+	for (int round = 0; round < KEY_BENCH_ROUNDS; ++round)
+	{
+		SDL_FreeSurface(reference);
+		SDL_SetColorKey(image, SDL_TRUE, SDL_MapRGB(image->format, 0, 0xFF, 0xFF));
+		Uint64 start = SDL_GetPerformanceCounter();
+		reference = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ARGB8888, 0);
+		sdlMs += (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+	}
+	SDL_SetColorKey(image, SDL_FALSE, 0);
+	if (reference == NULL)
+	{
+		printf("Unable to convert the benchmark image! SDL Error: %s\n", SDL_GetError());
+		SDL_FreeSurface(image);
+		return;
+	}
+	printf("SDL color key conversion: %.2f ms, %.0f Mpixels/s\n", sdlMs / KEY_BENCH_ROUNDS, pixels * KEY_BENCH_ROUNDS / sdlMs / 1000.0);
+
+	// a plain conversion and then the kernel, timed together and the kernel on its own
+	for (int simd = KEY_SIMD_SCALAR; simd <= LTexture::getBestKeySimd(); ++simd)
+	{
+		// the x86 paths aren't built anywhere else
+		#if !KEY_X86
+		if (simd == KEY_SIMD_SSE2 || simd == KEY_SIMD_AVX2)
+		{
+			continue;
+		}
+		#endif
+
+		SDL_Surface* keyed = NULL;
+		double totalMs = 0.0;
+		double kernelMs = 0.0;
+		for (int round = 0; round < KEY_BENCH_ROUNDS; ++round)
+		{
+			SDL_FreeSurface(keyed);
+			Uint64 start = SDL_GetPerformanceCounter();
+			keyed = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ARGB8888, 0);
+			Uint64 converted = SDL_GetPerformanceCounter();
+			LTexture::keySurface(keyed, (LKeySimd)simd);
+			Uint64 end = SDL_GetPerformanceCounter();
+			totalMs += (end - start) * 1000.0 / SDL_GetPerformanceFrequency();
+			kernelMs += (end - converted) * 1000.0 / SDL_GetPerformanceFrequency();
+		}
+
+		// same alpha everywhere, same color wherever it can still be seen
+		int mismatches = 0;
+		for (int y = 0; y < keyed->h; ++y)
+		{
+			Uint32* row = (Uint32*)((Uint8*)keyed->pixels + y * keyed->pitch);
+			Uint32* expected = (Uint32*)((Uint8*)reference->pixels + y * reference->pitch);
+			for (int x = 0; x < keyed->w; ++x)
+			{
+				bool visible = (expected[x] & 0xFF000000) != 0;
+				if (visible ? row[x] != expected[x] : row[x] != 0)
+				{
+					++mismatches;
+				}
+			}
+		}
+		if (mismatches > 0)
+		{
+			printf("%s: %d pixels don't match SDL's!\n", LTexture::getKeySimdName((LKeySimd)simd), mismatches);
+		}
+
+		// and it has to blend like SDL's, or the keyed pixels draw as black boxes
+		SDL_BlendMode referenceBlend = SDL_BLENDMODE_NONE;
+		SDL_BlendMode keyedBlend = SDL_BLENDMODE_NONE;
+		SDL_GetSurfaceBlendMode(reference, &referenceBlend);
+		SDL_GetSurfaceBlendMode(keyed, &keyedBlend);
+		if (keyedBlend != SDL_BLENDMODE_BLEND || keyedBlend != referenceBlend)
+		{
+			printf("%s: blend mode %d doesn't match SDL's %d!\n", LTexture::getKeySimdName((LKeySimd)simd), keyedBlend, referenceBlend);
+		}
+
+		printf("convert + %-6s kernel: %.2f ms (%.2fx SDL), kernel alone %.2f ms, %.0f Mpixels/s\n", LTexture::getKeySimdName((LKeySimd)simd),
+			totalMs / KEY_BENCH_ROUNDS, sdlMs / totalMs, kernelMs / KEY_BENCH_ROUNDS, pixels * KEY_BENCH_ROUNDS / kernelMs / 1000.0);
+		SDL_FreeSurface(keyed);
+	}
+
+	SDL_FreeSurface(reference);
+	SDL_FreeSurface(image);
+}
+
 int main( int argc, char* args[])
 { 
+	// --key-bench times the color key paths on surfaces only and exits
+	if (argc > 1 && strcmp(args[1], "--key-bench") == 0)
+	{
+		runKeyBenchmark();
+		return 0;
+	}
+
  	// start up SDL and create the window
 	if (!init())
 	{
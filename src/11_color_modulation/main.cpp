@@ -4,10 +4,33 @@
 #include <stdio.h>
 #include <string>
 
+// the color key kernel's SIMD paths are SSE2/AVX2 on x86 and NEON on AArch64, everything else keys with the scalar code
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEY_X86 1
+#else
+#define KEY_X86 0
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define KEY_NEON 1
+#else
+#define KEY_NEON 0
+#endif
+
 // ========================== Constants and Enums ==========================
 const int SCREEN_WIDTH = 1280;
 const int SCREEN_HEIGHT = 720;
 
+// the color key kernel code paths, best one picked at runtime
+enum LKeySimd
+{
+	KEY_SIMD_SCALAR,
+	KEY_SIMD_SSE2,
+	KEY_SIMD_AVX2,
+	KEY_SIMD_NEON
+};
+
 // ========================== Texture Wrapper Class ==========================
 class LTexture 
 {
@@ -21,6 +44,16 @@ class LTexture
         // Loads image at specified path
         bool loadFromFile(std::string path);
 
+        // Loads an image as ARGB8888 with the cyan color key pixels already transparent, the caller frees it
+        static SDL_Surface* loadKeyedSurface(std::string path);
+
+        // Makes every color key pixel of an ARGB8888 surface transparent black in place, and has it blend
+        static void keySurface(SDL_Surface* surface, LKeySimd simd);
+
+        // the color key code paths
+        static LKeySimd getBestKeySimd();
+        static const char* getKeySimdName(LKeySimd simd);
+
 		// Set color modulation
 		void setColor(Uint8 red, Uint8 green, Uint8 blue);
 
@@ -54,6 +87,144 @@ SDL_Renderer* gRenderer = NULL;
 LTexture gModulatedTexture;
 
 // ========================== Texture Wrapper Class Function Definitions ==========================
+// The kernels clear every pixel of an ARGB8888 row whose color matches the key, alpha ignored the way SDL
+// compares it. Cleared pixels are transparent black, which reads the same straight or premultiplied.
+void keyRowScalar(Uint32* pixels, int width, Uint32 key)
+{
+	for (int x = 0; x < width; ++x)
+	{
+		if ((pixels[x] & 0x00FFFFFF) == key)
+		{
+			pixels[x] = 0;
+		}
+	}
+}
+
+#if KEY_X86
+__attribute__((target("sse2")))
+void keyRowSse2(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step: compare the color bits, then and the matches away
+	const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+	const __m128i keyColor = _mm_set1_epi32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		__m128i color = _mm_loadu_si128((const __m128i*)(pixels + x));
+		__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(color, colorMask), keyColor);
+		_mm_storeu_si128((__m128i*)(pixels + x), _mm_andnot_si128(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+
+__attribute__((target("avx2")))
+void keyRowAvx2(Uint32* pixels, int width, Uint32 key)
+{
+	// eight pixels a step
+	const __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+	const __m256i keyColor = _mm256_set1_epi32(key);
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		__m256i color = _mm256_loadu_si256((const __m256i*)(pixels + x));
+		__m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(color, colorMask), keyColor);
+		_mm256_storeu_si256((__m256i*)(pixels + x), _mm256_andnot_si256(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+#if KEY_NEON
+void keyRowNeon(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step, NEON is always there on AArch64
+	const uint32x4_t colorMask = vdupq_n_u32(0x00FFFFFF);
+	const uint32x4_t keyColor = vdupq_n_u32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		uint32x4_t color = vld1q_u32(pixels + x);
+		uint32x4_t keyed = vceqq_u32(vandq_u32(color, colorMask), keyColor);
+		vst1q_u32(pixels + x, vbicq_u32(color, keyed));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+SDL_Surface* LTexture::loadKeyedSurface(std::string path)
+{
+	SDL_Surface* loadedSurface = IMG_Load(path.c_str());
+	if (loadedSurface == NULL)
+	{
+		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		return NULL;
+	}
+
+	// one conversion to the format the kernels work on, which SDL would have done making the texture anyway
+	SDL_Surface* keyedSurface = SDL_ConvertSurfaceFormat(loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(loadedSurface);
+	if (keyedSurface == NULL)
+	{
+		printf("Unable to convert image %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+		return NULL;
+	}
+
+	// and one pass to key it
+	keySurface(keyedSurface, getBestKeySimd());
+	return keyedSurface;
+}
+
+void LTexture::keySurface(SDL_Surface* surface, LKeySimd simd)
+{
+	Uint32 key = SDL_MapRGB(surface->format, 0, 0xFF, 0xFF) & 0x00FFFFFF;
+	for (int y = 0; y < surface->h; ++y)
+	{
+		Uint32* row = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch);
+		switch (simd)
+		{
+			#if KEY_X86
+			case KEY_SIMD_AVX2: keyRowAvx2(row, surface->w, key); break;
+			case KEY_SIMD_SSE2: keyRowSse2(row, surface->w, key); break;
+			#endif
+			#if KEY_NEON
+			case KEY_SIMD_NEON: keyRowNeon(row, surface->w, key); break;
+			#endif
+			default: keyRowScalar(row, surface->w, key); break;
+		}
+	}
+
+	// converted RGB images start out unblended, and the keyed pixels only vanish when the texture blends
+	SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_BLEND);
+}
+
+LKeySimd LTexture::getBestKeySimd()
+{
+	#if KEY_X86
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return KEY_SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return KEY_SIMD_SSE2;
+	}
+	#elif KEY_NEON
+	return KEY_SIMD_NEON;
+	#endif
+	return KEY_SIMD_SCALAR;
+}
+
+const char* LTexture::getKeySimdName(LKeySimd simd)
+{
+	switch (simd)
+	{
+		case KEY_SIMD_AVX2: return "avx2";
+		case KEY_SIMD_SSE2: return "sse2";
+		case KEY_SIMD_NEON: return "neon";
+		default: return "scalar";
+	}
+}
+
 LTexture::LTexture()
 {
 	// initialize
@@ -76,17 +247,14 @@ bool LTexture::loadFromFile(std::string path)
 	// create the texture
 	SDL_Texture* newTexture = NULL;
 
-	// first create a surface 
-	SDL_Surface* newSurface= IMG_Load(path.c_str());
+	// first create a surface, with the color key already turned into alpha
+	SDL_Surface* newSurface = loadKeyedSurface(path);
 	if (newSurface == NULL)
 	{
-		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		printf("Could not load image %s!\n", path.c_str()); 
 	}
 	else
 	{
-		// color key the image we load
-		SDL_SetColorKey(newSurface, SDL_TRUE, SDL_MapRGB(newSurface->format, 0, 0xFF, 0xFF));
-
 		// create texture from surface pixels
 		newTexture = SDL_CreateTextureFromSurface(gRenderer, newSurface);
 		if (newTexture == NULL) 
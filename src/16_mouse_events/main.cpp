@@ -4,7 +4,27 @@
 #include <SDL2/SDL_ttf.h>
 #include <stdio.h>
 #include <string>
+#include <string.h>
+#include <stdlib.h>
 #include <cmath>
+#include <vector>
+#include <list>
+#include <map>
+#include <algorithm>
+
+// the color key kernel's SIMD paths are SSE2/AVX2 on x86 and NEON on AArch64, everything else keys with the scalar code
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEY_X86 1
+#else
+#define KEY_X86 0
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define KEY_NEON 1
+#else
+#define KEY_NEON 0
+#endif
 
 // ========================== Constants and Enums ==========================
 // screen constants
@@ -16,6 +36,25 @@ const int BUTTON_WIDTH = 300;
 const int BUTTON_HEIGHT = 200;
 const int TOTAL_BUTTONS = 4;
 
+// Sprite batch benchmark constants
+const int BENCH_SPRITES = 50000;
+const int BENCH_FRAMES = 10;
+const int BENCH_CLIP_SIZE = 32;
+
+// Texture cache constants
+const int TEXTURE_CACHE_BUDGET = 64 * 1024 * 1024;
+
+// Input log constants
+const char INPUT_LOG_MAGIC[4] = {'L', 'R', 'E', 'C'};
+const Uint32 INPUT_LOG_VERSION = 1;
+
+// Hit-test grid constants
+const int HIT_GRID_CELL_SIZE = 128;
+const int HIT_BENCH_COLUMNS = 100;
+const int HIT_BENCH_ROWS = 100;
+const int HIT_BENCH_EVENTS = 1000000;
+const int HIT_BENCH_LINEAR_EVENTS = 10000;
+
 enum LButtonSprite
 {
 	BUTTON_SPRITE_MOUSE_OUT,
@@ -25,7 +64,19 @@ enum LButtonSprite
 	BUTTON_SPRITE_TOTAL
 };
 
+// the color key kernel code paths, best one picked at runtime
+enum LKeySimd
+{
+	KEY_SIMD_SCALAR,
+	KEY_SIMD_SSE2,
+	KEY_SIMD_AVX2,
+	KEY_SIMD_NEON
+};
+
 // ========================== Button Wrapper Class ==========================
+// buttons hold a pointer to their sprite sheet
+class LTexture;
+
 class LButton
 {
 	public:
@@ -35,9 +86,25 @@ class LButton
 		// sets top left position
 		void setPosition(int x, int y);
 
+		// takes a shared reference to the sprite sheet, dropping the old one
+		bool setSpriteSheet(std::string path);
+
+		// drops the sprite sheet reference
+		void free();
+
 		// handles mouse event
 		void handleEvent(SDL_Event* e);
 
+		// the mouse moved off the button without an event reaching it
+		void handleMouseLeave();
+
+		// whether a point is on the button, edges included
+		bool contains(int x, int y);
+
+		// gets top left position and the current sprite
+		SDL_Point getPosition();
+		LButtonSprite getSprite();
+
 		// shows button sprite
 		void render();
 	
@@ -45,6 +112,9 @@ class LButton
 		// top left position
 		SDL_Point mPosition;
 
+		// sprite sheet, owned by the texture cache
+		LTexture* mSpriteSheet;
+
 		// currently used global sprite
 		LButtonSprite mCurrentSprite; 	
 };
@@ -62,6 +132,16 @@ class LTexture
         // Loads image at specified path
         bool loadFromFile(std::string path);
 
+        // Loads an image as ARGB8888 with the cyan color key pixels already transparent, the caller frees it
+        static SDL_Surface* loadKeyedSurface(std::string path);
+
+        // Makes every color key pixel of an ARGB8888 surface transparent black in place, and has it blend
+        static void keySurface(SDL_Surface* surface, LKeySimd simd);
+
+        // the color key code paths
+        static LKeySimd getBestKeySimd();
+        static const char* getKeySimdName(LKeySimd simd);
+
 		#if defined(SDL_TTF_MAJOR_VERSION)
 		// Loads image from font string
 		bool loadFromRenderedText(std::string textureText, SDL_Color textColor);
@@ -95,6 +175,229 @@ class LTexture
         int mHeight;
 };
 
+// ========================== Sprite Batch Class ==========================
+class LSpriteBatch
+{
+	public:
+		// initializes internal variables
+		LSpriteBatch();
+
+		// turns batching on or off (off submits every quad on its own)
+		void setEnabled(bool enabled);
+		bool isEnabled();
+
+		// queues a quad, flushing first if the texture, blend or color state changed
+		void draw(SDL_Texture* texture, int textureWidth, int textureHeight, SDL_Rect* clip, SDL_Rect* dest, double angle, SDL_Point* center, SDL_RendererFlip flip);
+
+		// submits the queued quads as a single geometry call
+		void flush();
+
+		// flushes the batch and updates the screen
+		void present();
+
+		// renderer submissions and quads of the last presented frame
+		int getCallsLastFrame();
+		int getQuadsLastFrame();
+
+	private:
+		// state shared by every quad in the current batch
+		SDL_Texture* mTexture;
+		SDL_BlendMode mBlendMode;
+		SDL_Color mColor;
+
+		// queued quads, four vertices each
+		std::vector<SDL_Vertex> mVertices;
+
+		// shared quad index pattern, grown as needed
+		std::vector<int> mIndices;
+
+		// whether quads are queued or submitted right away
+		bool mEnabled;
+
+		// counters for the frame in progress and the last presented one
+		int mCalls;
+		int mQuads;
+		int mCallsLastFrame;
+		int mQuadsLastFrame;
+};
+
+// ========================== Button Hit-Test Grid Class ==========================
+class LButtonGrid
+{
+	public:
+		// initializes internal variables
+		LButtonGrid();
+
+		// buckets the buttons into square cells, rebuild after moving any of them
+		void build(LButton* buttons, int count, int cellSize = HIT_GRID_CELL_SIZE);
+
+		// sends a mouse event to the buttons under it and tells the ones it just left
+		void handleEvent(SDL_Event* e);
+
+		// buttons handed an event or a leave since the last build
+		long long getDispatchCount();
+
+	private:
+		// grid placement
+		SDL_Point mOrigin;
+		int mCellSize;
+		int mColumns;
+		int mRows;
+
+		// the buttons of cell i are mCellButtons[mCellStarts[i]] up to mCellButtons[mCellStarts[i + 1]]
+		std::vector<int> mCellStarts;
+		std::vector<LButton*> mCellButtons;
+
+		// buttons under the mouse after the last event
+		std::vector<LButton*> mHovered;
+		std::vector<LButton*> mNextHovered;
+
+		long long mDispatches;
+};
+
+// ========================== Input Recorder Class ==========================
+// log layout: the header, then one record per event (the same format chapter 22 writes, without the tick records)
+struct LInputHeader
+{
+	char magic[4];
+	Uint32 version;
+	Uint32 tickRate;
+};
+
+struct LInputRecord
+{
+	// the frame the event was polled on
+	Uint32 frame;
+
+	// the SDL event type
+	Uint32 type;
+
+	// the fields the event type needs, see pack()
+	Sint32 data[5];
+};
+
+class LInputRecorder
+{
+	public:
+		// initializes internal variables
+		LInputRecorder();
+
+		// closes the log
+		~LInputRecorder();
+
+		// starts logging every polled event to a file
+		bool startRecording(std::string path);
+
+		// loads a log to feed back in
+		bool startReplay(std::string path);
+
+		// closes the log
+		void stop();
+
+		// call before polling, a replay pushes this frame's events into the queue
+		void beginFrame();
+
+		// logs a polled event
+		void record(const SDL_Event& e);
+
+		// call after presenting
+		void endFrame();
+
+		bool isReplaying();
+
+		// every logged record has been played back
+		bool isFinished();
+
+		// frame times of the replay so far, to compare between builds
+		void printReplayStats();
+
+	private:
+		// only input worth replaying goes in the log, the rest is window noise
+		static bool pack(const SDL_Event& e, LInputRecord& record);
+		static void unpack(const LInputRecord& record, SDL_Event& e);
+
+		// the log being written, or everything read back from one
+		FILE* mFile;
+		std::vector<LInputRecord> mRecords;
+		int mNext;
+
+		bool mRecording;
+		bool mReplaying;
+
+		// frames since recording or replay started
+		Uint32 mFrame;
+
+		// how long each replayed frame took
+		std::vector<Uint64> mFrameCounts;
+		Uint64 mFrameStart;
+};
+
+// ========================== Texture Cache Class ==========================
+class LTextureCache
+{
+	public:
+		// initializes internal variables
+		LTextureCache();
+
+		// Deallocates memory
+		~LTextureCache();
+
+		// returns the shared texture for a file, loading it on the first request; NULL if it can't load
+		LTexture* acquire(std::string path);
+
+		// gives back a reference from acquire, the texture stays resident until the budget needs it
+		void release(LTexture* texture);
+
+		// bytes the idle textures may take up before the least recently used ones are evicted
+		void setBudget(int bytes);
+		int getBudget();
+
+		// frees every texture, referenced or not
+		void free();
+
+		// counters
+		int getHits();
+		int getMisses();
+		int getEvictions();
+		int getResidentCount();
+		int getResidentBytes();
+
+		// prints the counters
+		void printStats();
+
+	private:
+		// one loaded file
+		struct Entry
+		{
+			LTexture texture;
+			std::string key;
+			int refs;
+			int bytes;
+
+			// position in mIdle while nobody holds a reference
+			std::list<Entry*>::iterator idlePosition;
+		};
+
+		// resolves ./ and ../ and symlinks so one file only ever loads once
+		static std::string canonicalize(std::string path);
+
+		// evicts idle textures, least recently released first, until under budget
+		void trim();
+
+		// lookups by key and by the pointer handed out
+		std::map<std::string, Entry*> mEntries;
+		std::map<LTexture*, Entry*> mOwners;
+
+		// unreferenced textures, most recently released at the front
+		std::list<Entry*> mIdle;
+
+		int mBudget;
+		int mResidentBytes;
+		int mHits;
+		int mMisses;
+		int mEvictions;
+};
+
 // ========================== Global Variables ==========================
 // The window we are going to render to
 SDL_Window* gWindow = NULL;
@@ -108,17 +411,27 @@ TTF_Font* gFont = NULL;
 // rendered texture
 LTexture gTextTexture;
 
+// Shares textures between everything that loads the same file
+LTextureCache gTextureCache;
+
+// Routes mouse events to the buttons under the cursor
+LButtonGrid gButtonGrid;
+
 // Button texture and everything else 
-LTexture gButtonSpriteSheetTexture;
+LTexture* gButtonSpriteSheetTexture = NULL;
 SDL_Rect gButtonClips[TOTAL_BUTTONS];
 LButton gButtons[TOTAL_BUTTONS];
 
+// Batches every LTexture::render until the frame is presented
+LSpriteBatch gSpriteBatch;
+
 // ========================== Button Wrapper Class Function Definitions ==========================
 LButton::LButton()
 {
 	mPosition.x = 0;
 	mPosition.y = 0;
 	mCurrentSprite = BUTTON_SPRITE_MOUSE_OUT;
+	mSpriteSheet = NULL;
 }
 
 void LButton::setPosition(int x, int y)
@@ -127,39 +440,46 @@ void LButton::setPosition(int x, int y)
 	mPosition.y = y;
 }
 
+bool LButton::setSpriteSheet(std::string path)
+{
+	// take the new one first in case it is the same file
+	LTexture* spriteSheet = gTextureCache.acquire(path);
+	free();
+	mSpriteSheet = spriteSheet;
+
+	return mSpriteSheet != NULL;
+}
+
+void LButton::free()
+{
+	if (mSpriteSheet != NULL)
+	{
+		gTextureCache.release(mSpriteSheet);
+		mSpriteSheet = NULL;
+	}
+}
+
 void LButton::handleEvent(SDL_Event* e)
 {
 	// if mouse event happened
 	if (e->type == SDL_MOUSEMOTION || e->type == SDL_MOUSEBUTTONDOWN || e->type == SDL_MOUSEBUTTONUP)
 	{
-		// get the mouse position
+		// get the mouse position the event happened at
 		int x, y;
-		SDL_GetMouseState(&x, &y);
-
-		// check if mouse is in button
-		bool inside = true;
-
-		// mouse is left of the button
-		if (x < mPosition.x)
-		{
-			inside = false;
-		}
-		// mouse is right of button
-		else if (x > mPosition.x + BUTTON_WIDTH)
+		if (e->type == SDL_MOUSEMOTION)
 		{
-			inside = false;
+			x = e->motion.x;
+			y = e->motion.y;
 		}
-		// mouse is above the button
-		else if (y < mPosition.y)
-		{
-			inside = false;
-		} 
-		// mouse is below button
-		else if (y > mPosition.y + BUTTON_HEIGHT)
+		else
 		{
-			inside = false;
+			x = e->button.x;
+			y = e->button.y;
 		}
 
+		// check if mouse is in button
+		bool inside = contains(x, y);
+
 		// mouse is outside the button
 		if (!inside)
 		{
@@ -187,13 +507,174 @@ void LButton::handleEvent(SDL_Event* e)
 	}
 }
 
+void LButton::handleMouseLeave()
+{
+	mCurrentSprite = BUTTON_SPRITE_MOUSE_OUT;
+}
+
+bool LButton::contains(int x, int y)
+{
+	return x >= mPosition.x && x <= mPosition.x + BUTTON_WIDTH && y >= mPosition.y && y <= mPosition.y + BUTTON_HEIGHT;
+}
+
+SDL_Point LButton::getPosition()
+{
+	return mPosition;
+}
+
+LButtonSprite LButton::getSprite()
+{
+	return mCurrentSprite;
+}
+
 void LButton::render()
 {
 	// show current button sprite
-	gButtonSpriteSheetTexture.render(mPosition.x, mPosition.y, &gButtonClips[mCurrentSprite]);
+	if (mSpriteSheet != NULL)
+	{
+		mSpriteSheet->render(mPosition.x, mPosition.y, &gButtonClips[mCurrentSprite]);
+	}
 }
 
 // ========================== Texture Wrapper Class Function Definitions ==========================
+// The kernels clear every pixel of an ARGB8888 row whose color matches the key, alpha ignored the way SDL
+// compares it. Cleared pixels are transparent black, which reads the same straight or premultiplied.
+void keyRowScalar(Uint32* pixels, int width, Uint32 key)
+{
+	for (int x = 0; x < width; ++x)
+	{
+		if ((pixels[x] & 0x00FFFFFF) == key)
+		{
+			pixels[x] = 0;
+		}
+	}
+}
+
+#if KEY_X86
+__attribute__((target("sse2")))
+void keyRowSse2(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step: compare the color bits, then and the matches away
+	const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+	const __m128i keyColor = _mm_set1_epi32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		__m128i color = _mm_loadu_si128((const __m128i*)(pixels + x));
+		__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(color, colorMask), keyColor);
+		_mm_storeu_si128((__m128i*)(pixels + x), _mm_andnot_si128(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+
+__attribute__((target("avx2")))
+void keyRowAvx2(Uint32* pixels, int width, Uint32 key)
+{
+	// eight pixels a step
+	const __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+	const __m256i keyColor = _mm256_set1_epi32(key);
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		__m256i color = _mm256_loadu_si256((const __m256i*)(pixels + x));
+		__m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(color, colorMask), keyColor);
+		_mm256_storeu_si256((__m256i*)(pixels + x), _mm256_andnot_si256(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+#if KEY_NEON
+void keyRowNeon(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step, NEON is always there on AArch64
+	const uint32x4_t colorMask = vdupq_n_u32(0x00FFFFFF);
+	const uint32x4_t keyColor = vdupq_n_u32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		uint32x4_t color = vld1q_u32(pixels + x);
+		uint32x4_t keyed = vceqq_u32(vandq_u32(color, colorMask), keyColor);
+		vst1q_u32(pixels + x, vbicq_u32(color, keyed));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+SDL_Surface* LTexture::loadKeyedSurface(std::string path)
+{
+	SDL_Surface* loadedSurface = IMG_Load(path.c_str());
+	if (loadedSurface == NULL)
+	{
+		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		return NULL;
+	}
+
+	// one conversion to the format the kernels work on, which SDL would have done making the texture anyway
+	SDL_Surface* keyedSurface = SDL_ConvertSurfaceFormat(loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(loadedSurface);
+	if (keyedSurface == NULL)
+	{
+		printf("Unable to convert image %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+		return NULL;
+	}
+
+	// and one pass to key it
+	keySurface(keyedSurface, getBestKeySimd());
+	return keyedSurface;
+}
+
+void LTexture::keySurface(SDL_Surface* surface, LKeySimd simd)
+{
+	Uint32 key = SDL_MapRGB(surface->format, 0, 0xFF, 0xFF) & 0x00FFFFFF;
+	for (int y = 0; y < surface->h; ++y)
+	{
+		Uint32* row = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch);
+		switch (simd)
+		{
+			#if KEY_X86
+			case KEY_SIMD_AVX2: keyRowAvx2(row, surface->w, key); break;
+			case KEY_SIMD_SSE2: keyRowSse2(row, surface->w, key); break;
+			#endif
+			#if KEY_NEON
+			case KEY_SIMD_NEON: keyRowNeon(row, surface->w, key); break;
+			#endif
+			default: keyRowScalar(row, surface->w, key); break;
+		}
+	}
+
+	// converted RGB images start out unblended, and the keyed pixels only vanish when the texture blends
+	SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_BLEND);
+}
+
+LKeySimd LTexture::getBestKeySimd()
+{
+	#if KEY_X86
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return KEY_SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return KEY_SIMD_SSE2;
+	}
+	#elif KEY_NEON
+	return KEY_SIMD_NEON;
+	#endif
+	return KEY_SIMD_SCALAR;
+}
+
+const char* LTexture::getKeySimdName(LKeySimd simd)
+{
+	switch (simd)
+	{
+		case KEY_SIMD_AVX2: return "avx2";
+		case KEY_SIMD_SSE2: return "sse2";
+		case KEY_SIMD_NEON: return "neon";
+		default: return "scalar";
+	}
+}
+
 LTexture::LTexture()
 {
 	// initialize
@@ -216,17 +697,14 @@ bool LTexture::loadFromFile(std::string path)
 	// create the texture
 	SDL_Texture* newTexture = NULL;
 
-	// first create a surface 
-	SDL_Surface* newSurface= IMG_Load(path.c_str());
+	// first create a surface, with the color key already turned into alpha
+	SDL_Surface* newSurface = loadKeyedSurface(path);
 	if (newSurface == NULL)
 	{
-		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		printf("Could not load image %s!\n", path.c_str()); 
 	}
 	else
 	{
-		// color key the image we load
-		SDL_SetColorKey(newSurface, SDL_TRUE, SDL_MapRGB(newSurface->format, 0, 0xFF, 0xFF));
-
 		// create texture from surface pixels
 		newTexture = SDL_CreateTextureFromSurface(gRenderer, newSurface);
 		if (newTexture == NULL) 
@@ -310,6 +788,7 @@ void LTexture::free()
 	if (mTexture != NULL)
 	{
 		SDL_DestroyTexture(mTexture);
+		mTexture = NULL;
 		mWidth = 0;
 		mHeight = 0;
 		printf("Freed texture\n");
@@ -328,8 +807,8 @@ void LTexture::render(int x, int y, SDL_Rect* clip, double angle, SDL_Point* cen
 		renderQuad.h = clip->h;
 	}
 
-	// render to screen
-	SDL_RenderCopyEx(gRenderer, mTexture, clip, &renderQuad, angle, center, flip);
+	// queue for the screen
+	gSpriteBatch.draw(mTexture, mWidth, mHeight, clip, &renderQuad, angle, center, flip);
 }
 
 int LTexture::getWidth()
@@ -342,76 +821,776 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
-// ========================== Function Delcarations ==========================
-// loads up SDL and creates window
-bool init();
-
-// loads media
-bool loadMedia();
+// ========================== Sprite Batch Class Function Definitions ==========================
+LSpriteBatch::LSpriteBatch()
+{
+	mTexture = NULL;
+	mBlendMode = SDL_BLENDMODE_NONE;
+	mColor.r = 0xFF;
+	mColor.g = 0xFF;
+	mColor.b = 0xFF;
+	mColor.a = 0xFF;
+
+	mEnabled = true;
+
+	mCalls = 0;
+	mQuads = 0;
+	mCallsLastFrame = 0;
+	mQuadsLastFrame = 0;
+}
 
-// Frees media and shuts down SDL
-void close();
+void LSpriteBatch::setEnabled(bool enabled)
+{
+	// don't let queued quads change mode under us
+	flush();
+	mEnabled = enabled;
+}
 
-// Loads individual image
-SDL_Texture* loadTexture(std::string path);
+bool LSpriteBatch::isEnabled()
+{
+	return mEnabled;
+}
 
-// ========================== Function Definitions ==========================
-bool init()
+void LSpriteBatch::draw(SDL_Texture* texture, int textureWidth, int textureHeight, SDL_Rect* clip, SDL_Rect* dest, double angle, SDL_Point* center, SDL_RendererFlip flip)
 {
-	// Initialization flag
-	bool success = true;
+	++mQuads;
 
-	// Initialize SDL
-	if (SDL_Init(SDL_INIT_VIDEO) < 0)
+	// batching off, render it the old way
+	if (!mEnabled)
 	{
-		printf("SDL couldn't initialize! SDL_Error: %s\n", SDL_GetError());
-		success = false;
+		SDL_RenderCopyEx(gRenderer, texture, clip, dest, angle, center, flip);
+		++mCalls;
+		return;
 	}
-	else
-	{
-		// Create the window
-		gWindow = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
-		if (gWindow == NULL)
-		{ 
-		  printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
-		  success = false;
-		}
-		else
-		{
-			// initialize the renderer for the window
-			gRenderer = SDL_CreateRenderer(gWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-			if (gRenderer == NULL)
-			{
-				printf("Renderer could not be initialized! SDL_Error: %s\n", SDL_GetError());
-				success = false;
-			}
-			else
-			{
-				// initialize renderer color
-				SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
-			}
 
-			// initialize PNG loading
-			int imgFlags = IMG_INIT_PNG;
-			if (!(IMG_Init(imgFlags) & imgFlags))
-			{
-				printf("SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError()); 
-				success = false;
-			}
+	// read the state this quad has to be drawn with
+	SDL_BlendMode blendMode;
+	SDL_Color color;
+	SDL_GetTextureBlendMode(texture, &blendMode);
+	SDL_GetTextureColorMod(texture, &color.r, &color.g, &color.b);
+	SDL_GetTextureAlphaMod(texture, &color.a);
 
-			// Initialize SDL_ttf
-			if (TTF_Init() == -1)
-			{
-				printf("SDL_ttf could not initialize! SDL_ttf Error: %s\n", TTF_GetError());
-				success = false;
-			}
-		}
+	// a different state can't share the batch
+	if (!mVertices.empty() && (texture != mTexture || blendMode != mBlendMode || color.r != mColor.r || color.g != mColor.g || color.b != mColor.b || color.a != mColor.a))
+	{
+		flush();
 	}
-	
-	return success;
-}
+	mTexture = texture;
+	mBlendMode = blendMode;
+	mColor = color;
 
-bool loadMedia()
+	// texture coordinates of the clip
+	float u0 = 0.f, v0 = 0.f, u1 = 1.f, v1 = 1.f;
+	if (clip != NULL)
+	{
+		u0 = clip->x / (float)textureWidth;
+		v0 = clip->y / (float)textureHeight;
+		u1 = (clip->x + clip->w) / (float)textureWidth;
+		v1 = (clip->y + clip->h) / (float)textureHeight;
+	}
+
+	// flipping just swaps the texture coordinates
+	if (flip & SDL_FLIP_HORIZONTAL)
+	{
+		float temp = u0; u0 = u1; u1 = temp;
+	}
+	if (flip & SDL_FLIP_VERTICAL)
+	{
+		float temp = v0; v0 = v1; v1 = temp;
+	}
+
+	// rotation point relative to the quad, same default as SDL_RenderCopyEx
+	float centerX = dest->w / 2.f;
+	float centerY = dest->h / 2.f;
+	if (center != NULL)
+	{
+		centerX = center->x;
+		centerY = center->y;
+	}
+
+	// clockwise rotation, skipping the trig for the common case
+	float cosine = 1.f, sine = 0.f;
+	if (angle != 0.0)
+	{
+		double radians = angle * M_PI / 180.0;
+		cosine = (float)cos(radians);
+		sine = (float)sin(radians);
+	}
+
+	// corners in top left, top right, bottom right, bottom left order
+	float cornerX[4] = {0.f, (float)dest->w, (float)dest->w, 0.f};
+	float cornerY[4] = {0.f, 0.f, (float)dest->h, (float)dest->h};
+	float cornerU[4] = {u0, u1, u1, u0};
+	float cornerV[4] = {v0, v0, v1, v1};
+	for (int i = 0; i < 4; ++i)
+	{
+		float x = cornerX[i] - centerX;
+		float y = cornerY[i] - centerY;
+
+		SDL_Vertex vertex;
+		vertex.position.x = dest->x + centerX + x * cosine - y * sine;
+		vertex.position.y = dest->y + centerY + x * sine + y * cosine;
+		vertex.color = color;
+		vertex.tex_coord.x = cornerU[i];
+		vertex.tex_coord.y = cornerV[i];
+		mVertices.push_back(vertex);
+	}
+}
+
+void LSpriteBatch::flush()
+{
+	// nothing queued
+	if (mVertices.empty())
+	{
+		return;
+	}
+
+	// make sure the index pattern covers every queued quad
+	int quads = mVertices.size() / 4;
+	while ((int)mIndices.size() < quads * 6)
+	{
+		int base = mIndices.size() / 6 * 4;
+		mIndices.push_back(base);
+		mIndices.push_back(base + 1);
+		mIndices.push_back(base + 2);
+		mIndices.push_back(base + 2);
+		mIndices.push_back(base + 3);
+		mIndices.push_back(base);
+	}
+
+	// the vertex colors already carry the modulation, so don't let the texture apply it twice
+	SDL_SetTextureColorMod(mTexture, 0xFF, 0xFF, 0xFF);
+	SDL_SetTextureAlphaMod(mTexture, 0xFF);
+
+	// one submission for the whole batch
+	SDL_RenderGeometry(gRenderer, mTexture, &mVertices[0], mVertices.size(), &mIndices[0], quads * 6);
+	++mCalls;
+
+	// put the texture state back
+	SDL_SetTextureColorMod(mTexture, mColor.r, mColor.g, mColor.b);
+	SDL_SetTextureAlphaMod(mTexture, mColor.a);
+
+	// start a new batch, keeping the allocation
+	mVertices.clear();
+}
+
+void LSpriteBatch::present()
+{
+	// everything queued has to hit the renderer first
+	flush();
+	SDL_RenderPresent(gRenderer);
+
+	// roll the frame counters over
+	mCallsLastFrame = mCalls;
+	mQuadsLastFrame = mQuads;
+	mCalls = 0;
+	mQuads = 0;
+}
+
+int LSpriteBatch::getCallsLastFrame()
+{
+	return mCallsLastFrame;
+}
+
+int LSpriteBatch::getQuadsLastFrame()
+{
+	return mQuadsLastFrame;
+}
+
+// ========================== Button Hit-Test Grid Class Function Definitions ==========================
+LButtonGrid::LButtonGrid()
+{
+	// initialize
+	mOrigin.x = 0;
+	mOrigin.y = 0;
+	mCellSize = HIT_GRID_CELL_SIZE;
+	mColumns = 0;
+	mRows = 0;
+	mDispatches = 0;
+}
+
+void LButtonGrid::build(LButton* buttons, int count, int cellSize)
+{
+	mCellSize = cellSize;
+	mCellStarts.clear();
+	mCellButtons.clear();
+	mHovered.clear();
+	mDispatches = 0;
+	if (count == 0)
+	{
+		mColumns = 0;
+		mRows = 0;
+		return;
+	}
+
+	// cover the bounds of every button, right and bottom edges included
+	SDL_Point low = buttons[0].getPosition();
+	SDL_Point high = low;
+	for (int i = 1; i < count; ++i)
+	{
+		SDL_Point position = buttons[i].getPosition();
+		low.x = std::min(low.x, position.x);
+		low.y = std::min(low.y, position.y);
+		high.x = std::max(high.x, position.x);
+		high.y = std::max(high.y, position.y);
+	}
+	mOrigin = low;
+	mColumns = (high.x + BUTTON_WIDTH - low.x) / mCellSize + 1;
+	mRows = (high.y + BUTTON_HEIGHT - low.y) / mCellSize + 1;
+
+	// count the buttons per cell, then fill each cell's slice
+	mCellStarts.assign(mColumns * mRows + 1, 0);
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		std::vector<int> fill(mCellStarts.begin(), mCellStarts.end() - 1);
+		for (int i = 0; i < count; ++i)
+		{
+			SDL_Point position = buttons[i].getPosition();
+			int firstColumn = (position.x - mOrigin.x) / mCellSize;
+			int lastColumn = (position.x + BUTTON_WIDTH - mOrigin.x) / mCellSize;
+			int firstRow = (position.y - mOrigin.y) / mCellSize;
+			int lastRow = (position.y + BUTTON_HEIGHT - mOrigin.y) / mCellSize;
+
+			for (int row = firstRow; row <= lastRow; ++row)
+			{
+				for (int column = firstColumn; column <= lastColumn; ++column)
+				{
+					int cell = row * mColumns + column;
+					if (pass == 0)
+					{
+						++mCellStarts[cell + 1];
+					}
+					else
+					{
+						mCellButtons[fill[cell]++] = &buttons[i];
+					}
+				}
+			}
+		}
+
+		// turn the counts into offsets
+		if (pass == 0)
+		{
+			for (int cell = 0; cell < mColumns * mRows; ++cell)
+			{
+				mCellStarts[cell + 1] += mCellStarts[cell];
+			}
+			mCellButtons.resize(mCellStarts.back());
+		}
+	}
+}
+
+void LButtonGrid::handleEvent(SDL_Event* e)
+{
+	// if mouse event happened
+	if (e->type != SDL_MOUSEMOTION && e->type != SDL_MOUSEBUTTONDOWN && e->type != SDL_MOUSEBUTTONUP)
+	{
+		return;
+	}
+
+	// the position comes with the event, no need to poll
+	int x = e->type == SDL_MOUSEMOTION ? e->motion.x : e->button.x;
+	int y = e->type == SDL_MOUSEMOTION ? e->motion.y : e->button.y;
+
+	// only the buttons sharing the cell can be under the mouse
+	mNextHovered.clear();
+	int column = x - mOrigin.x >= 0 ? (x - mOrigin.x) / mCellSize : -1;
+	int row = y - mOrigin.y >= 0 ? (y - mOrigin.y) / mCellSize : -1;
+	if (column >= 0 && column < mColumns && row >= 0 && row < mRows)
+	{
+		int cell = row * mColumns + column;
+		for (int i = mCellStarts[cell]; i < mCellStarts[cell + 1]; ++i)
+		{
+			if (mCellButtons[i]->contains(x, y))
+			{
+				mCellButtons[i]->handleEvent(e);
+				mNextHovered.push_back(mCellButtons[i]);
+				++mDispatches;
+			}
+		}
+	}
+
+	// the ones the mouse just left go back to the out sprite
+	for (int i = 0; i < (int)mHovered.size(); ++i)
+	{
+		if (std::find(mNextHovered.begin(), mNextHovered.end(), mHovered[i]) == mNextHovered.end())
+		{
+			mHovered[i]->handleMouseLeave();
+			++mDispatches;
+		}
+	}
+	mHovered.swap(mNextHovered);
+}
+
+long long LButtonGrid::getDispatchCount()
+{
+	return mDispatches;
+}
+
+// ========================== Input Recorder Class Function Definitions ==========================
+LInputRecorder::LInputRecorder()
+{
+	// initialize
+	mFile = NULL;
+	mNext = 0;
+	mRecording = false;
+	mReplaying = false;
+	mFrame = 0;
+	mFrameStart = 0;
+}
+
+LInputRecorder::~LInputRecorder()
+{
+	// deallocate
+	stop();
+}
+
+bool LInputRecorder::startRecording(std::string path)
+{
+	stop();
+
+	mFile = fopen(path.c_str(), "wb");
+	if (mFile == NULL)
+	{
+		printf("Unable to write input log %s!\n", path.c_str());
+		return false;
+	}
+
+	// no fixed timestep here
+	LInputHeader header;
+	memcpy(header.magic, INPUT_LOG_MAGIC, sizeof(header.magic));
+	header.version = INPUT_LOG_VERSION;
+	header.tickRate = 0;
+	fwrite(&header, sizeof(header), 1, mFile);
+
+	mRecording = true;
+	mFrame = 0;
+	return true;
+}
+
+bool LInputRecorder::startReplay(std::string path)
+{
+	stop();
+
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == NULL)
+	{
+		printf("Unable to read input log %s!\n", path.c_str());
+		return false;
+	}
+
+	LInputHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, INPUT_LOG_MAGIC, sizeof(header.magic)) != 0 || header.version != INPUT_LOG_VERSION)
+	{
+		printf("%s is not an input log!\n", path.c_str());
+		fclose(file);
+		return false;
+	}
+
+	LInputRecord record;
+	while (fread(&record, sizeof(record), 1, file) == 1)
+	{
+		mRecords.push_back(record);
+	}
+	fclose(file);
+
+	mReplaying = true;
+	mNext = 0;
+	mFrame = 0;
+	mFrameCounts.clear();
+	mFrameStart = SDL_GetPerformanceCounter();
+	return true;
+}
+
+void LInputRecorder::stop()
+{
+	if (mFile != NULL)
+	{
+		fclose(mFile);
+		mFile = NULL;
+	}
+	mRecords.clear();
+	mRecording = false;
+	mReplaying = false;
+}
+
+void LInputRecorder::beginFrame()
+{
+	while (mReplaying && mNext < (int)mRecords.size() && mRecords[mNext].frame == mFrame)
+	{
+		SDL_Event e;
+		unpack(mRecords[mNext++], e);
+		SDL_PushEvent(&e);
+	}
+}
+
+void LInputRecorder::record(const SDL_Event& e)
+{
+	LInputRecord record;
+	if (mRecording && pack(e, record))
+	{
+		record.frame = mFrame;
+		fwrite(&record, sizeof(record), 1, mFile);
+	}
+}
+
+void LInputRecorder::endFrame()
+{
+	if (mReplaying)
+	{
+		Uint64 now = SDL_GetPerformanceCounter();
+		mFrameCounts.push_back(now - mFrameStart);
+		mFrameStart = now;
+	}
+	++mFrame;
+}
+
+bool LInputRecorder::isReplaying()
+{
+	return mReplaying;
+}
+
+bool LInputRecorder::isFinished()
+{
+	return mReplaying && mNext >= (int)mRecords.size();
+}
+
+void LInputRecorder::printReplayStats()
+{
+	if (mFrameCounts.empty())
+	{
+		return;
+	}
+
+	std::vector<Uint64> sorted(mFrameCounts);
+	std::sort(sorted.begin(), sorted.end());
+	Uint64 total = 0;
+	for (int i = 0; i < (int)sorted.size(); ++i)
+	{
+		total += sorted[i];
+	}
+
+	double toMs = 1000.0 / SDL_GetPerformanceFrequency();
+	printf("replayed %d frames in %.3f s: mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", (int)sorted.size(), total * toMs / 1000.0,
+		total * toMs / sorted.size(), sorted[sorted.size() / 2] * toMs, sorted[sorted.size() * 99 / 100] * toMs, sorted.back() * toMs);
+}
+
+bool LInputRecorder::pack(const SDL_Event& e, LInputRecord& record)
+{
+	memset(record.data, 0, sizeof(record.data));
+	record.type = e.type;
+	switch (e.type)
+	{
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+		record.data[0] = e.key.keysym.sym;
+		record.data[1] = e.key.keysym.scancode;
+		record.data[2] = e.key.keysym.mod;
+		record.data[3] = e.key.repeat;
+		record.data[4] = e.key.state;
+		return true;
+
+		case SDL_MOUSEMOTION:
+		record.data[0] = e.motion.x;
+		record.data[1] = e.motion.y;
+		record.data[2] = e.motion.xrel;
+		record.data[3] = e.motion.yrel;
+		record.data[4] = e.motion.state;
+		return true;
+
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEBUTTONUP:
+		record.data[0] = e.button.x;
+		record.data[1] = e.button.y;
+		record.data[2] = e.button.button;
+		record.data[3] = e.button.state;
+		record.data[4] = e.button.clicks;
+		return true;
+
+		case SDL_QUIT:
+		return true;
+	}
+
+	return false;
+}
+
+void LInputRecorder::unpack(const LInputRecord& record, SDL_Event& e)
+{
+	memset(&e, 0, sizeof(e));
+	e.type = record.type;
+	switch (record.type)
+	{
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+		e.key.keysym.sym = record.data[0];
+		e.key.keysym.scancode = (SDL_Scancode)record.data[1];
+		e.key.keysym.mod = record.data[2];
+		e.key.repeat = record.data[3];
+		e.key.state = record.data[4];
+		break;
+
+		case SDL_MOUSEMOTION:
+		e.motion.x = record.data[0];
+		e.motion.y = record.data[1];
+		e.motion.xrel = record.data[2];
+		e.motion.yrel = record.data[3];
+		e.motion.state = record.data[4];
+		break;
+
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEBUTTONUP:
+		e.button.x = record.data[0];
+		e.button.y = record.data[1];
+		e.button.button = record.data[2];
+		e.button.state = record.data[3];
+		e.button.clicks = record.data[4];
+		break;
+	}
+}
+
+// ========================== Texture Cache Class Function Definitions ==========================
+LTextureCache::LTextureCache()
+{
+	// initialize
+	mBudget = TEXTURE_CACHE_BUDGET;
+	mResidentBytes = 0;
+	mHits = 0;
+	mMisses = 0;
+	mEvictions = 0;
+}
+
+LTextureCache::~LTextureCache()
+{
+	// deallocate
+	free();
+}
+
+LTexture* LTextureCache::acquire(std::string path)
+{
+	std::string key = canonicalize(path);
+
+	// already resident, just take another reference
+	std::map<std::string, Entry*>::iterator found = mEntries.find(key);
+	if (found != mEntries.end())
+	{
+		Entry* entry = found->second;
+		if (entry->refs == 0)
+		{
+			mIdle.erase(entry->idlePosition);
+		}
+		++entry->refs;
+		++mHits;
+		return &entry->texture;
+	}
+
+	// first request, decode and upload it
+	++mMisses;
+	Entry* entry = new Entry();
+	if (!entry->texture.loadFromFile(path))
+	{
+		delete entry;
+		return NULL;
+	}
+	entry->key = key;
+	entry->refs = 1;
+	entry->bytes = entry->texture.getWidth() * entry->texture.getHeight() * 4;
+
+	mEntries[key] = entry;
+	mOwners[&entry->texture] = entry;
+	mResidentBytes += entry->bytes;
+
+	// make room among the idle ones
+	trim();
+
+	return &entry->texture;
+}
+
+void LTextureCache::release(LTexture* texture)
+{
+	std::map<LTexture*, Entry*>::iterator found = mOwners.find(texture);
+	if (found == mOwners.end())
+	{
+		printf("Released a texture the cache does not own!\n");
+		return;
+	}
+
+	// the last reference makes it an eviction candidate
+	Entry* entry = found->second;
+	if (--entry->refs == 0)
+	{
+		mIdle.push_front(entry);
+		entry->idlePosition = mIdle.begin();
+		trim();
+	}
+}
+
+void LTextureCache::setBudget(int bytes)
+{
+	mBudget = bytes;
+	trim();
+}
+
+int LTextureCache::getBudget()
+{
+	return mBudget;
+}
+
+void LTextureCache::free()
+{
+	// the textures free themselves
+	for (std::map<std::string, Entry*>::iterator it = mEntries.begin(); it != mEntries.end(); ++it)
+	{
+		delete it->second;
+	}
+	mEntries.clear();
+	mOwners.clear();
+	mIdle.clear();
+	mResidentBytes = 0;
+}
+
+int LTextureCache::getHits()
+{
+	return mHits;
+}
+
+int LTextureCache::getMisses()
+{
+	return mMisses;
+}
+
+int LTextureCache::getEvictions()
+{
+	return mEvictions;
+}
+
+int LTextureCache::getResidentCount()
+{
+	return mEntries.size();
+}
+
+int LTextureCache::getResidentBytes()
+{
+	return mResidentBytes;
+}
+
+void LTextureCache::printStats()
+{
+	printf("texture cache: %d hits, %d misses, %d evictions, %d textures resident (%.1f of %.1f MB)\n",
+		mHits, mMisses, mEvictions, getResidentCount(), mResidentBytes / (1024.0 * 1024.0), mBudget / (1024.0 * 1024.0));
+}
+
+std::string LTextureCache::canonicalize(std::string path)
+{
+	// fall back to the path as given if it doesn't resolve, the load will report the error
+	char* resolved = realpath(path.c_str(), NULL);
+	if (resolved == NULL)
+	{
+		return path;
+	}
+
+	std::string key = resolved;
+	::free(resolved);
+	return key;
+}
+
+void LTextureCache::trim()
+{
+	// referenced textures are never evicted, so the budget can be overshot while they are in use
+	while (mResidentBytes > mBudget && !mIdle.empty())
+	{
+		Entry* entry = mIdle.back();
+		mIdle.pop_back();
+
+		mEntries.erase(entry->key);
+		mOwners.erase(&entry->texture);
+		mResidentBytes -= entry->bytes;
+		++mEvictions;
+
+		delete entry;
+	}
+}
+
+// ========================== Function Delcarations ==========================
+// loads up SDL and creates window (software renderer for benchmarking)
+bool init(bool softwareRenderer = false);
+
+// loads media
+bool loadMedia();
+
+// Frees media and shuts down SDL
+void close();
+
+// Loads individual image
+SDL_Texture* loadTexture(std::string path);
+
+// Draws clipped sprites with and without batching and reports the difference
+void runSpriteBenchmark();
+
+// Hit-tests 10k buttons against a stream of motion events, every button vs the grid
+void runHitTestBenchmark();
+
+// ========================== Function Definitions ==========================
+bool init(bool softwareRenderer)
+{
+	// Initialization flag
+	bool success = true;
+
+	// Initialize SDL
+	if (SDL_Init(SDL_INIT_VIDEO) < 0)
+	{
+		printf("SDL couldn't initialize! SDL_Error: %s\n", SDL_GetError());
+		success = false;
+	}
+	else
+	{
+		// Create the window
+		gWindow = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+		if (gWindow == NULL)
+		{ 
+		  printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+		  success = false;
+		}
+		else
+		{
+			// initialize the renderer for the window
+			Uint32 rendererFlags = SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC;
+			if (softwareRenderer)
+			{
+				rendererFlags = SDL_RENDERER_SOFTWARE;
+			}
+			gRenderer = SDL_CreateRenderer(gWindow, -1, rendererFlags);
+			if (gRenderer == NULL)
+			{
+				printf("Renderer could not be initialized! SDL_Error: %s\n", SDL_GetError());
+				success = false;
+			}
+			else
+			{
+				// initialize renderer color
+				SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
+			}
+
+			// initialize PNG loading
+			int imgFlags = IMG_INIT_PNG;
+			if (!(IMG_Init(imgFlags) & imgFlags))
+			{
+				printf("SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError()); 
+				success = false;
+			}
+
+			// Initialize SDL_ttf
+			if (TTF_Init() == -1)
+			{
+				printf("SDL_ttf could not initialize! SDL_ttf Error: %s\n", TTF_GetError());
+				success = false;
+			}
+		}
+	}
+	
+	return success;
+}
+
+bool loadMedia()
 {
 	// Function success
 	bool success = true;
@@ -437,7 +1616,8 @@ bool loadMedia()
 	#endif
 
 	// load button sprite sheet texture
-	if (!gButtonSpriteSheetTexture.loadFromFile("media/button.png"))
+	gButtonSpriteSheetTexture = gTextureCache.acquire("media/button.png");
+	if (gButtonSpriteSheetTexture == NULL)
 	{
 		printf("Failed to load button sprite sheet!\n");
 		success = false;
@@ -452,8 +1632,13 @@ bool loadMedia()
 			gButtonClips[i].w = BUTTON_WIDTH;
 			gButtonClips[i].h = BUTTON_HEIGHT;
 
+			// every button shares the sheet that is already resident
 			gButtons[i].setPosition(0, i * BUTTON_HEIGHT);
+			gButtons[i].setSpriteSheet("media/button.png");
 		}
+
+		// events only go to the buttons under the mouse
+		gButtonGrid.build(gButtons, TOTAL_BUTTONS);
 	}
 	
 	return success;
@@ -465,6 +1650,19 @@ void close()
 	// they go out of scope and the destructor is automatically called, which is dope
 	gTextTexture.free();
 
+	// drop the texture references and empty the cache while the renderer is still around
+	for (int i = 0; i < TOTAL_BUTTONS; ++i)
+	{
+		gButtons[i].free();
+	}
+	if (gButtonSpriteSheetTexture != NULL)
+	{
+		gTextureCache.release(gButtonSpriteSheetTexture);
+		gButtonSpriteSheetTexture = NULL;
+	}
+	gTextureCache.printStats();
+	gTextureCache.free();
+
 	// Free the global font
 	TTF_CloseFont(gFont);
 	gFont = NULL;
@@ -493,10 +1691,170 @@ SDL_Texture* loadTexture(std::string path)
 	return newTexture;
 }
 
+void runSpriteBenchmark()
+{
+	// small clips spread over the whole sheet
+	int clipsPerRow = gButtonSpriteSheetTexture->getWidth() / BENCH_CLIP_SIZE;
+	int clipsPerColumn = gButtonSpriteSheetTexture->getHeight() / BENCH_CLIP_SIZE;
+	std::vector<SDL_Rect> clips(clipsPerRow * clipsPerColumn);
+	for (int i = 0; i < (int)clips.size(); ++i)
+	{
+		clips[i].x = (i % clipsPerRow) * BENCH_CLIP_SIZE;
+		clips[i].y = (i / clipsPerRow) * BENCH_CLIP_SIZE;
+		clips[i].w = BENCH_CLIP_SIZE;
+		clips[i].h = BENCH_CLIP_SIZE;
+	}
+
+	// the same scene for both runs
+	std::vector<SDL_Point> positions(BENCH_SPRITES);
+	std::vector<int> sprites(BENCH_SPRITES);
+	srand(16);
+	for (int i = 0; i < BENCH_SPRITES; ++i)
+	{
+		positions[i].x = rand() % (SCREEN_WIDTH - BENCH_CLIP_SIZE);
+		positions[i].y = rand() % (SCREEN_HEIGHT - BENCH_CLIP_SIZE);
+		sprites[i] = rand() % clips.size();
+	}
+
+	// first run without batching, then with it
+	for (int run = 0; run < 2; ++run)
+	{
+		gSpriteBatch.setEnabled(run == 1);
+
+		int calls = 0;
+		Uint64 start = SDL_GetPerformanceCounter();
+		for (int frame = 0; frame < BENCH_FRAMES; ++frame)
+		{
+			SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
+			SDL_RenderClear(gRenderer);
+
+			for (int i = 0; i < BENCH_SPRITES; ++i)
+			{
+				gButtonSpriteSheetTexture->render(positions[i].x, positions[i].y, &clips[sprites[i]]);
+			}
+
+			gSpriteBatch.present();
+			calls += gSpriteBatch.getCallsLastFrame();
+		}
+		double frameMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() / BENCH_FRAMES;
+
+		printf("%-9s %d sprites: %d calls/frame, %.3f ms/frame\n", run == 1 ? "batched" : "unbatched", BENCH_SPRITES, calls / BENCH_FRAMES, frameMs);
+	}
+}
+
+void runHitTestBenchmark()
+{
+	// a big sheet of buttons, one copy per approach
+	int count = HIT_BENCH_COLUMNS * HIT_BENCH_ROWS;
+	std::vector<LButton> linearButtons(count);
+	std::vector<LButton> gridButtons(count);
+	for (int i = 0; i < count; ++i)
+	{
+		linearButtons[i].setPosition((i % HIT_BENCH_COLUMNS) * BUTTON_WIDTH, (i / HIT_BENCH_COLUMNS) * BUTTON_HEIGHT);
+		gridButtons[i].setPosition((i % HIT_BENCH_COLUMNS) * BUTTON_WIDTH, (i / HIT_BENCH_COLUMNS) * BUTTON_HEIGHT);
+	}
+	LButtonGrid grid;
+	grid.build(&gridButtons[0], count);
+
+	// a wandering mouse with the odd click
+	std::vector<SDL_Event> events(HIT_BENCH_EVENTS);
+	int x = 0;
+	int y = 0;
+	srand(16);
+	for (int i = 0; i < HIT_BENCH_EVENTS; ++i)
+	{
+		x = std::max(0, std::min(HIT_BENCH_COLUMNS * BUTTON_WIDTH, x + rand() % 201 - 100));
+		y = std::max(0, std::min(HIT_BENCH_ROWS * BUTTON_HEIGHT, y + rand() % 201 - 100));
+
+		memset(&events[i], 0, sizeof(SDL_Event));
+		if (rand() % 100 == 0)
+		{
+			events[i].type = rand() % 2 == 0 ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+			events[i].button.x = x;
+			events[i].button.y = y;
+		}
+		else
+		{
+			events[i].type = SDL_MOUSEMOTION;
+			events[i].motion.x = x;
+			events[i].motion.y = y;
+		}
+	}
+
+	// every button sees every event, only a slice of the stream or this takes minutes
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < HIT_BENCH_LINEAR_EVENTS; ++i)
+	{
+		for (int j = 0; j < count; ++j)
+		{
+			linearButtons[j].handleEvent(&events[i]);
+		}
+	}
+	double linearNs = (SDL_GetPerformanceCounter() - start) * 1000000000.0 / SDL_GetPerformanceFrequency() / HIT_BENCH_LINEAR_EVENTS;
+
+	// the grid over the same slice has to end up in the same state
+	for (int i = 0; i < HIT_BENCH_LINEAR_EVENTS; ++i)
+	{
+		grid.handleEvent(&events[i]);
+	}
+	int mismatches = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (linearButtons[i].getSprite() != gridButtons[i].getSprite())
+		{
+			++mismatches;
+		}
+	}
+
+	// then the whole stream
+	start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < HIT_BENCH_EVENTS; ++i)
+	{
+		grid.handleEvent(&events[i]);
+	}
+	double gridNs = (SDL_GetPerformanceCounter() - start) * 1000000000.0 / SDL_GetPerformanceFrequency() / HIT_BENCH_EVENTS;
+
+	printf("%d buttons, %d events\n", count, HIT_BENCH_EVENTS);
+	printf("every button: %.1f ns/event (%.2f s for the stream, measured over %d events)\n", linearNs, linearNs * HIT_BENCH_EVENTS / 1000000000.0, HIT_BENCH_LINEAR_EVENTS);
+	printf("grid:         %.1f ns/event (%.3f s for the stream), %.2f buttons touched per event, %.0fx faster\n",
+		gridNs, gridNs * HIT_BENCH_EVENTS / 1000000000.0, (double)grid.getDispatchCount() / (HIT_BENCH_LINEAR_EVENTS + HIT_BENCH_EVENTS), linearNs / gridNs);
+	if (mismatches > 0)
+	{
+		printf("%d buttons ended up in a different state with the grid!\n", mismatches);
+	}
+}
+
 int main( int argc, char* args[])
 { 
- 	// start up SDL and create the window
-	if (!init())
+	// --hit-bench needs no window
+	if (argc > 1 && strcmp(args[1], "--hit-bench") == 0)
+	{
+		runHitTestBenchmark();
+		return 0;
+	}
+
+	// --bench draws with the software renderer and exits
+	bool benchmark = argc > 1 && strcmp(args[1], "--bench") == 0;
+
+	// --record <log> saves the input, --replay <log> plays it back without a real display unless SDL_VIDEODRIVER says otherwise
+	LInputRecorder recorder;
+	bool replaying = false;
+	if (argc > 2 && strcmp(args[1], "--record") == 0 && !recorder.startRecording(args[2]))
+	{
+		return 1;
+	}
+	else if (argc > 2 && strcmp(args[1], "--replay") == 0)
+	{
+		if (!recorder.startReplay(args[2]))
+		{
+			return 1;
+		}
+		SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+		replaying = true;
+	}
+
+ 	// start up SDL and create the window, the dummy driver only has the software renderer
+	if (!init(benchmark || replaying))
 	{
 		printf("Failed to initialize!\n");
 	}
@@ -507,6 +1865,12 @@ int main( int argc, char* args[])
 		{
 			printf("Failed to load media!\n");
 		}
+		else if (benchmark)
+		{
+			runSpriteBenchmark();
+			close();
+			return 0;
+		}
 		
 		// main loop
 		bool quit = false;
@@ -522,9 +1886,14 @@ int main( int argc, char* args[])
 		// The main loop of the game
 		while (!quit) 
 		{
+			// a replay queues up this frame's recorded input
+			recorder.beginFrame();
+
 			// handle events on the queue
 			while (SDL_PollEvent(&e) != 0) 
 			{
+				recorder.record(e);
+
 				// the user requests to quit
 				if (e.type == SDL_QUIT) 
 				{
@@ -532,10 +1901,7 @@ int main( int argc, char* args[])
 				}
 
 				// handle button events
-				for (int i = 0; i < TOTAL_BUTTONS; ++i)
-				{
-					gButtons[i].handleEvent(&e);
-				}
+				gButtonGrid.handleEvent(&e);
 			}
 		
 			// Clear the screen
@@ -548,14 +1914,24 @@ int main( int argc, char* args[])
 				gButtons[i].render();
 			}
 
-			// Update screen
-			SDL_RenderPresent(gRenderer);
+			// Submit the batched sprites and update screen
+			gSpriteBatch.present();
 
 
 			// Increment the value
 			++counter;
+			recorder.endFrame();
+
+			// the log ran out
+			if (recorder.isFinished())
+			{
+				quit = true;
+			}
 		}
+
+		recorder.printReplayStats();
 	}
+	recorder.stop();
 
 	// close out resources and SDL
 	close();
@@ -4,7 +4,26 @@
 #include <SDL2/SDL_ttf.h>
 #include <stdio.h>
 #include <string>
+#include <string.h>
 #include <cmath>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <dirent.h>
+
+// the color key kernel's SIMD paths are SSE2/AVX2 on x86 and NEON on AArch64, everything else keys with the scalar code
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEY_X86 1
+#else
+#define KEY_X86 0
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define KEY_NEON 1
+#else
+#define KEY_NEON 0
+#endif
 
 // ========================== Constants and Enums ==========================
 // screen constants
@@ -16,6 +35,10 @@ const int BUTTON_WIDTH = 300;
 const int BUTTON_HEIGHT = 200;
 const int TOTAL_BUTTONS = 4;
 
+// Atlas constants
+const int ATLAS_PAGE_SIZE = 2048;
+const int ATLAS_PADDING = 1;
+
 enum LButtonSprite
 {
 	BUTTON_SPRITE_MOUSE_OUT,
@@ -25,6 +48,15 @@ enum LButtonSprite
 	BUTTON_SPRITE_TOTAL
 };
 
+// the color key kernel code paths, best one picked at runtime
+enum LKeySimd
+{
+	KEY_SIMD_SCALAR,
+	KEY_SIMD_SSE2,
+	KEY_SIMD_AVX2,
+	KEY_SIMD_NEON
+};
+
 // ========================== Button Wrapper Class ==========================
 class LButton
 {
@@ -62,6 +94,16 @@ class LTexture
         // Loads image at specified path
         bool loadFromFile(std::string path);
 
+        // Loads an image as ARGB8888 with the cyan color key pixels already transparent, the caller frees it
+        static SDL_Surface* loadKeyedSurface(std::string path);
+
+        // Makes every color key pixel of an ARGB8888 surface transparent black in place, and has it blend
+        static void keySurface(SDL_Surface* surface, LKeySimd simd);
+
+        // the color key code paths
+        static LKeySimd getBestKeySimd();
+        static const char* getKeySimdName(LKeySimd simd);
+
 		#if defined(SDL_TTF_MAJOR_VERSION)
 		// Loads image from font string
 		bool loadFromRenderedText(std::string textureText, SDL_Color textColor);
@@ -76,6 +118,10 @@ class LTexture
 		// Set alpha modulation
 		void setAlpha(Uint8 alpha);
 
+        // points at a region of a texture owned by someone else (an atlas page)
+        // color, blend and alpha modulation then apply to the whole page, every image on it included
+        void setFromAtlas(SDL_Texture* texture, SDL_Rect region);
+
         // deallocates the texture
         void free();
 
@@ -90,11 +136,86 @@ class LTexture
         // the actual texture hardware
         SDL_Texture* mTexture;
 
+        // the part of mTexture that holds this image
+        SDL_Rect mRegion;
+
+        // false when mTexture belongs to an atlas
+        bool mOwnsTexture;
+
         // image dimensions
         int mWidth;
         int mHeight;
 };
 
+// ========================== Texture Atlas Class ==========================
+class LTextureAtlas
+{
+	public:
+		// initializes variables
+		LTextureAtlas();
+
+		// Deallocates memory
+		~LTextureAtlas();
+
+		// decodes an image to be packed, color keyed like LTexture::loadFromFile
+		bool addFile(std::string path);
+
+		// adds every .png and .bmp in a directory
+		bool addDirectory(std::string directory);
+
+		// packs the added images onto as few pages as fit and uploads them
+		bool build();
+
+		// points a texture at the region an added image was packed into,
+		// the page is shared so modulating the texture modulates every image on that page
+		bool bind(std::string path, LTexture& texture);
+
+		// atlas page count and their combined size in bytes
+		int getPageCount();
+		int getByteSize();
+
+		// deallocates every page
+		void free();
+
+	private:
+		// an image waiting to be packed, and where it went
+		struct Image
+		{
+			std::string path;
+			SDL_Surface* surface;
+			int page;
+			SDL_Rect region;
+		};
+
+		// a horizontal segment of a page's skyline
+		struct SkylineNode
+		{
+			int x;
+			int y;
+			int width;
+		};
+
+		// one page being packed
+		struct Page
+		{
+			std::vector<SkylineNode> skyline;
+			int usedHeight;
+		};
+
+		// bottom-left skyline placement, returns false when the page is full
+		bool insert(Page& page, int width, int height, SDL_Rect& region);
+
+		// largest page the renderer accepts, capped at ATLAS_PAGE_SIZE
+		int mPageSize;
+
+		std::vector<Image> mImages;
+		std::vector<SDL_Texture*> mTextures;
+		std::map<std::string, int> mLookup;
+
+		// bytes of every page texture
+		int mByteSize;
+};
+
 // ========================== Global Variables ==========================
 // The window we are going to render to
 SDL_Window* gWindow = NULL;
@@ -120,6 +241,13 @@ LTexture gButtonSpriteSheetTexture;
 SDL_Rect gButtonClips[TOTAL_BUTTONS];
 LButton gButtons[TOTAL_BUTTONS];
 
+// every image in media/, packed
+LTextureAtlas gMediaAtlas;
+
+// Texture last handed to the renderer and how often that changed, for measuring state switches
+SDL_Texture* gLastRenderedTexture = NULL;
+int gTextureSwitches = 0;
+
 // ========================== Button Wrapper Class Function Definitions ==========================
 LButton::LButton()
 {
@@ -201,10 +329,153 @@ void LButton::render()
 }
 
 // ========================== Texture Wrapper Class Function Definitions ==========================
+// The kernels clear every pixel of an ARGB8888 row whose color matches the key, alpha ignored the way SDL
+// compares it. Cleared pixels are transparent black, which reads the same straight or premultiplied.
+void keyRowScalar(Uint32* pixels, int width, Uint32 key)
+{
+	for (int x = 0; x < width; ++x)
+	{
+		if ((pixels[x] & 0x00FFFFFF) == key)
+		{
+			pixels[x] = 0;
+		}
+	}
+}
+
+#if KEY_X86
+__attribute__((target("sse2")))
+void keyRowSse2(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step: compare the color bits, then and the matches away
+	const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+	const __m128i keyColor = _mm_set1_epi32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		__m128i color = _mm_loadu_si128((const __m128i*)(pixels + x));
+		__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(color, colorMask), keyColor);
+		_mm_storeu_si128((__m128i*)(pixels + x), _mm_andnot_si128(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+
+__attribute__((target("avx2")))
+void keyRowAvx2(Uint32* pixels, int width, Uint32 key)
+{
+	// eight pixels a step
+	const __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+	const __m256i keyColor = _mm256_set1_epi32(key);
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		__m256i color = _mm256_loadu_si256((const __m256i*)(pixels + x));
+		__m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(color, colorMask), keyColor);
+		_mm256_storeu_si256((__m256i*)(pixels + x), _mm256_andnot_si256(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+#if KEY_NEON
+void keyRowNeon(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step, NEON is always there on AArch64
+	const uint32x4_t colorMask = vdupq_n_u32(0x00FFFFFF);
+	const uint32x4_t keyColor = vdupq_n_u32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		uint32x4_t color = vld1q_u32(pixels + x);
+		uint32x4_t keyed = vceqq_u32(vandq_u32(color, colorMask), keyColor);
+		vst1q_u32(pixels + x, vbicq_u32(color, keyed));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+SDL_Surface* LTexture::loadKeyedSurface(std::string path)
+{
+	SDL_Surface* loadedSurface = IMG_Load(path.c_str());
+	if (loadedSurface == NULL)
+	{
+		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		return NULL;
+	}
+
+	// one conversion to the format the kernels work on, which SDL would have done making the texture anyway
+	SDL_Surface* keyedSurface = SDL_ConvertSurfaceFormat(loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(loadedSurface);
+	if (keyedSurface == NULL)
+	{
+		printf("Unable to convert image %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+		return NULL;
+	}
+
+	// and one pass to key it
+	keySurface(keyedSurface, getBestKeySimd());
+	return keyedSurface;
+}
+
+void LTexture::keySurface(SDL_Surface* surface, LKeySimd simd)
+{
+	Uint32 key = SDL_MapRGB(surface->format, 0, 0xFF, 0xFF) & 0x00FFFFFF;
+	for (int y = 0; y < surface->h; ++y)
+	{
+		Uint32* row = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch);
+		switch (simd)
+		{
+			#if KEY_X86
+			case KEY_SIMD_AVX2: keyRowAvx2(row, surface->w, key); break;
+			case KEY_SIMD_SSE2: keyRowSse2(row, surface->w, key); break;
+			#endif
+			#if KEY_NEON
+			case KEY_SIMD_NEON: keyRowNeon(row, surface->w, key); break;
+			#endif
+			default: keyRowScalar(row, surface->w, key); break;
+		}
+	}
+
+	// converted RGB images start out unblended, and the keyed pixels only vanish when the texture blends
+	SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_BLEND);
+}
+
+LKeySimd LTexture::getBestKeySimd()
+{
+	#if KEY_X86
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return KEY_SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return KEY_SIMD_SSE2;
+	}
+	#elif KEY_NEON
+	return KEY_SIMD_NEON;
+	#endif
+	return KEY_SIMD_SCALAR;
+}
+
+const char* LTexture::getKeySimdName(LKeySimd simd)
+{
+	switch (simd)
+	{
+		case KEY_SIMD_AVX2: return "avx2";
+		case KEY_SIMD_SSE2: return "sse2";
+		case KEY_SIMD_NEON: return "neon";
+		default: return "scalar";
+	}
+}
+
 LTexture::LTexture()
 {
 	// initialize
 	mTexture = NULL;
+	mRegion.x = 0;
+	mRegion.y = 0;
+	mRegion.w = 0;
+	mRegion.h = 0;
+	mOwnsTexture = true;
 	mWidth = 0;
 	mHeight = 0;
 }
@@ -223,17 +494,14 @@ bool LTexture::loadFromFile(std::string path)
 	// create the texture
 	SDL_Texture* newTexture = NULL;
 
-	// first create a surface 
-	SDL_Surface* newSurface= IMG_Load(path.c_str());
+	// first create a surface, with the color key already turned into alpha
+	SDL_Surface* newSurface = loadKeyedSurface(path);
 	if (newSurface == NULL)
 	{
-		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		printf("Could not load image %s!\n", path.c_str()); 
 	}
 	else
 	{
-		// color key the image we load
-		SDL_SetColorKey(newSurface, SDL_TRUE, SDL_MapRGB(newSurface->format, 0, 0xFF, 0xFF));
-
 		// create texture from surface pixels
 		newTexture = SDL_CreateTextureFromSurface(gRenderer, newSurface);
 		if (newTexture == NULL) 
@@ -245,6 +513,8 @@ bool LTexture::loadFromFile(std::string path)
 			// get the image dimensions
 			mWidth = newSurface->w;
 			mHeight = newSurface->h;
+			mRegion.w = mWidth;
+			mRegion.h = mHeight;
 		}
 
 		// get rid of the surface that we loaded
@@ -282,6 +552,8 @@ bool LTexture::loadFromRenderedText(std::string textureText, SDL_Color textColor
 			// get the image dimensions
 			mWidth = textSurface->w;
 			mHeight = textSurface->h;
+			mRegion.w = mWidth;
+			mRegion.h = mHeight;
 		}
 
 		// get rid of the old surface
@@ -311,15 +583,38 @@ void LTexture::setAlpha(Uint8 alpha)
 	SDL_SetTextureAlphaMod(mTexture, alpha);
 }
 
+void LTexture::setFromAtlas(SDL_Texture* texture, SDL_Rect region)
+{
+	// let go of anything we had
+	free();
+
+	// the atlas keeps ownership, we only remember where we are
+	mTexture = texture;
+	mRegion = region;
+	mOwnsTexture = false;
+	mWidth = region.w;
+	mHeight = region.h;
+}
+
 void LTexture::free()
 {
 	// free the texture if it exists
 	if (mTexture != NULL)
 	{
-		SDL_DestroyTexture(mTexture);
+		// atlas pages are freed by the atlas
+		if (mOwnsTexture)
+		{
+			SDL_DestroyTexture(mTexture);
+			printf("Freed texture\n");
+		}
+		mTexture = NULL;
+		mRegion.x = 0;
+		mRegion.y = 0;
+		mRegion.w = 0;
+		mRegion.h = 0;
+		mOwnsTexture = true;
 		mWidth = 0;
 		mHeight = 0;
-		printf("Freed texture\n");
 	}
 }
 
@@ -328,15 +623,30 @@ void LTexture::render(int x, int y, SDL_Rect* clip, double angle, SDL_Point* cen
 	// set rendering space
 	SDL_Rect renderQuad = {x, y, mWidth, mHeight};
 
+	// the source is our region of the texture, or the clip within it
+	SDL_Rect source = mRegion;
+
 	// Set clip rendering dimensions
 	if (clip != NULL)
 	{
 		renderQuad.w = clip->w;
 		renderQuad.h = clip->h;
+
+		source.x += clip->x;
+		source.y += clip->y;
+		source.w = clip->w;
+		source.h = clip->h;
+	}
+
+	// count every time the renderer has to switch textures
+	if (mTexture != gLastRenderedTexture)
+	{
+		++gTextureSwitches;
+		gLastRenderedTexture = mTexture;
 	}
 
 	// render to screen
-	SDL_RenderCopyEx(gRenderer, mTexture, clip, &renderQuad, angle, center, flip);
+	SDL_RenderCopyEx(gRenderer, mTexture, &source, &renderQuad, angle, center, flip);
 }
 
 int LTexture::getWidth()
@@ -349,6 +659,329 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
+// ========================== Texture Atlas Class Function Definitions ==========================
+LTextureAtlas::LTextureAtlas()
+{
+	// initialize
+	mPageSize = ATLAS_PAGE_SIZE;
+	mByteSize = 0;
+}
+
+LTextureAtlas::~LTextureAtlas()
+{
+	// deallocate
+	free();
+}
+
+bool LTextureAtlas::addFile(std::string path)
+{
+	// first create a surface, color keyed like every other texture
+	SDL_Surface* surface = LTexture::loadKeyedSurface(path);
+	if (surface == NULL)
+	{
+		printf("Could not load image %s!\n", path.c_str());
+		return false;
+	}
+
+	// the pages start out transparent, so the pixels are copied as they are rather than blended on
+	SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+
+	Image image;
+	image.path = path;
+	image.surface = surface;
+	image.page = -1;
+	image.region.x = 0;
+	image.region.y = 0;
+	image.region.w = surface->w;
+	image.region.h = surface->h;
+	mImages.push_back(image);
+
+	return true;
+}
+
+bool LTextureAtlas::addDirectory(std::string directory)
+{
+	DIR* dir = opendir(directory.c_str());
+	if (dir == NULL)
+	{
+		printf("Could not open directory %s!\n", directory.c_str());
+		return false;
+	}
+
+	// sorted so the packing comes out the same on every run
+	std::vector<std::string> names;
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		std::string name = entry->d_name;
+		if (name.size() > 4 && (name.compare(name.size() - 4, 4, ".png") == 0 || name.compare(name.size() - 4, 4, ".bmp") == 0))
+		{
+			names.push_back(name);
+		}
+	}
+	closedir(dir);
+	std::sort(names.begin(), names.end());
+
+	bool success = true;
+	for (int i = 0; i < (int)names.size(); ++i)
+	{
+		if (!addFile(directory + "/" + names[i]))
+		{
+			success = false;
+		}
+	}
+
+	return success;
+}
+
+bool LTextureAtlas::insert(Page& page, int width, int height, SDL_Rect& region)
+{
+	// find the spot that leaves the skyline lowest, ties go to the narrowest segment
+	int bestIndex = -1;
+	int bestY = mPageSize;
+	int bestWidth = mPageSize;
+	for (int i = 0; i < (int)page.skyline.size(); ++i)
+	{
+		int x = page.skyline[i].x;
+		if (x + width > mPageSize)
+		{
+			break;
+		}
+
+		// the rect rests on the highest segment it spans
+		int y = 0;
+		int remaining = width;
+		for (int j = i; remaining > 0; ++j)
+		{
+			y = std::max(y, page.skyline[j].y);
+			remaining -= page.skyline[j].width;
+		}
+
+		if (y + height <= mPageSize && (y < bestY || (y == bestY && page.skyline[i].width < bestWidth)))
+		{
+			bestIndex = i;
+			bestY = y;
+			bestWidth = page.skyline[i].width;
+		}
+	}
+
+	// page is full
+	if (bestIndex < 0)
+	{
+		return false;
+	}
+
+	region.x = page.skyline[bestIndex].x;
+	region.y = bestY;
+	region.w = width;
+	region.h = height;
+
+	// raise the skyline under the new rect
+	SkylineNode node = {region.x, bestY + height, width};
+	page.skyline.insert(page.skyline.begin() + bestIndex, node);
+
+	// trim the segments it now covers
+	for (int i = bestIndex + 1; i < (int)page.skyline.size(); )
+	{
+		SkylineNode& current = page.skyline[i];
+		int covered = node.x + node.width - current.x;
+		if (covered <= 0)
+		{
+			break;
+		}
+		if (covered < current.width)
+		{
+			current.x += covered;
+			current.width -= covered;
+			break;
+		}
+		page.skyline.erase(page.skyline.begin() + i);
+	}
+
+	// merge neighbours at the same height
+	for (int i = 0; i + 1 < (int)page.skyline.size(); )
+	{
+		if (page.skyline[i].y == page.skyline[i + 1].y)
+		{
+			page.skyline[i].width += page.skyline[i + 1].width;
+			page.skyline.erase(page.skyline.begin() + i + 1);
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	page.usedHeight = std::max(page.usedHeight, bestY + height);
+	return true;
+}
+
+bool LTextureAtlas::build()
+{
+	// never make a page the renderer can't hold
+	SDL_RendererInfo info;
+	mPageSize = ATLAS_PAGE_SIZE;
+	if (SDL_GetRendererInfo(gRenderer, &info) == 0)
+	{
+		if (info.max_texture_width > 0 && info.max_texture_width < mPageSize)
+		{
+			mPageSize = info.max_texture_width;
+		}
+		if (info.max_texture_height > 0 && info.max_texture_height < mPageSize)
+		{
+			mPageSize = info.max_texture_height;
+		}
+	}
+
+	// tallest images first pack tightest
+	std::vector<int> order(mImages.size());
+	for (int i = 0; i < (int)order.size(); ++i)
+	{
+		order[i] = i;
+	}
+	for (int i = 1; i < (int)order.size(); ++i)
+	{
+		for (int j = i; j > 0 && mImages[order[j]].region.h > mImages[order[j - 1]].region.h; --j)
+		{
+			std::swap(order[j], order[j - 1]);
+		}
+	}
+
+	// place every image on the first page with room, opening pages as needed
+	std::vector<Page> pages;
+	bool success = true;
+	for (int i = 0; i < (int)order.size(); ++i)
+	{
+		Image& image = mImages[order[i]];
+		int width = image.surface->w + ATLAS_PADDING;
+		int height = image.surface->h + ATLAS_PADDING;
+		if (width > mPageSize || height > mPageSize)
+		{
+			printf("%s is too big for a %dx%d atlas page!\n", image.path.c_str(), mPageSize, mPageSize);
+			success = false;
+			continue;
+		}
+
+		SDL_Rect region;
+		for (int p = 0; p <= (int)pages.size() && image.page < 0; ++p)
+		{
+			if (p == (int)pages.size())
+			{
+				Page page;
+				SkylineNode ground = {0, 0, mPageSize};
+				page.skyline.push_back(ground);
+				page.usedHeight = 0;
+				pages.push_back(page);
+			}
+
+			if (insert(pages[p], width, height, region))
+			{
+				image.page = p;
+				image.region.x = region.x;
+				image.region.y = region.y;
+			}
+		}
+	}
+
+	// draw each page's images into a transparent surface only as tall as it needs and upload it
+	for (int p = 0; p < (int)pages.size(); ++p)
+	{
+		SDL_Surface* pageSurface = SDL_CreateRGBSurfaceWithFormat(0, mPageSize, pages[p].usedHeight, 32, SDL_PIXELFORMAT_RGBA32);
+		if (pageSurface == NULL)
+		{
+			printf("Unable to create atlas page! SDL Error: %s\n", SDL_GetError());
+			success = false;
+			mTextures.push_back(NULL);
+			continue;
+		}
+		SDL_FillRect(pageSurface, NULL, 0);
+
+		for (int i = 0; i < (int)mImages.size(); ++i)
+		{
+			if (mImages[i].page == p)
+			{
+				// keyed pixels are skipped and stay transparent
+				SDL_Rect destination = mImages[i].region;
+				SDL_BlitSurface(mImages[i].surface, NULL, pageSurface, &destination);
+			}
+		}
+
+		SDL_Texture* texture = SDL_CreateTextureFromSurface(gRenderer, pageSurface);
+		if (texture == NULL)
+		{
+			printf("Unable to create atlas page texture! SDL Error: %s\n", SDL_GetError());
+			success = false;
+		}
+		else
+		{
+			SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+			mByteSize += pageSurface->w * pageSurface->h * 4;
+		}
+		mTextures.push_back(texture);
+
+		SDL_FreeSurface(pageSurface);
+	}
+
+	// the pages hold the pixels now
+	for (int i = 0; i < (int)mImages.size(); ++i)
+	{
+		SDL_FreeSurface(mImages[i].surface);
+		mImages[i].surface = NULL;
+		mLookup[mImages[i].path] = i;
+	}
+
+	return success;
+}
+
+bool LTextureAtlas::bind(std::string path, LTexture& texture)
+{
+	std::map<std::string, int>::iterator found = mLookup.find(path);
+	if (found == mLookup.end() || mImages[found->second].page < 0 || mTextures[mImages[found->second].page] == NULL)
+	{
+		printf("%s is not in the atlas!\n", path.c_str());
+		return false;
+	}
+
+	Image& image = mImages[found->second];
+	texture.setFromAtlas(mTextures[image.page], image.region);
+	return true;
+}
+
+int LTextureAtlas::getPageCount()
+{
+	return mTextures.size();
+}
+
+int LTextureAtlas::getByteSize()
+{
+	return mByteSize;
+}
+
+void LTextureAtlas::free()
+{
+	// free the pages
+	for (int i = 0; i < (int)mTextures.size(); ++i)
+	{
+		if (mTextures[i] != NULL)
+		{
+			SDL_DestroyTexture(mTextures[i]);
+		}
+	}
+	mTextures.clear();
+
+	// free images that were never packed
+	for (int i = 0; i < (int)mImages.size(); ++i)
+	{
+		if (mImages[i].surface != NULL)
+		{
+			SDL_FreeSurface(mImages[i].surface);
+		}
+	}
+	mImages.clear();
+	mLookup.clear();
+	mByteSize = 0;
+}
+
 // ========================== Function Delcarations ==========================
 // loads up SDL and creates window
 bool init();
@@ -362,6 +995,9 @@ void close();
 // Loads individual image
 SDL_Texture* loadTexture(std::string path);
 
+// Compares separate textures against the atlas: texture count, bytes and texture switches per frame
+void reportAtlasSavings();
+
 // ========================== Function Definitions ==========================
 bool init()
 {
@@ -443,28 +1079,35 @@ bool loadMedia()
 	}
 	#endif
 
-	// load key press textures
-	if (!gUpTexture.loadFromFile("media/up.png"))
+	// pack every image in media into as few textures as possible
+	if (!gMediaAtlas.addDirectory("media") || !gMediaAtlas.build())
+	{
+		printf("Failed to build media atlas!\n");
+		success = false;
+	}
+
+	// load key press textures out of the atlas
+	if (!gMediaAtlas.bind("media/up.png", gUpTexture))
 	{
 		printf("Failed to load up texture!\n");
 		success = false;
 	}
-	if (!gDownTexture.loadFromFile("media/down.png"))
+	if (!gMediaAtlas.bind("media/down.png", gDownTexture))
 	{
 		printf("Failed to load down texture!\n");
 		success = false;
 	}
-	if (!gRightTexture.loadFromFile("media/right.png"))
+	if (!gMediaAtlas.bind("media/right.png", gRightTexture))
 	{
 		printf("Failed to load right texture!\n");
 		success = false;
 	}
-	if (!gLeftTexture.loadFromFile("media/left.png"))
+	if (!gMediaAtlas.bind("media/left.png", gLeftTexture))
 	{
 		printf("Failed to load left texture!\n");
 		success = false;
 	}
-	if (!gPressTexture.loadFromFile("media/press.png"))
+	if (!gMediaAtlas.bind("media/press.png", gPressTexture))
 	{
 		printf("Failed to load press texture!\n");
 		success = false;
@@ -478,6 +1121,12 @@ void close()
 	// you might think we have to free the textures that we declared as globals, but actually
 	// they go out of scope and the destructor is automatically called, which is dope
 	gTextTexture.free();
+	gUpTexture.free();
+	gDownTexture.free();
+	gRightTexture.free();
+	gLeftTexture.free();
+	gPressTexture.free();
+	gMediaAtlas.free();
 
 	// Free the global font
 	TTF_CloseFont(gFont);
@@ -507,6 +1156,45 @@ SDL_Texture* loadTexture(std::string path)
 	return newTexture;
 }
 
+void reportAtlasSavings()
+{
+	const char* paths[5] = {"media/up.png", "media/down.png", "media/left.png", "media/right.png", "media/press.png"};
+
+	// the same five images as separate textures
+	LTexture separate[5];
+	int separateBytes = 0;
+	for (int i = 0; i < 5; ++i)
+	{
+		separate[i].loadFromFile(paths[i]);
+		separateBytes += separate[i].getWidth() * separate[i].getHeight() * 4;
+	}
+
+	// a frame that draws every image twice, the way a HUD cycling through them would
+	gLastRenderedTexture = NULL;
+	gTextureSwitches = 0;
+	for (int i = 0; i < 10; ++i)
+	{
+		separate[i % 5].render(0, 0);
+	}
+	int separateSwitches = gTextureSwitches;
+
+	// and out of the atlas
+	gLastRenderedTexture = NULL;
+	gTextureSwitches = 0;
+	LTexture* atlased[5] = {&gUpTexture, &gDownTexture, &gLeftTexture, &gRightTexture, &gPressTexture};
+	for (int i = 0; i < 10; ++i)
+	{
+		atlased[i % 5]->render(0, 0);
+	}
+	int atlasSwitches = gTextureSwitches;
+
+	printf("separate: %d textures, %d bytes, %d texture switches/frame\n", 5, separateBytes, separateSwitches);
+	printf("atlas:    %d textures, %d bytes, %d texture switches/frame\n", gMediaAtlas.getPageCount(), gMediaAtlas.getByteSize(), atlasSwitches);
+
+	// throw the test frame away
+	SDL_RenderClear(gRenderer);
+}
+
 int main( int argc, char* args[])
 { 
  	// start up SDL and create the window
@@ -521,6 +1209,12 @@ int main( int argc, char* args[])
 		{
 			printf("Failed to load media!\n");
 		}
+		else if (argc > 1 && strcmp(args[1], "--atlas-report") == 0)
+		{
+			reportAtlasSavings();
+			close();
+			return 0;
+		}
 		
 		// main loop
 		bool quit = false;
@@ -5,7 +5,37 @@
 #include <SDL2/SDL_mixer.h>
 #include <stdio.h>
 #include <string>
+#include <string.h>
+#include <stdlib.h>
 #include <cmath>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <errno.h>
+
+// the mixer's and the color key kernel's SSE2/AVX2 paths are x86 only, everything else uses the scalar code
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MIXER_X86 1
+#define KEY_X86 1
+#else
+#define MIXER_X86 0
+#define KEY_X86 0
+#endif
+
+// the color key kernel also has a NEON path, always there on AArch64
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define KEY_NEON 1
+#else
+#define KEY_NEON 0
+#endif
 
 // ========================== Constants and Enums ==========================
 // screen constants
@@ -17,6 +47,51 @@ const int BUTTON_WIDTH = 300;
 const int BUTTON_HEIGHT = 200;
 const int TOTAL_BUTTONS = 4;
 
+// Startup benchmark constants
+const int LOAD_BENCH_COPIES = 500;
+
+// Pack file constants
+const char PACK_MAGIC[4] = {'L', 'P', 'A', 'K'};
+const Uint32 PACK_VERSION = 1;
+const int PACK_NAME_LENGTH = 48;
+const int PACK_ALIGNMENT = 64;
+const char* PACK_FILE = "media.pak";
+const int PACK_BENCH_ROUNDS = 20;
+
+// Texture cache constants, an entry is the header and then width * height ARGB8888 pixels
+const char TEXTURE_CACHE_MAGIC[4] = {'L', 'T', 'E', 'X'};
+const Uint32 TEXTURE_CACHE_VERSION = 2;
+const char* TEXTURE_CACHE_DIR = "texture_cache";
+const int TEXTURE_CACHE_BENCH_ROUNDS = 50;
+const int TEXTURE_CACHE_BENCH_WIDTH = 1920;
+const int TEXTURE_CACHE_BENCH_HEIGHT = 1080;
+
+// Audio device constants, all overridable from the command line
+const int AUDIO_DEFAULT_RATE = 44100;
+const int AUDIO_DEFAULT_BUFFER = 2048;
+
+// Latency benchmark constants
+const int LATENCY_BENCH_PRESSES = 300;
+const int LATENCY_FRAME_MS = 16;
+
+// Mixer constants
+const int MIXER_DEFAULT_VOICES = 64;
+const int MIXER_COMMAND_QUEUE = 1024;
+const int MIXER_MAX_FRAMES = 1024;
+const int MIXER_BENCH_VOICES = 256;
+const int MIXER_BENCH_FRAMES = 1024;
+const int MIXER_BENCH_BUFFERS = 500;
+const int MIXER_DEFAULT_INSTANCES = 8;
+const float MIXER_CULL_GAIN = 0.001f;
+const float MIXER_REFERENCE_DISTANCE = 64.f;
+const int MIXER_BURST_TRIGGERS = 200;
+const int MIXER_LATENCY_QUEUE = 256;
+
+// Music stream constants, the ring holds about a third of a second at 44.1kHz F32 stereo
+const int MUSIC_RING_BYTES = 128 * 1024;
+const int MUSIC_FILE_BLOCK = 4096;
+const int MUSIC_DECODE_INTERVAL = 5;
+
 enum LButtonSprite
 {
 	BUTTON_SPRITE_MOUSE_OUT,
@@ -26,6 +101,15 @@ enum LButtonSprite
 	BUTTON_SPRITE_TOTAL
 };
 
+// the color key kernel code paths, best one picked at runtime
+enum LKeySimd
+{
+	KEY_SIMD_SCALAR,
+	KEY_SIMD_SSE2,
+	KEY_SIMD_AVX2,
+	KEY_SIMD_NEON
+};
+
 // ========================== Button Wrapper Class ==========================
 class LButton
 {
@@ -63,6 +147,17 @@ class LTexture
         // Loads image at specified path
         bool loadFromFile(std::string path);
 
+        // Makes every color key pixel of an ARGB8888 surface transparent black in place, and has it blend
+        static void keySurface(SDL_Surface* surface, LKeySimd simd);
+
+        // the color key code paths
+        static LKeySimd getBestKeySimd();
+        static const char* getKeySimdName(LKeySimd simd);
+
+        // Creates the texture from an already decoded image, the surface stays with the caller;
+        // colorKey is false for surfaces from the texture cache, which has already keyed them
+        bool loadFromSurface(SDL_Surface* surface, bool colorKey = true);
+
 		#if defined(SDL_TTF_MAJOR_VERSION)
 		// Loads image from font string
 		bool loadFromRenderedText(std::string textureText, SDL_Color textColor);
@@ -96,6 +191,481 @@ class LTexture
         int mHeight;
 };
 
+// ========================== Async Loader Class ==========================
+class LAsyncLoader
+{
+	public:
+		// initializes variables
+		LAsyncLoader();
+
+		// Stops the workers and deallocates memory
+		~LAsyncLoader();
+
+		// starts the decode workers, one per CPU when workers is 0
+		bool start(int workers = 0);
+
+		// finishes queued work and joins the workers
+		void stop();
+
+		// queues a decode, the texture is created on this thread by pump() or wait(); returns a handle
+		int loadTexture(std::string path, LTexture* texture);
+		int loadSound(std::string path, Mix_Chunk** chunk);
+
+		// finishes every decode that is ready without blocking, returns how many
+		int pump();
+
+		// polls a handle
+		bool isDone(int handle);
+
+		// blocks until a handle (or everything) is finished, returns whether it loaded
+		bool wait(int handle);
+		bool waitAll();
+
+		// loads queued but not yet finished
+		int getPendingCount();
+
+	private:
+		enum RequestType
+		{
+			REQUEST_TEXTURE,
+			REQUEST_SOUND
+		};
+
+		// one asset on its way from disk to its owner
+		struct Request
+		{
+			RequestType type;
+			std::string path;
+
+			// decoded on a worker
+			SDL_Surface* surface;
+			Mix_Chunk* chunk;
+
+			// where the result goes once finished
+			LTexture* texture;
+			Mix_Chunk** chunkTarget;
+
+			bool done;
+			bool success;
+		};
+
+		// worker thread entry point
+		static int workerMain(void* data);
+
+		// the decode half, safe to run on any thread
+		static void decode(Request* request);
+
+		// the upload half, render thread only
+		void finish(Request* request);
+
+		// hands a request to the workers (or decodes it right away without any)
+		int queue(Request* request);
+
+		// every request so far, indexed by handle
+		std::vector<Request*> mRequests;
+
+		// waiting for a worker, and decoded waiting for the render thread
+		std::deque<Request*> mWork;
+		std::deque<Request*> mCompleted;
+
+		// guards both queues and mQuit
+		SDL_mutex* mMutex;
+		SDL_cond* mWorkReady;
+		SDL_cond* mCompletedReady;
+
+		std::vector<SDL_Thread*> mThreads;
+		bool mQuit;
+
+		// requests not finished yet (render thread only)
+		int mPending;
+};
+
+// ========================== Pack File Class ==========================
+// pack layout: the header, then the index sorted by name, then every payload starting on a PACK_ALIGNMENT boundary
+struct LPackHeader
+{
+	char magic[4];
+	Uint32 version;
+	Uint32 count;
+	Uint32 alignment;
+};
+
+struct LPackEntry
+{
+	// the path the game opens it by, e.g. media/prompt.png
+	char name[PACK_NAME_LENGTH];
+
+	// from the start of the file
+	Uint64 offset;
+	Uint64 size;
+};
+
+class LPackFile
+{
+	public:
+		// initializes variables
+		LPackFile();
+
+		// unmaps the pack
+		~LPackFile();
+
+		// maps a pack built by build() read only
+		bool open(std::string path);
+		void close();
+		bool isOpen();
+
+		// returns a stream for an asset, read straight out of the mapping when it is packed and from disk otherwise
+		SDL_RWops* openAsset(std::string path);
+
+		// assets in the pack
+		int getCount();
+
+		// packs every file in a directory, naming them directory/file
+		static bool build(std::string directory, std::string path);
+
+	private:
+		// binary search of the index
+		const LPackEntry* find(const char* name);
+
+		// the mapping and the views into it
+		Uint8* mData;
+		size_t mSize;
+		const LPackHeader* mHeader;
+		const LPackEntry* mEntries;
+};
+
+// ========================== Texture Cache Class ==========================
+// entry layout: this header, then the pixels row after row with no padding
+struct LTextureCacheHeader
+{
+	char magic[4];
+	Uint32 version;
+
+	// the source file the pixels came from, checked again on a hit
+	Uint64 sourceHash;
+	Uint64 sourceSize;
+
+	Uint32 width;
+	Uint32 height;
+	Uint32 format;
+	Uint32 reserved;
+};
+
+class LTextureCache
+{
+	public:
+		// initializes variables
+		LTextureCache();
+
+		// keeps entries in directory, creating it if it's missing; until then nothing is read or written
+		bool open(std::string directory);
+		void close();
+		bool isOpen();
+
+		// decodes an image to ARGB8888 with the cyan color key pixels already transparent, straight from the
+		// cache when the source hasn't changed; safe to call on any thread, the caller frees the surface
+		SDL_Surface* load(std::string path);
+
+		// deletes every entry
+		void clear();
+
+		// hits, misses and entries written so far
+		void printStats();
+
+	private:
+		// FNV-1a over the whole source file
+		static Uint64 hash(const Uint8* data, size_t size);
+
+		// where the entry for a source with this hash lives
+		std::string getEntryPath(Uint64 sourceHash);
+
+		// reads an entry back, NULL if it's missing or doesn't belong to this source
+		SDL_Surface* readEntry(std::string entryPath, Uint64 sourceHash, Uint64 sourceSize);
+
+		// writes through a temporary file so a half written entry is never picked up
+		bool writeEntry(std::string entryPath, Uint64 sourceHash, Uint64 sourceSize, SDL_Surface* surface);
+
+		// empty while the cache is closed
+		std::string mDirectory;
+
+		SDL_atomic_t mHits;
+		SDL_atomic_t mMisses;
+		SDL_atomic_t mWrites;
+};
+
+// ========================== Music Stream Class ==========================
+enum LMusicState
+{
+	MUSIC_STOPPED,
+	MUSIC_PLAYING,
+	MUSIC_PAUSED
+};
+
+// a stop's trip through the threads: the game asks, the decoder rewinds the file, the audio thread drops the stale ring
+enum LMusicRewind
+{
+	MUSIC_REWIND_NONE,
+	MUSIC_REWIND_REQUESTED,
+	MUSIC_REWIND_DECODED
+};
+
+class LMusicStream
+{
+	public:
+		// initializes internal variables
+		LMusicStream();
+
+		// stops the decode thread
+		~LMusicStream();
+
+		// opens a WAV and starts decoding it into the ring, converted to the output format as it goes
+		bool open(std::string path, int frequency, Uint16 format);
+		void close();
+
+		// game thread controls, play starts over after a stop and picks up after a pause; the track loops
+		void play();
+		void pause();
+		void stop();
+		LMusicState getState();
+
+		// audio thread: copies up to frames of decoded stereo out of the ring, returns how many (an underrun if short)
+		int read(Uint8* buffer, int frames);
+
+		// whether the decoded samples are F32 or S16
+		bool isFloat();
+
+		// metrics, the decoded byte count belongs to the decode thread so read it after close()
+		int getUnderruns();
+		int getBufferedMs();
+		Sint64 getDecodedBytes();
+		void printStats();
+
+	private:
+		// decode thread entry point
+		static int decodeMain(void* data);
+
+		// finds the format and sample data of the WAV
+		bool readHeader(SDL_AudioFormat* format, int* channels, int* frequency);
+
+		// converts file data into the ring until it's full, false if the file can't be read
+		bool fill();
+
+		// the file and where its samples are
+		SDL_RWops* mFile;
+		Sint64 mDataStart;
+		Sint64 mDataSize;
+		Sint64 mDataRead;
+
+		// source format to output format
+		SDL_AudioStream* mConverter;
+		std::vector<Uint8> mFileBlock;
+
+		// output format
+		Uint16 mFormat;
+		int mFrequency;
+		int mFrameBytes;
+
+		// decoded output, the decode thread moves the head and the audio thread the tail
+		std::vector<Uint8> mRing;
+		SDL_atomic_t mHead;
+		SDL_atomic_t mTail;
+
+		// playback state, and how far the last stop has got (an LMusicRewind)
+		SDL_atomic_t mState;
+		SDL_atomic_t mRewind;
+
+		SDL_Thread* mThread;
+		SDL_atomic_t mQuit;
+
+		SDL_atomic_t mUnderruns;
+		Sint64 mDecodedBytes;
+};
+
+// ========================== Mixer Class ==========================
+// a sound the mixer can play, interleaved stereo in either the device's S16 or F32
+struct LSound
+{
+	const void* samples;
+	bool isFloat;
+	int frames;
+
+	// most voices it can play on at once, 0 for no limit
+	int maxInstances;
+};
+
+// the mixing code paths, best one picked at runtime
+enum LMixerSimd
+{
+	MIXER_SIMD_SCALAR,
+	MIXER_SIMD_SSE2,
+	MIXER_SIMD_AVX2,
+	MIXER_SIMD_TOTAL
+};
+
+// when a timed play was triggered and when the callback that started it ran, in performance counter ticks
+struct LLatencySample
+{
+	Uint64 triggered;
+	Uint64 callback;
+	int callbackFrames;
+};
+
+// which voice gives way when they're all busy, always the lowest priority first
+enum LMixerSteal
+{
+	MIXER_STEAL_OLDEST,
+	MIXER_STEAL_QUIETEST
+};
+
+class LMixer
+{
+	public:
+		// initializes internal variables
+		LMixer();
+
+		// unhooks from SDL_mixer
+		~LMixer();
+
+		// mixes a fixed pool of voices and the music on top of SDL_mixer's output
+		bool open(int voices = MIXER_DEFAULT_VOICES);
+		void close();
+
+		// sets up the voices for an output format without hooking into the device, for mixing offline
+		bool configure(int voices, int frequency, Uint16 format);
+
+		// wraps a chunk SDL_mixer loaded (already converted to the device format), the chunk has to outlive its voices
+		LSound wrapChunk(Mix_Chunk* chunk);
+
+		// queues commands for the audio thread, game thread only, never blocks; false if the queue is full or the sound is culled
+		// higher priorities steal voices from lower ones, sounds quieter than MIXER_CULL_GAIN are never queued
+		// give it the performance counter at the trigger to get a latency sample back once the voice starts
+		bool play(const LSound* sound, float gain = 1.f, float pan = 0.f, int priority = 0, Uint64 triggered = 0);
+		bool stopAll();
+
+		// streamed music mixed under the voices, set before open and keep it open until close
+		void setMusic(LMusicStream* music);
+
+		// mixes the voices into a buffer of output, what the audio callback runs
+		void mix(Uint8* stream, int bytes);
+
+		// the code path mix() uses, lowered for the benchmark
+		LMixerSimd getSimd();
+		void setSimd(LMixerSimd simd);
+		static LMixerSimd getBestSimd();
+		static const char* getSimdName(LMixerSimd simd);
+
+		// which voice a sound takes over when none are free or it's at its instance cap
+		LMixerSteal getStealPolicy();
+		void setStealPolicy(LMixerSteal policy);
+
+		// falloff for a sound some distance from the listener, multiply it into the gain
+		static float getDistanceGain(float distance);
+
+		// voices playing as of the last callback, and commands dropped on a full queue
+		int getActiveVoices();
+		int getDroppedCommands();
+
+		// sounds that got a voice, voices taken over, and sounds too quiet or outranked to play
+		int getPlayedVoices();
+		int getStolenVoices();
+		int getCulledVoices();
+		void printStats();
+
+		// takes the next latency sample off the queue, game thread only
+		bool popLatency(LLatencySample* sample);
+
+		// frames in the last callback, what the device actually asked for
+		int getCallbackFrames();
+
+	private:
+		// one playing sound, gains already include the pan and the sample scale
+		struct Voice
+		{
+			const LSound* sound;
+			int position;
+			float gainLeft;
+			float gainRight;
+			bool active;
+
+			// what stealing goes by
+			int priority;
+			Uint32 started;
+		};
+
+		enum CommandType
+		{
+			COMMAND_PLAY,
+			COMMAND_STOP_ALL
+		};
+
+		struct Command
+		{
+			CommandType type;
+			const LSound* sound;
+			float gainLeft;
+			float gainRight;
+			int priority;
+			Uint64 triggered;
+		};
+
+		// SDL_mixer post mix hook
+		static void postMix(void* data, Uint8* stream, int bytes);
+
+		// single producer single consumer, the game thread pushes and the audio thread pops
+		bool pushCommand(const Command& command);
+		void runCommands();
+
+		// starts a sound on a free voice, or takes one over, audio thread only
+		void startVoice(const Command& command);
+
+		// whether voice a should give way before voice b
+		bool isBetterVictim(const Voice& a, const Voice& b);
+
+		// adds one voice's next frames to the accumulator
+		void mixVoice(Voice& voice, float* accumulator, int frames);
+
+		// adds interleaved stereo to the accumulator with the current code path
+		void mixStereo(float* accumulator, const void* samples, bool isFloat, int frames, float gainLeft, float gainRight);
+
+		// writes the accumulator on top of the output
+		void writeOutput(Uint8* stream, int frames);
+
+		// output format
+		int mFrequency;
+		Uint16 mFormat;
+		bool mHooked;
+
+		std::vector<Voice> mVoices;
+		std::vector<float> mAccumulator;
+		LMixerSimd mSimd;
+		LMixerSteal mStealPolicy;
+
+		// counts up with every voice started, audio thread only
+		Uint32 mStartCount;
+
+		// latency samples going the other way, from the audio thread to the game
+		LLatencySample mLatency[MIXER_LATENCY_QUEUE];
+		SDL_atomic_t mLatencyHead;
+		SDL_atomic_t mLatencyTail;
+		Uint64 mCallbackStart;
+		SDL_atomic_t mCallbackFrames;
+
+		// music is read out of its ring into here before it's mixed
+		LMusicStream* mMusic;
+		std::vector<Uint8> mMusicBuffer;
+
+		// command ring, the indices only ever grow and wrap through the mask
+		Command mCommands[MIXER_COMMAND_QUEUE];
+		SDL_atomic_t mCommandHead;
+		SDL_atomic_t mCommandTail;
+
+		SDL_atomic_t mActiveVoices;
+		SDL_atomic_t mDroppedCommands;
+		SDL_atomic_t mPlayedVoices;
+		SDL_atomic_t mStolenVoices;
+		SDL_atomic_t mCulledVoices;
+};
+
 // ========================== Global Variables ==========================
 // The window we are going to render to
 SDL_Window* gWindow = NULL;
@@ -112,8 +682,14 @@ LTexture gTextTexture;
 // rendered texture
 LTexture gPromptTexture;
 
-// Music stuff
-Mix_Music* gMusic = NULL; 
+// Every asset is opened through here
+LPackFile gPack;
+
+// Decoded and keyed images from earlier runs
+LTextureCache gTextureCache;
+
+// Music stuff, streamed from the pack instead of decoded up front
+LMusicStream gMusic;
 
 // The sound effect that will be used
 Mix_Chunk* gScratch = NULL;
@@ -121,6 +697,13 @@ Mix_Chunk* gHigh = NULL;
 Mix_Chunk* gMedium = NULL;
 Mix_Chunk* gLow = NULL;
 
+// Mixes the sound effects on top of the music
+LMixer gMixer;
+LSound gScratchSound;
+LSound gHighSound;
+LSound gMediumSound;
+LSound gLowSound;
+
 // ========================== Button Wrapper Class Function Definitions ==========================
 LButton::LButton()
 {
@@ -202,6 +785,121 @@ void LButton::render()
 }
 
 // ========================== Texture Wrapper Class Function Definitions ==========================
+// The kernels clear every pixel of an ARGB8888 row whose color matches the key, alpha ignored the way SDL
+// compares it. Cleared pixels are transparent black, which reads the same straight or premultiplied.
+void keyRowScalar(Uint32* pixels, int width, Uint32 key)
+{
+	for (int x = 0; x < width; ++x)
+	{
+		if ((pixels[x] & 0x00FFFFFF) == key)
+		{
+			pixels[x] = 0;
+		}
+	}
+}
+
+#if KEY_X86
+__attribute__((target("sse2")))
+void keyRowSse2(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step: compare the color bits, then and the matches away
+	const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+	const __m128i keyColor = _mm_set1_epi32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		__m128i color = _mm_loadu_si128((const __m128i*)(pixels + x));
+		__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(color, colorMask), keyColor);
+		_mm_storeu_si128((__m128i*)(pixels + x), _mm_andnot_si128(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+
+__attribute__((target("avx2")))
+void keyRowAvx2(Uint32* pixels, int width, Uint32 key)
+{
+	// eight pixels a step
+	const __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+	const __m256i keyColor = _mm256_set1_epi32(key);
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		__m256i color = _mm256_loadu_si256((const __m256i*)(pixels + x));
+		__m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(color, colorMask), keyColor);
+		_mm256_storeu_si256((__m256i*)(pixels + x), _mm256_andnot_si256(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+#if KEY_NEON
+void keyRowNeon(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step, NEON is always there on AArch64
+	const uint32x4_t colorMask = vdupq_n_u32(0x00FFFFFF);
+	const uint32x4_t keyColor = vdupq_n_u32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		uint32x4_t color = vld1q_u32(pixels + x);
+		uint32x4_t keyed = vceqq_u32(vandq_u32(color, colorMask), keyColor);
+		vst1q_u32(pixels + x, vbicq_u32(color, keyed));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+void LTexture::keySurface(SDL_Surface* surface, LKeySimd simd)
+{
+	Uint32 key = SDL_MapRGB(surface->format, 0, 0xFF, 0xFF) & 0x00FFFFFF;
+	for (int y = 0; y < surface->h; ++y)
+	{
+		Uint32* row = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch);
+		switch (simd)
+		{
+			#if KEY_X86
+			case KEY_SIMD_AVX2: keyRowAvx2(row, surface->w, key); break;
+			case KEY_SIMD_SSE2: keyRowSse2(row, surface->w, key); break;
+			#endif
+			#if KEY_NEON
+			case KEY_SIMD_NEON: keyRowNeon(row, surface->w, key); break;
+			#endif
+			default: keyRowScalar(row, surface->w, key); break;
+		}
+	}
+
+	// converted RGB images start out unblended, and the keyed pixels only vanish when the texture blends
+	SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_BLEND);
+}
+
+LKeySimd LTexture::getBestKeySimd()
+{
+	#if KEY_X86
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return KEY_SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return KEY_SIMD_SSE2;
+	}
+	#elif KEY_NEON
+	return KEY_SIMD_NEON;
+	#endif
+	return KEY_SIMD_SCALAR;
+}
+
+const char* LTexture::getKeySimdName(LKeySimd simd)
+{
+	switch (simd)
+	{
+		case KEY_SIMD_AVX2: return "avx2";
+		case KEY_SIMD_SSE2: return "sse2";
+		case KEY_SIMD_NEON: return "neon";
+		default: return "scalar";
+	}
+}
+
 LTexture::LTexture()
 {
 	// initialize
@@ -221,31 +919,18 @@ bool LTexture::loadFromFile(std::string path)
 	// get rid of the preexisting texture in case something is already loaded
 	free();
 
-	// create the texture
-	SDL_Texture* newTexture = NULL;
-
-	// first create a surface 
-	SDL_Surface* newSurface= IMG_Load(path.c_str());
+	// first create a surface, already color keyed
+	SDL_Surface* newSurface = gTextureCache.load(path);
 	if (newSurface == NULL)
 	{
-		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		printf("Could not load image %s!\n", path.c_str()); 
 	}
 	else
 	{
-		// color key the image we load
-		SDL_SetColorKey(newSurface, SDL_TRUE, SDL_MapRGB(newSurface->format, 0, 0xFF, 0xFF));
-
 		// create texture from surface pixels
-		newTexture = SDL_CreateTextureFromSurface(gRenderer, newSurface);
-		if (newTexture == NULL) 
-		{
-			printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
-		}	
-		else
+		if (!loadFromSurface(newSurface, false))
 		{
-			// get the image dimensions
-			mWidth = newSurface->w;
-			mHeight = newSurface->h;
+			printf("Unable to create texture from %s!\n", path.c_str());
 		}
 
 		// get rid of the surface that we loaded
@@ -253,7 +938,33 @@ bool LTexture::loadFromFile(std::string path)
 	}
 
 	// return success
-	mTexture = newTexture;
+	return mTexture != NULL;
+}
+
+bool LTexture::loadFromSurface(SDL_Surface* surface, bool colorKey)
+{
+	// get rid of the preexisting texture in case something is already loaded
+	free();
+
+	// color key the image we load
+	if (colorKey)
+	{
+		SDL_SetColorKey(surface, SDL_TRUE, SDL_MapRGB(surface->format, 0, 0xFF, 0xFF));
+	}
+
+	// create texture from surface pixels
+	mTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+	if (mTexture == NULL) 
+	{
+		printf("Unable to create texture from surface! SDL Error: %s\n", SDL_GetError());
+	}	
+	else
+	{
+		// get the image dimensions
+		mWidth = surface->w;
+		mHeight = surface->h;
+	}
+
 	return mTexture != NULL;
 }
 
@@ -318,9 +1029,9 @@ void LTexture::free()
 	if (mTexture != NULL)
 	{
 		SDL_DestroyTexture(mTexture);
+		mTexture = NULL;
 		mWidth = 0;
 		mHeight = 0;
-		printf("Freed texture\n");
 	}
 }
 
@@ -350,55 +1061,1759 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
-// ========================== Function Delcarations ==========================
-// loads up SDL and creates window
-bool init();
+// ========================== Async Loader Class Function Definitions ==========================
+LAsyncLoader::LAsyncLoader()
+{
+	// initialize
+	mMutex = SDL_CreateMutex();
+	mWorkReady = SDL_CreateCond();
+	mCompletedReady = SDL_CreateCond();
+	mQuit = false;
+	mPending = 0;
+}
 
-// loads media
-bool loadMedia();
+LAsyncLoader::~LAsyncLoader()
+{
+	// deallocate
+	stop();
 
-// Frees media and shuts down SDL
-void close();
+	for (int i = 0; i < (int)mRequests.size(); ++i)
+	{
+		delete mRequests[i];
+	}
+	mRequests.clear();
 
-// Loads individual image
-SDL_Texture* loadTexture(std::string path);
+	SDL_DestroyCond(mCompletedReady);
+	SDL_DestroyCond(mWorkReady);
+	SDL_DestroyMutex(mMutex);
+}
 
-// ========================== Function Definitions ==========================
-bool init()
+bool LAsyncLoader::start(int workers)
 {
-	// Initialization flag
-	bool success = true;
-
-	// Initialize SDL Video and Audio
-	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
+	// one worker per core by default
+	if (workers <= 0)
 	{
-		printf("SDL couldn't initialize! SDL_Error: %s\n", SDL_GetError());
-		success = false;
+		workers = SDL_GetCPUCount();
 	}
-	else
+
+	mQuit = false;
+	for (int i = 0; i < workers; ++i)
 	{
-		// Create the window
-		gWindow = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
-		if (gWindow == NULL)
-		{ 
-		  printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
-		  success = false;
-		}
-		else
+		SDL_Thread* thread = SDL_CreateThread(workerMain, "LoaderWorker", this);
+		if (thread == NULL)
 		{
-			// initialize the renderer for the window
-			gRenderer = SDL_CreateRenderer(gWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-			if (gRenderer == NULL)
-			{
-				printf("Renderer could not be initialized! SDL_Error: %s\n", SDL_GetError());
-				success = false;
-			}
-			else
-			{
-				// initialize renderer color
-				SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
-			}
-
+			printf("Unable to create loader worker! SDL Error: %s\n", SDL_GetError());
+			break;
+		}
+		mThreads.push_back(thread);
+	}
+
+	return !mThreads.empty();
+}
+
+void LAsyncLoader::stop()
+{
+	// nothing running
+	if (mThreads.empty())
+	{
+		return;
+	}
+
+	// workers drain the queue before they notice the quit flag
+	SDL_LockMutex(mMutex);
+	mQuit = true;
+	SDL_CondBroadcast(mWorkReady);
+	SDL_UnlockMutex(mMutex);
+
+	for (int i = 0; i < (int)mThreads.size(); ++i)
+	{
+		SDL_WaitThread(mThreads[i], NULL);
+	}
+	mThreads.clear();
+
+	// hand over whatever they finished
+	pump();
+}
+
+int LAsyncLoader::loadTexture(std::string path, LTexture* texture)
+{
+	Request* request = new Request();
+	request->type = REQUEST_TEXTURE;
+	request->path = path;
+	request->surface = NULL;
+	request->chunk = NULL;
+	request->texture = texture;
+	request->chunkTarget = NULL;
+	request->done = false;
+	request->success = false;
+
+	return queue(request);
+}
+
+int LAsyncLoader::loadSound(std::string path, Mix_Chunk** chunk)
+{
+	Request* request = new Request();
+	request->type = REQUEST_SOUND;
+	request->path = path;
+	request->surface = NULL;
+	request->chunk = NULL;
+	request->texture = NULL;
+	request->chunkTarget = chunk;
+	request->done = false;
+	request->success = false;
+
+	return queue(request);
+}
+
+int LAsyncLoader::queue(Request* request)
+{
+	mRequests.push_back(request);
+	++mPending;
+
+	// no workers, load it the old way
+	if (mThreads.empty())
+	{
+		decode(request);
+		finish(request);
+	}
+	else
+	{
+		SDL_LockMutex(mMutex);
+		mWork.push_back(request);
+		SDL_CondSignal(mWorkReady);
+		SDL_UnlockMutex(mMutex);
+	}
+
+	return mRequests.size() - 1;
+}
+
+int LAsyncLoader::workerMain(void* data)
+{
+	LAsyncLoader* loader = (LAsyncLoader*)data;
+
+	while (true)
+	{
+		// wait for work or for the quit flag
+		SDL_LockMutex(loader->mMutex);
+		while (loader->mWork.empty() && !loader->mQuit)
+		{
+			SDL_CondWait(loader->mWorkReady, loader->mMutex);
+		}
+		if (loader->mWork.empty())
+		{
+			SDL_UnlockMutex(loader->mMutex);
+			break;
+		}
+		Request* request = loader->mWork.front();
+		loader->mWork.pop_front();
+		SDL_UnlockMutex(loader->mMutex);
+
+		// the slow part runs without the lock
+		decode(request);
+
+		// queue it up for the render thread
+		SDL_LockMutex(loader->mMutex);
+		loader->mCompleted.push_back(request);
+		SDL_CondBroadcast(loader->mCompletedReady);
+		SDL_UnlockMutex(loader->mMutex);
+	}
+
+	return 0;
+}
+
+void LAsyncLoader::decode(Request* request)
+{
+	if (request->type == REQUEST_TEXTURE)
+	{
+		request->surface = gTextureCache.load(request->path);
+		if (request->surface == NULL)
+		{
+			printf("Could not load image %s!\n", request->path.c_str());
+		}
+	}
+	else
+	{
+		request->chunk = Mix_LoadWAV_RW(gPack.openAsset(request->path), 1);
+		if (request->chunk == NULL)
+		{
+			printf("Failed to load sound effect %s! SDL_Mixer error: %s\n", request->path.c_str(), Mix_GetError());
+		}
+	}
+}
+
+void LAsyncLoader::finish(Request* request)
+{
+	if (request->type == REQUEST_TEXTURE)
+	{
+		// textures can only be created on the render thread
+		if (request->surface != NULL)
+		{
+			request->success = request->texture->loadFromSurface(request->surface, false);
+			SDL_FreeSurface(request->surface);
+			request->surface = NULL;
+		}
+	}
+	else
+	{
+		// the owner takes the chunk
+		*request->chunkTarget = request->chunk;
+		request->success = request->chunk != NULL;
+		request->chunk = NULL;
+	}
+
+	request->done = true;
+	--mPending;
+}
+
+int LAsyncLoader::pump()
+{
+	// take everything finished so far in one go
+	std::deque<Request*> completed;
+	SDL_LockMutex(mMutex);
+	completed.swap(mCompleted);
+	SDL_UnlockMutex(mMutex);
+
+	for (int i = 0; i < (int)completed.size(); ++i)
+	{
+		finish(completed[i]);
+	}
+
+	return completed.size();
+}
+
+bool LAsyncLoader::isDone(int handle)
+{
+	return handle >= 0 && handle < (int)mRequests.size() && mRequests[handle]->done;
+}
+
+bool LAsyncLoader::wait(int handle)
+{
+	if (handle < 0 || handle >= (int)mRequests.size())
+	{
+		return false;
+	}
+
+	while (true)
+	{
+		pump();
+		if (mRequests[handle]->done)
+		{
+			return mRequests[handle]->success;
+		}
+
+		// sleep until a worker hands something back
+		SDL_LockMutex(mMutex);
+		while (mCompleted.empty())
+		{
+			SDL_CondWait(mCompletedReady, mMutex);
+		}
+		SDL_UnlockMutex(mMutex);
+	}
+}
+
+bool LAsyncLoader::waitAll()
+{
+	bool success = true;
+	for (int i = 0; i < (int)mRequests.size(); ++i)
+	{
+		if (!wait(i))
+		{
+			success = false;
+		}
+	}
+	return success;
+}
+
+int LAsyncLoader::getPendingCount()
+{
+	return mPending;
+}
+
+// ========================== Pack File Class Function Definitions ==========================
+LPackFile::LPackFile()
+{
+	// initialize
+	mData = NULL;
+	mSize = 0;
+	mHeader = NULL;
+	mEntries = NULL;
+}
+
+LPackFile::~LPackFile()
+{
+	// deallocate
+	close();
+}
+
+bool LPackFile::open(std::string path)
+{
+	// get rid of the pack that is open
+	close();
+
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		return false;
+	}
+
+	// map the whole thing, the descriptor isn't needed once it's mapped
+	struct stat info;
+	void* data = MAP_FAILED;
+	if (fstat(file, &info) == 0 && info.st_size >= (off_t)sizeof(LPackHeader))
+	{
+		data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	}
+	::close(file);
+	if (data == MAP_FAILED)
+	{
+		printf("Unable to map pack %s!\n", path.c_str());
+		return false;
+	}
+
+	mData = (Uint8*)data;
+	mSize = info.st_size;
+	mHeader = (const LPackHeader*)mData;
+	mEntries = (const LPackEntry*)(mData + sizeof(LPackHeader));
+
+	// check that the header and every entry fit in the file
+	bool valid = memcmp(mHeader->magic, PACK_MAGIC, sizeof(PACK_MAGIC)) == 0 && mHeader->version == PACK_VERSION;
+	valid = valid && sizeof(LPackHeader) + (Uint64)mHeader->count * sizeof(LPackEntry) <= mSize;
+	for (Uint32 i = 0; valid && i < mHeader->count; ++i)
+	{
+		valid = mEntries[i].offset <= mSize && mEntries[i].size <= mSize - mEntries[i].offset && mEntries[i].name[PACK_NAME_LENGTH - 1] == '\0';
+	}
+	if (!valid)
+	{
+		printf("%s is not a valid pack!\n", path.c_str());
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void LPackFile::close()
+{
+	if (mData != NULL)
+	{
+		munmap(mData, mSize);
+		mData = NULL;
+		mSize = 0;
+		mHeader = NULL;
+		mEntries = NULL;
+	}
+}
+
+bool LPackFile::isOpen()
+{
+	return mData != NULL;
+}
+
+SDL_RWops* LPackFile::openAsset(std::string path)
+{
+	// no copy, the decoder reads the mapped pages
+	const LPackEntry* entry = find(path.c_str());
+	if (entry != NULL)
+	{
+		return SDL_RWFromConstMem(mData + entry->offset, entry->size);
+	}
+
+	// not packed, read the loose file
+	SDL_RWops* file = SDL_RWFromFile(path.c_str(), "rb");
+	if (file == NULL)
+	{
+		printf("Unable to open %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+	}
+	return file;
+}
+
+int LPackFile::getCount()
+{
+	return mHeader != NULL ? mHeader->count : 0;
+}
+
+const LPackEntry* LPackFile::find(const char* name)
+{
+	if (mHeader == NULL)
+	{
+		return NULL;
+	}
+
+	// the index is sorted by name when it's built
+	int low = 0;
+	int high = (int)mHeader->count - 1;
+	while (low <= high)
+	{
+		int middle = (low + high) / 2;
+		int order = strcmp(mEntries[middle].name, name);
+		if (order == 0)
+		{
+			return &mEntries[middle];
+		}
+		else if (order < 0)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+
+	return NULL;
+}
+
+bool LPackFile::build(std::string directory, std::string path)
+{
+	DIR* dir = opendir(directory.c_str());
+	if (dir == NULL)
+	{
+		printf("Unable to open directory %s!\n", directory.c_str());
+		return false;
+	}
+
+	// every regular file, sorted so lookups can binary search
+	std::vector<std::string> names;
+	struct dirent* item;
+	while ((item = readdir(dir)) != NULL)
+	{
+		std::string name = directory + "/" + item->d_name;
+		struct stat info;
+		if (item->d_name[0] != '.' && stat(name.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+		{
+			if ((int)name.size() >= PACK_NAME_LENGTH)
+			{
+				printf("Skipping %s, the name is too long for the pack!\n", name.c_str());
+				continue;
+			}
+			names.push_back(name);
+		}
+	}
+	closedir(dir);
+	std::sort(names.begin(), names.end());
+
+	// read everything in and lay out the index
+	std::vector<std::vector<char> > payloads(names.size());
+	std::vector<LPackEntry> entries(names.size());
+	Uint64 offset = sizeof(LPackHeader) + names.size() * sizeof(LPackEntry);
+	for (int i = 0; i < (int)names.size(); ++i)
+	{
+		FILE* input = fopen(names[i].c_str(), "rb");
+		if (input == NULL)
+		{
+			printf("Unable to read %s!\n", names[i].c_str());
+			return false;
+		}
+		fseek(input, 0, SEEK_END);
+		payloads[i].resize(ftell(input));
+		fseek(input, 0, SEEK_SET);
+		if (!payloads[i].empty() && fread(&payloads[i][0], payloads[i].size(), 1, input) != 1)
+		{
+			printf("Unable to read %s!\n", names[i].c_str());
+			fclose(input);
+			return false;
+		}
+		fclose(input);
+
+		offset = (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+		memset(&entries[i], 0, sizeof(LPackEntry));
+		strcpy(entries[i].name, names[i].c_str());
+		entries[i].offset = offset;
+		entries[i].size = payloads[i].size();
+		offset += payloads[i].size();
+	}
+
+	FILE* output = fopen(path.c_str(), "wb");
+	if (output == NULL)
+	{
+		printf("Unable to write %s!\n", path.c_str());
+		return false;
+	}
+
+	LPackHeader header;
+	memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+	header.version = PACK_VERSION;
+	header.count = names.size();
+	header.alignment = PACK_ALIGNMENT;
+	fwrite(&header, sizeof(header), 1, output);
+	if (!entries.empty())
+	{
+		fwrite(&entries[0], sizeof(LPackEntry), entries.size(), output);
+	}
+
+	// zero padding up to each payload
+	const char padding[PACK_ALIGNMENT] = {0};
+	for (int i = 0; i < (int)names.size(); ++i)
+	{
+		fwrite(padding, entries[i].offset - ftell(output), 1, output);
+		if (!payloads[i].empty())
+		{
+			fwrite(&payloads[i][0], payloads[i].size(), 1, output);
+		}
+	}
+
+	bool success = ferror(output) == 0;
+	fclose(output);
+	if (success)
+	{
+		printf("Packed %d files from %s into %s (%lld bytes)\n", (int)names.size(), directory.c_str(), path.c_str(), (long long)offset);
+	}
+	else
+	{
+		printf("Unable to write %s!\n", path.c_str());
+	}
+
+	return success;
+}
+
+// ========================== Texture Cache Class Function Definitions ==========================
+LTextureCache::LTextureCache()
+{
+	// initialize
+	SDL_AtomicSet(&mHits, 0);
+	SDL_AtomicSet(&mMisses, 0);
+	SDL_AtomicSet(&mWrites, 0);
+}
+
+bool LTextureCache::open(std::string directory)
+{
+	// fine if it's already there
+	if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+	{
+		printf("Unable to create texture cache %s!\n", directory.c_str());
+		return false;
+	}
+
+	mDirectory = directory;
+	return true;
+}
+
+void LTextureCache::close()
+{
+	mDirectory.clear();
+}
+
+bool LTextureCache::isOpen()
+{
+	return !mDirectory.empty();
+}
+
+SDL_Surface* LTextureCache::load(std::string path)
+{
+	// read the whole source, the hash needs every byte and a miss decodes from the same copy
+	SDL_RWops* file = gPack.openAsset(path);
+	if (file == NULL)
+	{
+		return NULL;
+	}
+	std::vector<Uint8> source(std::max((Sint64)SDL_RWsize(file), (Sint64)0));
+	bool read = !source.empty() && SDL_RWread(file, &source[0], source.size(), 1) == 1;
+	SDL_RWclose(file);
+	if (!read)
+	{
+		printf("Unable to read %s!\n", path.c_str());
+		return NULL;
+	}
+
+	// an unchanged source hashes to an entry written by an earlier run
+	Uint64 sourceHash = hash(&source[0], source.size());
+	std::string entryPath;
+	if (isOpen())
+	{
+		entryPath = getEntryPath(sourceHash);
+		SDL_Surface* cached = readEntry(entryPath, sourceHash, source.size());
+		if (cached != NULL)
+		{
+			// blended like a fresh decode, which keySurface sets up
+			SDL_SetSurfaceBlendMode(cached, SDL_BLENDMODE_BLEND);
+			SDL_AtomicAdd(&mHits, 1);
+			return cached;
+		}
+	}
+	SDL_AtomicAdd(&mMisses, 1);
+
+	// decode it and bring it to the one format the cache stores
+	SDL_Surface* decoded = IMG_Load_RW(SDL_RWFromConstMem(&source[0], source.size()), 1);
+	if (decoded == NULL)
+	{
+		printf("Could not decode %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+		return NULL;
+	}
+	SDL_Surface* converted = SDL_ConvertSurfaceFormat(decoded, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(decoded);
+	if (converted == NULL)
+	{
+		printf("Unable to convert %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+		return NULL;
+	}
+	// keying also sets it to blend, the same as a hit
+	LTexture::keySurface(converted, LTexture::getBestKeySimd());
+
+	// a failed write only costs the next run a decode
+	if (isOpen() && writeEntry(entryPath, sourceHash, source.size(), converted))
+	{
+		SDL_AtomicAdd(&mWrites, 1);
+	}
+
+	return converted;
+}
+
+void LTextureCache::clear()
+{
+	if (!isOpen())
+	{
+		return;
+	}
+
+	DIR* dir = opendir(mDirectory.c_str());
+	if (dir == NULL)
+	{
+		return;
+	}
+
+	// only our own entries, in case the directory is shared
+	struct dirent* item;
+	while ((item = readdir(dir)) != NULL)
+	{
+		std::string name = item->d_name;
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tex") == 0)
+		{
+			unlink((mDirectory + "/" + name).c_str());
+		}
+	}
+	closedir(dir);
+}
+
+void LTextureCache::printStats()
+{
+	printf("Texture cache: %d hits, %d misses, %d entries written\n", SDL_AtomicGet(&mHits), SDL_AtomicGet(&mMisses), SDL_AtomicGet(&mWrites));
+}
+
+Uint64 LTextureCache::hash(const Uint8* data, size_t size)
+{
+	Uint64 value = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; ++i)
+	{
+		value = (value ^ data[i]) * 1099511628211ULL;
+	}
+	return value;
+}
+
+std::string LTextureCache::getEntryPath(Uint64 sourceHash)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.tex", (unsigned long long)sourceHash);
+	return mDirectory + name;
+}
+
+SDL_Surface* LTextureCache::readEntry(std::string entryPath, Uint64 sourceHash, Uint64 sourceSize)
+{
+	FILE* input = fopen(entryPath.c_str(), "rb");
+	if (input == NULL)
+	{
+		return NULL;
+	}
+
+	// a different version, a hash collision or a truncated file all count as a miss
+	LTextureCacheHeader header;
+	SDL_Surface* surface = NULL;
+	bool valid = fread(&header, sizeof(header), 1, input) == 1 && memcmp(header.magic, TEXTURE_CACHE_MAGIC, sizeof(TEXTURE_CACHE_MAGIC)) == 0;
+	valid = valid && header.version == TEXTURE_CACHE_VERSION && header.sourceHash == sourceHash && header.sourceSize == sourceSize;
+	valid = valid && header.format == SDL_PIXELFORMAT_ARGB8888 && header.width > 0 && header.height > 0;
+	if (valid)
+	{
+		surface = SDL_CreateRGBSurfaceWithFormat(0, header.width, header.height, 32, SDL_PIXELFORMAT_ARGB8888);
+	}
+
+	// rows go straight into the surface, in one read when there's no row padding
+	if (surface != NULL)
+	{
+		int rowBytes = surface->w * 4;
+		if (surface->pitch == rowBytes)
+		{
+			valid = fread(surface->pixels, rowBytes * surface->h, 1, input) == 1;
+		}
+		for (int y = 0; valid && surface->pitch != rowBytes && y < surface->h; ++y)
+		{
+			valid = fread((Uint8*)surface->pixels + y * surface->pitch, rowBytes, 1, input) == 1;
+		}
+		if (!valid)
+		{
+			SDL_FreeSurface(surface);
+			surface = NULL;
+		}
+	}
+	fclose(input);
+
+	return surface;
+}
+
+bool LTextureCache::writeEntry(std::string entryPath, Uint64 sourceHash, Uint64 sourceSize, SDL_Surface* surface)
+{
+	// each thread has its own temporary so two loads of the same image can't interleave
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%lu.tmp", (unsigned long)SDL_ThreadID());
+	std::string temporaryPath = entryPath + suffix;
+	FILE* output = fopen(temporaryPath.c_str(), "wb");
+	if (output == NULL)
+	{
+		printf("Unable to write %s!\n", temporaryPath.c_str());
+		return false;
+	}
+
+	LTextureCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(TEXTURE_CACHE_MAGIC));
+	header.version = TEXTURE_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+	header.width = surface->w;
+	header.height = surface->h;
+	header.format = SDL_PIXELFORMAT_ARGB8888;
+	fwrite(&header, sizeof(header), 1, output);
+	for (int y = 0; y < surface->h; ++y)
+	{
+		fwrite((Uint8*)surface->pixels + y * surface->pitch, surface->w * 4, 1, output);
+	}
+
+	// the rename swaps the whole entry in at once
+	bool success = ferror(output) == 0;
+	success = fclose(output) == 0 && success;
+	success = success && rename(temporaryPath.c_str(), entryPath.c_str()) == 0;
+	if (!success)
+	{
+		printf("Unable to write %s!\n", entryPath.c_str());
+		unlink(temporaryPath.c_str());
+	}
+
+	return success;
+}
+
+// ========================== Mixer Class Function Definitions ==========================
+// The kernels add n frames of interleaved stereo to the accumulator, left and right scaled by their own gain.
+// S16 gains already include the 1/32768 that brings samples to -1..1.
+void mixS16Scalar(float* accumulator, const Sint16* samples, int frames, float gainLeft, float gainRight)
+{
+	for (int i = 0; i < frames; ++i)
+	{
+		accumulator[2 * i] += samples[2 * i] * gainLeft;
+		accumulator[2 * i + 1] += samples[2 * i + 1] * gainRight;
+	}
+}
+
+void mixF32Scalar(float* accumulator, const float* samples, int frames, float gainLeft, float gainRight)
+{
+	for (int i = 0; i < frames; ++i)
+	{
+		accumulator[2 * i] += samples[2 * i] * gainLeft;
+		accumulator[2 * i + 1] += samples[2 * i + 1] * gainRight;
+	}
+}
+
+#if MIXER_X86
+__attribute__((target("sse2")))
+void mixS16Sse2(float* accumulator, const Sint16* samples, int frames, float gainLeft, float gainRight)
+{
+	// four frames a step: eight samples widened to two vectors of 32 bit
+	__m128 gain = _mm_setr_ps(gainLeft, gainRight, gainLeft, gainRight);
+	int i = 0;
+	for (; i + 4 <= frames; i += 4)
+	{
+		__m128i packed = _mm_loadu_si128((const __m128i*)(samples + 2 * i));
+		__m128 low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16));
+		__m128 high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16));
+		_mm_storeu_ps(accumulator + 2 * i, _mm_add_ps(_mm_loadu_ps(accumulator + 2 * i), _mm_mul_ps(low, gain)));
+		_mm_storeu_ps(accumulator + 2 * i + 4, _mm_add_ps(_mm_loadu_ps(accumulator + 2 * i + 4), _mm_mul_ps(high, gain)));
+	}
+	mixS16Scalar(accumulator + 2 * i, samples + 2 * i, frames - i, gainLeft, gainRight);
+}
+
+__attribute__((target("sse2")))
+void mixF32Sse2(float* accumulator, const float* samples, int frames, float gainLeft, float gainRight)
+{
+	__m128 gain = _mm_setr_ps(gainLeft, gainRight, gainLeft, gainRight);
+	int i = 0;
+	for (; i + 2 <= frames; i += 2)
+	{
+		__m128 source = _mm_loadu_ps(samples + 2 * i);
+		_mm_storeu_ps(accumulator + 2 * i, _mm_add_ps(_mm_loadu_ps(accumulator + 2 * i), _mm_mul_ps(source, gain)));
+	}
+	mixF32Scalar(accumulator + 2 * i, samples + 2 * i, frames - i, gainLeft, gainRight);
+}
+
+__attribute__((target("avx2")))
+void mixS16Avx2(float* accumulator, const Sint16* samples, int frames, float gainLeft, float gainRight)
+{
+	// eight frames a step
+	__m256 gain = _mm256_setr_ps(gainLeft, gainRight, gainLeft, gainRight, gainLeft, gainRight, gainLeft, gainRight);
+	int i = 0;
+	for (; i + 8 <= frames; i += 8)
+	{
+		__m128i first = _mm_loadu_si128((const __m128i*)(samples + 2 * i));
+		__m128i second = _mm_loadu_si128((const __m128i*)(samples + 2 * i + 8));
+		__m256 low = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(first));
+		__m256 high = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(second));
+		_mm256_storeu_ps(accumulator + 2 * i, _mm256_add_ps(_mm256_loadu_ps(accumulator + 2 * i), _mm256_mul_ps(low, gain)));
+		_mm256_storeu_ps(accumulator + 2 * i + 8, _mm256_add_ps(_mm256_loadu_ps(accumulator + 2 * i + 8), _mm256_mul_ps(high, gain)));
+	}
+	mixS16Scalar(accumulator + 2 * i, samples + 2 * i, frames - i, gainLeft, gainRight);
+}
+
+__attribute__((target("avx2")))
+void mixF32Avx2(float* accumulator, const float* samples, int frames, float gainLeft, float gainRight)
+{
+	__m256 gain = _mm256_setr_ps(gainLeft, gainRight, gainLeft, gainRight, gainLeft, gainRight, gainLeft, gainRight);
+	int i = 0;
+	for (; i + 4 <= frames; i += 4)
+	{
+		__m256 source = _mm256_loadu_ps(samples + 2 * i);
+		_mm256_storeu_ps(accumulator + 2 * i, _mm256_add_ps(_mm256_loadu_ps(accumulator + 2 * i), _mm256_mul_ps(source, gain)));
+	}
+	mixF32Scalar(accumulator + 2 * i, samples + 2 * i, frames - i, gainLeft, gainRight);
+}
+#endif
+
+LMixer::LMixer()
+{
+	// initialize
+	mFrequency = 0;
+	mFormat = 0;
+	mHooked = false;
+	mSimd = getBestSimd();
+	mStealPolicy = MIXER_STEAL_OLDEST;
+	mStartCount = 0;
+	mCallbackStart = 0;
+	mMusic = NULL;
+	SDL_AtomicSet(&mCommandHead, 0);
+	SDL_AtomicSet(&mCommandTail, 0);
+	SDL_AtomicSet(&mActiveVoices, 0);
+	SDL_AtomicSet(&mDroppedCommands, 0);
+	SDL_AtomicSet(&mPlayedVoices, 0);
+	SDL_AtomicSet(&mStolenVoices, 0);
+	SDL_AtomicSet(&mCulledVoices, 0);
+	SDL_AtomicSet(&mLatencyHead, 0);
+	SDL_AtomicSet(&mLatencyTail, 0);
+	SDL_AtomicSet(&mCallbackFrames, 0);
+}
+
+LMixer::~LMixer()
+{
+	// deallocate
+	close();
+}
+
+bool LMixer::open(int voices)
+{
+	// mix in whatever SDL_mixer opened the device with
+	int frequency = 0;
+	Uint16 format = 0;
+	int channels = 0;
+	if (Mix_QuerySpec(&frequency, &format, &channels) == 0)
+	{
+		printf("Mixer needs the audio device open! SDL_mixer Error: %s\n", Mix_GetError());
+		return false;
+	}
+	if (channels != 2)
+	{
+		printf("Mixer only mixes to stereo, the device has %d channels!\n", channels);
+		return false;
+	}
+	if (!configure(voices, frequency, format))
+	{
+		return false;
+	}
+
+	Mix_SetPostMix(postMix, this);
+	mHooked = true;
+	printf("Mixing %d voices at %d Hz with %s\n", voices, frequency, getSimdName(mSimd));
+	return true;
+}
+
+void LMixer::close()
+{
+	// after this the callback won't touch the voices or the sounds they point at
+	if (mHooked)
+	{
+		Mix_SetPostMix(NULL, NULL);
+		mHooked = false;
+	}
+}
+
+bool LMixer::configure(int voices, int frequency, Uint16 format)
+{
+	if (format != AUDIO_S16SYS && format != AUDIO_F32SYS)
+	{
+		printf("Mixer can't mix to audio format 0x%x!\n", format);
+		return false;
+	}
+
+	mFrequency = frequency;
+	mFormat = format;
+
+	Voice idle = {NULL, 0, 0.f, 0.f, false, 0, 0};
+	mVoices.assign(voices, idle);
+	mAccumulator.resize(MIXER_MAX_FRAMES * 2);
+	mMusicBuffer.resize(MIXER_MAX_FRAMES * 2 * sizeof(float));
+	return true;
+}
+
+LSound LMixer::wrapChunk(Mix_Chunk* chunk)
+{
+	// chunks come out of SDL_mixer in the device format
+	LSound sound = {NULL, false, 0, MIXER_DEFAULT_INSTANCES};
+	if (chunk != NULL)
+	{
+		int frameBytes = mFormat == AUDIO_F32SYS ? 2 * sizeof(float) : 2 * sizeof(Sint16);
+		sound.samples = chunk->abuf;
+		sound.isFloat = mFormat == AUDIO_F32SYS;
+		sound.frames = chunk->alen / frameBytes;
+	}
+	return sound;
+}
+
+bool LMixer::play(const LSound* sound, float gain, float pan, int priority, Uint64 triggered)
+{
+	if (sound == NULL || sound->samples == NULL)
+	{
+		return false;
+	}
+
+	// not worth a voice, or a command
+	if (gain < MIXER_CULL_GAIN)
+	{
+		SDL_AtomicAdd(&mCulledVoices, 1);
+		return false;
+	}
+
+	// equal power pan, -1 is hard left and 1 hard right
+	float angle = (std::max(-1.f, std::min(1.f, pan)) + 1.f) * (float)M_PI / 4.f;
+	float scale = sound->isFloat ? 1.f : 1.f / 32768.f;
+
+	Command command;
+	command.type = COMMAND_PLAY;
+	command.sound = sound;
+	command.gainLeft = gain * cosf(angle) * scale;
+	command.gainRight = gain * sinf(angle) * scale;
+	command.priority = priority;
+	command.triggered = triggered;
+	return pushCommand(command);
+}
+
+bool LMixer::stopAll()
+{
+	Command command;
+	command.type = COMMAND_STOP_ALL;
+	command.sound = NULL;
+	command.gainLeft = 0.f;
+	command.gainRight = 0.f;
+	command.priority = 0;
+	command.triggered = 0;
+	return pushCommand(command);
+}
+
+void LMixer::setMusic(LMusicStream* music)
+{
+	mMusic = music;
+}
+
+bool LMixer::pushCommand(const Command& command)
+{
+	int head = SDL_AtomicGet(&mCommandHead);
+	int tail = SDL_AtomicGet(&mCommandTail);
+	if (head - tail >= MIXER_COMMAND_QUEUE)
+	{
+		SDL_AtomicAdd(&mDroppedCommands, 1);
+		return false;
+	}
+
+	// the audio thread is done with the slots before tail
+	SDL_MemoryBarrierAcquire();
+
+	// fill the slot, then publish it, the barrier keeps the slot's bytes ahead of the new head
+	mCommands[head & (MIXER_COMMAND_QUEUE - 1)] = command;
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&mCommandHead, head + 1);
+	return true;
+}
+
+void LMixer::runCommands()
+{
+	int tail = SDL_AtomicGet(&mCommandTail);
+	int head = SDL_AtomicGet(&mCommandHead);
+
+	// the slots before head are fully written
+	SDL_MemoryBarrierAcquire();
+	for (; tail != head; ++tail)
+	{
+		const Command& command = mCommands[tail & (MIXER_COMMAND_QUEUE - 1)];
+		if (command.type == COMMAND_STOP_ALL)
+		{
+			for (int i = 0; i < (int)mVoices.size(); ++i)
+			{
+				mVoices[i].active = false;
+			}
+		}
+		else
+		{
+			startVoice(command);
+		}
+	}
+
+	// hand the slots back once we're done reading them
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&mCommandTail, tail);
+}
+
+void LMixer::startVoice(const Command& command)
+{
+	// one pass over the pool, so a burst of triggers costs the same per command however busy it is
+	int instances = 0;
+	int freeVoice = -1;
+	int victim = -1;
+	int instanceVictim = -1;
+	for (int i = 0; i < (int)mVoices.size(); ++i)
+	{
+		const Voice& voice = mVoices[i];
+		if (!voice.active)
+		{
+			if (freeVoice < 0)
+			{
+				freeVoice = i;
+			}
+			continue;
+		}
+
+		if (voice.sound == command.sound)
+		{
+			++instances;
+			if (instanceVictim < 0 || isBetterVictim(voice, mVoices[instanceVictim]))
+			{
+				instanceVictim = i;
+			}
+		}
+		if (victim < 0 || isBetterVictim(voice, mVoices[victim]))
+		{
+			victim = i;
+		}
+	}
+
+	// at its cap it can only replace one of its own, otherwise a free voice comes before stealing
+	int target = freeVoice >= 0 ? freeVoice : victim;
+	if (command.sound->maxInstances > 0 && instances >= command.sound->maxInstances)
+	{
+		target = instanceVictim;
+	}
+	if (target < 0)
+	{
+		SDL_AtomicAdd(&mCulledVoices, 1);
+		return;
+	}
+
+	// a sound never cuts off something more important than itself
+	Voice& voice = mVoices[target];
+	if (voice.active)
+	{
+		if (voice.priority > command.priority)
+		{
+			SDL_AtomicAdd(&mCulledVoices, 1);
+			return;
+		}
+		SDL_AtomicAdd(&mStolenVoices, 1);
+	}
+
+	voice.sound = command.sound;
+	voice.position = 0;
+	voice.gainLeft = command.gainLeft;
+	voice.gainRight = command.gainRight;
+	voice.active = true;
+	voice.priority = command.priority;
+	voice.started = mStartCount++;
+	SDL_AtomicAdd(&mPlayedVoices, 1);
+
+	// it's heard from the start of this callback's buffer, dropped if the game isn't collecting them
+	if (command.triggered != 0)
+	{
+		int head = SDL_AtomicGet(&mLatencyHead);
+		if (head - SDL_AtomicGet(&mLatencyTail) < MIXER_LATENCY_QUEUE)
+		{
+			// the game thread is done with the samples before tail, and sees this one only once it is whole
+			SDL_MemoryBarrierAcquire();
+			LLatencySample& sample = mLatency[head & (MIXER_LATENCY_QUEUE - 1)];
+			sample.triggered = command.triggered;
+			sample.callback = mCallbackStart;
+			sample.callbackFrames = SDL_AtomicGet(&mCallbackFrames);
+			SDL_MemoryBarrierRelease();
+			SDL_AtomicSet(&mLatencyHead, head + 1);
+		}
+	}
+}
+
+bool LMixer::isBetterVictim(const Voice& a, const Voice& b)
+{
+	if (a.priority != b.priority)
+	{
+		return a.priority < b.priority;
+	}
+
+	// the start counter wraps, so compare how long ago rather than the raw values
+	Uint32 ageA = mStartCount - a.started;
+	Uint32 ageB = mStartCount - b.started;
+	float loudnessA = fabsf(a.gainLeft) + fabsf(a.gainRight);
+	float loudnessB = fabsf(b.gainLeft) + fabsf(b.gainRight);
+	if (mStealPolicy == MIXER_STEAL_QUIETEST && loudnessA != loudnessB)
+	{
+		return loudnessA < loudnessB;
+	}
+	return ageA > ageB;
+}
+
+void LMixer::postMix(void* data, Uint8* stream, int bytes)
+{
+	((LMixer*)data)->mix(stream, bytes);
+}
+
+void LMixer::mix(Uint8* stream, int bytes)
+{
+	int sampleBytes = mFormat == AUDIO_F32SYS ? sizeof(float) : sizeof(Sint16);
+	int frames = bytes / (2 * sampleBytes);
+
+	// what latency samples are measured against
+	mCallbackStart = SDL_GetPerformanceCounter();
+	SDL_AtomicSet(&mCallbackFrames, frames);
+
+	runCommands();
+
+	// in blocks the accumulator can hold
+	for (int done = 0; done < frames; done += MIXER_MAX_FRAMES)
+	{
+		int block = std::min(MIXER_MAX_FRAMES, frames - done);
+		memset(&mAccumulator[0], 0, block * 2 * sizeof(float));
+
+		int active = 0;
+		for (int i = 0; i < (int)mVoices.size(); ++i)
+		{
+			if (mVoices[i].active)
+			{
+				mixVoice(mVoices[i], &mAccumulator[0], block);
+				++active;
+			}
+		}
+
+		// the music, silent while it's stopped, paused or rewinding
+		if (mMusic != NULL)
+		{
+			int count = mMusic->read(&mMusicBuffer[0], block);
+			float scale = mMusic->isFloat() ? 1.f : 1.f / 32768.f;
+			mixStereo(&mAccumulator[0], &mMusicBuffer[0], mMusic->isFloat(), count, scale, scale);
+		}
+
+		writeOutput(stream + done * 2 * sampleBytes, block);
+		SDL_AtomicSet(&mActiveVoices, active);
+	}
+}
+
+void LMixer::mixVoice(Voice& voice, float* accumulator, int frames)
+{
+	// whatever is left of the sound, up to a block
+	int count = std::min(frames, voice.sound->frames - voice.position);
+	int sampleBytes = voice.sound->isFloat ? sizeof(float) : sizeof(Sint16);
+	const Uint8* samples = (const Uint8*)voice.sound->samples + 2 * voice.position * sampleBytes;
+	mixStereo(accumulator, samples, voice.sound->isFloat, count, voice.gainLeft, voice.gainRight);
+
+	// done playing
+	voice.position += count;
+	if (voice.position >= voice.sound->frames)
+	{
+		voice.active = false;
+	}
+}
+
+void LMixer::mixStereo(float* accumulator, const void* samples, bool isFloat, int frames, float gainLeft, float gainRight)
+{
+	if (isFloat)
+	{
+		switch (mSimd)
+		{
+			#if MIXER_X86
+			case MIXER_SIMD_AVX2: mixF32Avx2(accumulator, (const float*)samples, frames, gainLeft, gainRight); break;
+			case MIXER_SIMD_SSE2: mixF32Sse2(accumulator, (const float*)samples, frames, gainLeft, gainRight); break;
+			#endif
+			default: mixF32Scalar(accumulator, (const float*)samples, frames, gainLeft, gainRight); break;
+		}
+	}
+	else
+	{
+		switch (mSimd)
+		{
+			#if MIXER_X86
+			case MIXER_SIMD_AVX2: mixS16Avx2(accumulator, (const Sint16*)samples, frames, gainLeft, gainRight); break;
+			case MIXER_SIMD_SSE2: mixS16Sse2(accumulator, (const Sint16*)samples, frames, gainLeft, gainRight); break;
+			#endif
+			default: mixS16Scalar(accumulator, (const Sint16*)samples, frames, gainLeft, gainRight); break;
+		}
+	}
+}
+
+void LMixer::writeOutput(Uint8* stream, int frames)
+{
+	int samples = frames * 2;
+	const float* accumulator = &mAccumulator[0];
+
+	if (mFormat == AUDIO_F32SYS)
+	{
+		// the device clamps floats itself
+		float* output = (float*)stream;
+		for (int i = 0; i < samples; ++i)
+		{
+			output[i] += accumulator[i];
+		}
+		return;
+	}
+
+	// S16 has to saturate, the buffer holds SDL_mixer's output (silent, nothing plays through SDL_mixer any more) and is added in
+	Sint16* output = (Sint16*)stream;
+	int i = 0;
+	#if MIXER_X86
+	if (mSimd != MIXER_SIMD_SCALAR)
+	{
+		__m128 scale = _mm_set1_ps(32768.f);
+		for (; i + 8 <= samples; i += 8)
+		{
+			__m128i packed = _mm_loadu_si128((const __m128i*)(output + i));
+			__m128 low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16));
+			__m128 high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16));
+			low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(accumulator + i), scale));
+			high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(accumulator + i + 4), scale));
+			_mm_storeu_si128((__m128i*)(output + i), _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high)));
+		}
+	}
+	#endif
+	for (; i < samples; ++i)
+	{
+		float value = output[i] + accumulator[i] * 32768.f;
+		output[i] = (Sint16)lrintf(std::max(-32768.f, std::min(32767.f, value)));
+	}
+}
+
+LMixerSimd LMixer::getSimd()
+{
+	return mSimd;
+}
+
+void LMixer::setSimd(LMixerSimd simd)
+{
+	// never above what the CPU can run
+	mSimd = std::min(simd, getBestSimd());
+}
+
+LMixerSimd LMixer::getBestSimd()
+{
+	#if MIXER_X86
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return MIXER_SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return MIXER_SIMD_SSE2;
+	}
+	#endif
+	return MIXER_SIMD_SCALAR;
+}
+
+const char* LMixer::getSimdName(LMixerSimd simd)
+{
+	const char* names[MIXER_SIMD_TOTAL] = {"scalar", "SSE2", "AVX2"};
+	return names[simd];
+}
+
+int LMixer::getActiveVoices()
+{
+	return SDL_AtomicGet(&mActiveVoices);
+}
+
+int LMixer::getDroppedCommands()
+{
+	return SDL_AtomicGet(&mDroppedCommands);
+}
+
+LMixerSteal LMixer::getStealPolicy()
+{
+	return mStealPolicy;
+}
+
+void LMixer::setStealPolicy(LMixerSteal policy)
+{
+	mStealPolicy = policy;
+}
+
+float LMixer::getDistanceGain(float distance)
+{
+	// inverse distance, full volume inside the reference distance
+	return MIXER_REFERENCE_DISTANCE / std::max(MIXER_REFERENCE_DISTANCE, distance);
+}
+
+int LMixer::getPlayedVoices()
+{
+	return SDL_AtomicGet(&mPlayedVoices);
+}
+
+int LMixer::getStolenVoices()
+{
+	return SDL_AtomicGet(&mStolenVoices);
+}
+
+int LMixer::getCulledVoices()
+{
+	return SDL_AtomicGet(&mCulledVoices);
+}
+
+bool LMixer::popLatency(LLatencySample* sample)
+{
+	int tail = SDL_AtomicGet(&mLatencyTail);
+	if (tail == SDL_AtomicGet(&mLatencyHead))
+	{
+		return false;
+	}
+
+	// read the sample only after seeing it published, and hand the slot back only after reading it
+	SDL_MemoryBarrierAcquire();
+	*sample = mLatency[tail & (MIXER_LATENCY_QUEUE - 1)];
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&mLatencyTail, tail + 1);
+	return true;
+}
+
+int LMixer::getCallbackFrames()
+{
+	return SDL_AtomicGet(&mCallbackFrames);
+}
+
+void LMixer::printStats()
+{
+	printf("mixer: %d voices played, %d stolen, %d culled, %d commands dropped\n", getPlayedVoices(), getStolenVoices(), getCulledVoices(), getDroppedCommands());
+}
+
+// ========================== Music Stream Class Function Definitions ==========================
+LMusicStream::LMusicStream()
+{
+	// initialize
+	mFile = NULL;
+	mDataStart = 0;
+	mDataSize = 0;
+	mDataRead = 0;
+	mConverter = NULL;
+	mFormat = AUDIO_S16SYS;
+	mFrequency = 0;
+	mFrameBytes = 0;
+	mThread = NULL;
+	mDecodedBytes = 0;
+	SDL_AtomicSet(&mHead, 0);
+	SDL_AtomicSet(&mTail, 0);
+	SDL_AtomicSet(&mState, MUSIC_STOPPED);
+	SDL_AtomicSet(&mRewind, MUSIC_REWIND_NONE);
+	SDL_AtomicSet(&mQuit, 0);
+	SDL_AtomicSet(&mUnderruns, 0);
+}
+
+LMusicStream::~LMusicStream()
+{
+	// deallocate
+	close();
+}
+
+bool LMusicStream::open(std::string path, int frequency, Uint16 format)
+{
+	close();
+
+	mFile = gPack.openAsset(path);
+	if (mFile == NULL)
+	{
+		return false;
+	}
+
+	SDL_AudioFormat sourceFormat;
+	int sourceChannels = 0;
+	int sourceFrequency = 0;
+	if (!readHeader(&sourceFormat, &sourceChannels, &sourceFrequency))
+	{
+		printf("Unable to stream %s, only PCM and float WAVs are supported!\n", path.c_str());
+		close();
+		return false;
+	}
+
+	// straight to the mixer's stereo output format
+	mConverter = SDL_NewAudioStream(sourceFormat, sourceChannels, sourceFrequency, format, 2, frequency);
+	if (mConverter == NULL)
+	{
+		printf("Unable to convert %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+		close();
+		return false;
+	}
+
+	mFormat = format;
+	mFrequency = frequency;
+	mFrameBytes = 2 * (format == AUDIO_F32SYS ? sizeof(float) : sizeof(Sint16));
+	mFileBlock.resize(MUSIC_FILE_BLOCK);
+	mRing.assign(MUSIC_RING_BYTES, 0);
+	mDecodedBytes = 0;
+	SDL_AtomicSet(&mHead, 0);
+	SDL_AtomicSet(&mTail, 0);
+	SDL_AtomicSet(&mState, MUSIC_STOPPED);
+	SDL_AtomicSet(&mRewind, MUSIC_REWIND_NONE);
+	SDL_AtomicSet(&mQuit, 0);
+	SDL_AtomicSet(&mUnderruns, 0);
+
+	mThread = SDL_CreateThread(decodeMain, "MusicDecoder", this);
+	if (mThread == NULL)
+	{
+		printf("Unable to create music decode thread! SDL Error: %s\n", SDL_GetError());
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void LMusicStream::close()
+{
+	// stop the decoder before pulling the file out from under it
+	if (mThread != NULL)
+	{
+		SDL_AtomicSet(&mQuit, 1);
+		SDL_WaitThread(mThread, NULL);
+		mThread = NULL;
+	}
+	if (mConverter != NULL)
+	{
+		SDL_FreeAudioStream(mConverter);
+		mConverter = NULL;
+	}
+	if (mFile != NULL)
+	{
+		SDL_RWclose(mFile);
+		mFile = NULL;
+	}
+	SDL_AtomicSet(&mState, MUSIC_STOPPED);
+}
+
+void LMusicStream::play()
+{
+	SDL_AtomicSet(&mState, MUSIC_PLAYING);
+}
+
+void LMusicStream::pause()
+{
+	if (SDL_AtomicGet(&mState) == MUSIC_PLAYING)
+	{
+		SDL_AtomicSet(&mState, MUSIC_PAUSED);
+	}
+}
+
+void LMusicStream::stop()
+{
+	// the decoder rewinds, then the audio thread drops what was buffered so far
+	SDL_AtomicSet(&mState, MUSIC_STOPPED);
+	SDL_AtomicSet(&mRewind, MUSIC_REWIND_REQUESTED);
+}
+
+LMusicState LMusicStream::getState()
+{
+	return (LMusicState)SDL_AtomicGet(&mState);
+}
+
+int LMusicStream::read(Uint8* buffer, int frames)
+{
+	// the decoder has rewound and stopped writing, so everything in the ring is stale; a stop in between starts over.
+	// the decoder gets a callback to refill before anything is read
+	if (SDL_AtomicGet(&mRewind) == MUSIC_REWIND_DECODED)
+	{
+		SDL_AtomicSet(&mTail, SDL_AtomicGet(&mHead));
+		SDL_AtomicCAS(&mRewind, MUSIC_REWIND_DECODED, MUSIC_REWIND_NONE);
+		return 0;
+	}
+
+	// nothing to play, or still stale data in the ring
+	if (mThread == NULL || SDL_AtomicGet(&mState) != MUSIC_PLAYING || SDL_AtomicGet(&mRewind) != MUSIC_REWIND_NONE)
+	{
+		return 0;
+	}
+
+	unsigned int head = SDL_AtomicGet(&mHead);
+	unsigned int tail = SDL_AtomicGet(&mTail);
+
+	// the bytes before head are fully decoded
+	SDL_MemoryBarrierAcquire();
+
+	// copy out, in two pieces when it wraps
+	int bytes = std::min((unsigned int)(frames * mFrameBytes), head - tail);
+	int start = tail & (MUSIC_RING_BYTES - 1);
+	int first = std::min(bytes, MUSIC_RING_BYTES - start);
+	memcpy(buffer, &mRing[start], first);
+	memcpy(buffer + first, &mRing[0], bytes - first);
+
+	// the copy is done before the decoder may write over it
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&mTail, tail + bytes);
+
+	// the decoder didn't keep up
+	if (bytes < frames * mFrameBytes)
+	{
+		SDL_AtomicAdd(&mUnderruns, 1);
+	}
+
+	return bytes / mFrameBytes;
+}
+
+bool LMusicStream::isFloat()
+{
+	return mFormat == AUDIO_F32SYS;
+}
+
+int LMusicStream::getUnderruns()
+{
+	return SDL_AtomicGet(&mUnderruns);
+}
+
+int LMusicStream::getBufferedMs()
+{
+	if (mFrameBytes == 0)
+	{
+		return 0;
+	}
+	unsigned int buffered = (unsigned int)SDL_AtomicGet(&mHead) - (unsigned int)SDL_AtomicGet(&mTail);
+	return (Sint64)buffered / mFrameBytes * 1000 / mFrequency;
+}
+
+Sint64 LMusicStream::getDecodedBytes()
+{
+	return mDecodedBytes;
+}
+
+void LMusicStream::printStats()
+{
+	printf("music stream: %.1f MB decoded through a %d KB ring, %d underruns\n", mDecodedBytes / (1024.0 * 1024.0), MUSIC_RING_BYTES / 1024, getUnderruns());
+}
+
+int LMusicStream::decodeMain(void* data)
+{
+	LMusicStream* music = (LMusicStream*)data;
+
+	while (SDL_AtomicGet(&music->mQuit) == 0)
+	{
+		// back to the start after a stop, then leave the ring alone until the audio thread has skipped what's buffered
+		if (SDL_AtomicGet(&music->mRewind) == MUSIC_REWIND_REQUESTED)
+		{
+			SDL_AudioStreamClear(music->mConverter);
+			SDL_RWseek(music->mFile, music->mDataStart, RW_SEEK_SET);
+			music->mDataRead = 0;
+			SDL_AtomicCAS(&music->mRewind, MUSIC_REWIND_REQUESTED, MUSIC_REWIND_DECODED);
+		}
+
+		// top up, then give the audio thread time to drain some
+		if (!music->fill())
+		{
+			break;
+		}
+		SDL_Delay(MUSIC_DECODE_INTERVAL);
+	}
+
+	return 0;
+}
+
+bool LMusicStream::fill()
+{
+	while (SDL_AtomicGet(&mRewind) == MUSIC_REWIND_NONE)
+	{
+		// whole frames of free space
+		unsigned int head = SDL_AtomicGet(&mHead);
+		unsigned int tail = SDL_AtomicGet(&mTail);
+		int space = (MUSIC_RING_BYTES - (head - tail)) / mFrameBytes * mFrameBytes;
+		if (space < MUSIC_FILE_BLOCK)
+		{
+			return true;
+		}
+
+		// the audio thread has finished copying out the bytes before tail
+		SDL_MemoryBarrierAcquire();
+
+		// feed the converter a block of the file, from the top again at the end
+		if (SDL_AudioStreamAvailable(mConverter) < space)
+		{
+			if (mDataRead >= mDataSize)
+			{
+				SDL_RWseek(mFile, mDataStart, RW_SEEK_SET);
+				mDataRead = 0;
+			}
+			int wanted = (int)std::min((Sint64)mFileBlock.size(), mDataSize - mDataRead);
+			int got = SDL_RWread(mFile, &mFileBlock[0], 1, wanted);
+			if (got <= 0)
+			{
+				printf("Unable to read music! SDL Error: %s\n", SDL_GetError());
+				return false;
+			}
+			mDataRead += got;
+			SDL_AudioStreamPut(mConverter, &mFileBlock[0], got);
+		}
+
+		// converted output into the ring, in two pieces when it wraps
+		int start = head & (MUSIC_RING_BYTES - 1);
+		int first = std::min(space, MUSIC_RING_BYTES - start);
+		int bytes = SDL_AudioStreamGet(mConverter, &mRing[start], first / mFrameBytes * mFrameBytes);
+		if (bytes == first && space > first)
+		{
+			int more = SDL_AudioStreamGet(mConverter, &mRing[0], space - first);
+			bytes += std::max(0, more);
+		}
+		if (bytes > 0)
+		{
+			mDecodedBytes += bytes;
+
+			// the PCM lands before the head that publishes it
+			SDL_MemoryBarrierRelease();
+			SDL_AtomicSet(&mHead, head + bytes);
+		}
+	}
+
+	return true;
+}
+
+bool LMusicStream::readHeader(SDL_AudioFormat* format, int* channels, int* frequency)
+{
+	// RIFF header then chunks, fmt has to come before data
+	char id[4];
+	if (SDL_RWread(mFile, id, 4, 1) != 1 || memcmp(id, "RIFF", 4) != 0)
+	{
+		return false;
+	}
+	SDL_ReadLE32(mFile);
+	if (SDL_RWread(mFile, id, 4, 1) != 1 || memcmp(id, "WAVE", 4) != 0)
+	{
+		return false;
+	}
+
+	bool haveFormat = false;
+	while (SDL_RWread(mFile, id, 4, 1) == 1)
+	{
+		Uint32 size = SDL_ReadLE32(mFile);
+		Sint64 next = SDL_RWtell(mFile) + size + (size & 1);
+
+		if (memcmp(id, "fmt ", 4) == 0)
+		{
+			Uint16 encoding = SDL_ReadLE16(mFile);
+			*channels = SDL_ReadLE16(mFile);
+			*frequency = SDL_ReadLE32(mFile);
+			SDL_ReadLE32(mFile);
+			SDL_ReadLE16(mFile);
+			Uint16 bits = SDL_ReadLE16(mFile);
+
+			// 1 is integer PCM, 3 is float
+			if (encoding == 1 && bits == 8)
+			{
+				*format = AUDIO_U8;
+			}
+			else if (encoding == 1 && bits == 16)
+			{
+				*format = AUDIO_S16LSB;
+			}
+			else if (encoding == 3 && bits == 32)
+			{
+				*format = AUDIO_F32LSB;
+			}
+			else
+			{
+				return false;
+			}
+			haveFormat = true;
+		}
+		else if (memcmp(id, "data", 4) == 0)
+		{
+			mDataStart = SDL_RWtell(mFile);
+			mDataSize = size;
+			mDataRead = 0;
+			return haveFormat && *channels > 0 && *frequency > 0;
+		}
+
+		SDL_RWseek(mFile, next, RW_SEEK_SET);
+	}
+
+	return false;
+}
+
+// ========================== Function Delcarations ==========================
+// loads up SDL and creates window, opens the audio device as asked with a pool of mixer voices for the sound effects
+// (software renderer for the headless benchmarks on the dummy driver)
+bool init(int mixerVoices = MIXER_DEFAULT_VOICES, int audioRate = AUDIO_DEFAULT_RATE, Uint16 audioFormat = AUDIO_S16SYS, int audioBuffer = AUDIO_DEFAULT_BUFFER, bool softwareRenderer = false);
+
+// loads media
+bool loadMedia();
+
+// Frees media and shuts down SDL
+void close();
+
+// Loads individual image
+SDL_Texture* loadTexture(std::string path);
+
+// Loads many copies of the media one after another and then on the loader, and compares the wall time
+void runLoadBenchmark();
+
+// Times startup loads from loose files and from the pack, with cold and warm page caches
+void runPackBenchmark();
+
+// Loads the media and a large generated image with no cache, a cold cache and a warm one, timing decode and upload
+void runTextureCacheBenchmark();
+
+// Mixes hundreds of voices offline with each SIMD path and reports voices mixed per millisecond of CPU,
+// then bursts thousands of triggers a second at the default pool to time the callback with stealing
+void runMixerBenchmark();
+
+// Sorts a set of latencies and prints their spread
+void printLatencies(const char* name, std::vector<double>& latencies);
+
+// Presses keys through the event queue and reports how long until the callback starts the sound, and until it's heard
+void runLatencyBenchmark();
+
+// ========================== Function Definitions ==========================
+bool init(int mixerVoices, int audioRate, Uint16 audioFormat, int audioBuffer, bool softwareRenderer)
+{
+	// Initialization flag
+	bool success = true;
+
+	// Initialize SDL Video and Audio
+	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
+	{
+		printf("SDL couldn't initialize! SDL_Error: %s\n", SDL_GetError());
+		success = false;
+	}
+	else
+	{
+		// Create the window
+		gWindow = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+		if (gWindow == NULL)
+		{ 
+		  printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+		  success = false;
+		}
+		else
+		{
+			// initialize the renderer for the window
+			Uint32 rendererFlags = SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC;
+			if (softwareRenderer)
+			{
+				rendererFlags = SDL_RENDERER_SOFTWARE;
+			}
+			gRenderer = SDL_CreateRenderer(gWindow, -1, rendererFlags);
+			if (gRenderer == NULL)
+			{
+				printf("Renderer could not be initialized! SDL_Error: %s\n", SDL_GetError());
+				success = false;
+			}
+			else
+			{
+				// initialize renderer color
+				SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
+			}
+
 			// initialize PNG loading
 			int imgFlags = IMG_INIT_PNG;
 			if (!(IMG_Init(imgFlags) & imgFlags))
@@ -414,12 +2829,27 @@ bool init()
 				success = false;
 			}
 
-			// Initialize SDL_Mixer
-			if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0)
+			// Initialize SDL_Mixer, a smaller buffer is less latency but more callbacks to keep up with
+			if (Mix_OpenAudio(audioRate, audioFormat, 2, audioBuffer) < 0)
 			{
 				printf("SDL_Mixer could not initialize! SDL_mixer error: %s\n", Mix_GetError());
 				success = false;
 			}
+			// our own voices for the sound effects
+			else if (!gMixer.open(mixerVoices))
+			{
+				success = false;
+			}
+			else
+			{
+				// the device can pick a different rate
+				int frequency = 0;
+				Uint16 format = 0;
+				int channels = 0;
+				Mix_QuerySpec(&frequency, &format, &channels);
+				printf("Audio: %d Hz %s, %d frame buffer (%.1f ms) on the %s driver\n", frequency, format == AUDIO_F32SYS ? "F32" : "S16",
+					audioBuffer, audioBuffer * 1000.0 / frequency, SDL_GetCurrentAudioDriver());
+			}
 		}
 	}
 	
@@ -431,9 +2861,18 @@ bool loadMedia()
 	// Function success
 	bool success = true;
 
+	// decode images and sound effects on the workers while the font loads here
+	LAsyncLoader loader;
+	loader.start();
+	int promptLoad = loader.loadTexture("media/prompt.png", &gPromptTexture);
+	int highLoad = loader.loadSound("media/high.wav", &gHigh);
+	int scratchLoad = loader.loadSound("media/scratch.wav", &gScratch);
+	int lowLoad = loader.loadSound("media/low.wav", &gLow);
+	int mediumLoad = loader.loadSound("media/medium.wav", &gMedium);
+
 	#if defined(SDL_TTF_MAJOR_VERSION)
 	// Open the font 
-	gFont = TTF_OpenFont("media/lazy.ttf", 56);
+	gFont = TTF_OpenFontRW(gPack.openAsset("media/lazy.ttf"), 1, 56);
 	if (gFont == NULL)
 	{
 		printf("Failed to load lazy font! SDL_ttf Error: %s\n", TTF_GetError());
@@ -452,48 +2891,57 @@ bool loadMedia()
 	#endif
 
 	// Load prompt texture
-	if (!gPromptTexture.loadFromFile("media/prompt.png"))
+	if (!loader.wait(promptLoad))
 	{
 		printf("Failed to load prompt texture!\n");
 		success = false;
 	}
 
-	// Load music
-	gMusic = Mix_LoadMUS("media/beat.wav");
-	if (gMusic == NULL)
+	// Open the music, it decodes on its own thread into the device format as it plays
+	int frequency = 0;
+	Uint16 format = 0;
+	int channels = 0;
+	Mix_QuerySpec(&frequency, &format, &channels);
+	if (!gMusic.open("media/beat.wav", frequency, format))
 	{
-		printf("Failed to load beat music! SDL_Mixer error: %s\n", Mix_GetError());
+		printf("Failed to open beat music!\n");
 		success = false;
 	}
+	else
+	{
+		gMixer.setMusic(&gMusic);
+	}
 
-	gHigh = Mix_LoadWAV("media/high.wav");
-	if (gHigh == NULL)
+	if (!loader.wait(highLoad))
 	{
 		printf("Failed to load high sound effect! SDL_Mixer error: %s\n", Mix_GetError());
 		success = false;
 	}
 
-	gScratch = Mix_LoadWAV("media/scratch.wav");
-	if (gScratch == NULL)
+	if (!loader.wait(scratchLoad))
 	{
 		printf("Failed to load scratch sound effect! SDL_Mixer error: %s\n", Mix_GetError());
 		success = false;
 	}
 
-	gLow = Mix_LoadWAV("media/low.wav");
-	if (gLow == NULL)
+	if (!loader.wait(lowLoad))
 	{
 		printf("Failed to load low sound effect! SDL_Mixer error: %s\n", Mix_GetError());
 		success = false;
 	}
 
-	gMedium = Mix_LoadWAV("media/medium.wav");
-	if (gMedium == NULL)
+	if (!loader.wait(mediumLoad))
 	{
 		printf("Failed to load medium sound effect! SDL_Mixer error: %s\n", Mix_GetError());
 		success = false;
 	}
 
+	// the mixer plays straight out of the chunks
+	gScratchSound = gMixer.wrapChunk(gScratch);
+	gHighSound = gMixer.wrapChunk(gHigh);
+	gMediumSound = gMixer.wrapChunk(gMedium);
+	gLowSound = gMixer.wrapChunk(gLow);
+
 	return success;
 }
 
@@ -502,6 +2950,10 @@ void close()
 	// free loaded images
 	gPromptTexture.free();
 
+	// stop mixing before the chunks the voices point at and the music go away
+	gMixer.close();
+	gMixer.printStats();
+
 	// free the sound effects
 	Mix_FreeChunk(gScratch);
 	Mix_FreeChunk(gHigh);
@@ -512,14 +2964,17 @@ void close()
 	gLow = NULL;
 	gMedium = NULL;
 	
-	// free the music
-	Mix_FreeMusic(gMusic);
-	gMusic = NULL;
+	// stop streaming the music, the stats once the decoder is done with them
+	gMusic.close();
+	gMusic.printStats();
 
 	// Free the global font
 	TTF_CloseFont(gFont);
 	gFont = NULL;
 
+	// the font and music are done reading from the pack
+	gPack.close();
+
 	// Destroy the window
 	SDL_DestroyRenderer(gRenderer);
 	SDL_DestroyWindow(gWindow);
@@ -545,20 +3000,544 @@ SDL_Texture* loadTexture(std::string path)
 	return newTexture;
 }
 
+void runLoadBenchmark()
+{
+	const int SOUNDS = 5;
+	const char* image = "media/prompt.png";
+	const char* sounds[SOUNDS] = {"media/beat.wav", "media/high.wav", "media/medium.wav", "media/low.wav", "media/scratch.wav"};
+	int assets = LOAD_BENCH_COPIES * (1 + SOUNDS);
+
+	// one after another on this thread, the way loadMedia used to
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int copy = 0; copy < LOAD_BENCH_COPIES; ++copy)
+	{
+		LTexture texture;
+		texture.loadFromFile(image);
+		texture.free();
+
+		for (int i = 0; i < SOUNDS; ++i)
+		{
+			Mix_FreeChunk(Mix_LoadWAV(sounds[i]));
+		}
+	}
+	double sequentialMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+
+	// decoded on the workers, uploaded here
+	LAsyncLoader loader;
+	loader.start();
+	std::vector<LTexture> textures(LOAD_BENCH_COPIES);
+	std::vector<Mix_Chunk*> chunks(LOAD_BENCH_COPIES * SOUNDS, (Mix_Chunk*)NULL);
+
+	start = SDL_GetPerformanceCounter();
+	for (int copy = 0; copy < LOAD_BENCH_COPIES; ++copy)
+	{
+		loader.loadTexture(image, &textures[copy]);
+		for (int i = 0; i < SOUNDS; ++i)
+		{
+			loader.loadSound(sounds[i], &chunks[copy * SOUNDS + i]);
+		}
+	}
+
+	// free every copy as soon as it lands so they never pile up, same as the sequential run
+	for (int copy = 0; copy < LOAD_BENCH_COPIES; ++copy)
+	{
+		int handle = copy * (1 + SOUNDS);
+		loader.wait(handle);
+		textures[copy].free();
+
+		for (int i = 0; i < SOUNDS; ++i)
+		{
+			loader.wait(handle + 1 + i);
+			Mix_FreeChunk(chunks[copy * SOUNDS + i]);
+			chunks[copy * SOUNDS + i] = NULL;
+		}
+	}
+	double parallelMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+
+	printf("sequential: %d assets in %.1f ms\n", assets, sequentialMs);
+	printf("parallel (%d workers): %d assets in %.1f ms, %.2fx faster\n", SDL_GetCPUCount(), assets, parallelMs, sequentialMs / parallelMs);
+}
+
+// pushes a file out of the page cache so the next read goes to the disk,
+// false where the OS can't be asked to (macOS has no posix_fadvise)
+bool evictFromPageCache(std::string path)
+{
+	#ifdef POSIX_FADV_DONTNEED
+	int file = open(path.c_str(), O_RDONLY);
+	if (file >= 0)
+	{
+		posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+		close(file);
+	}
+	return true;
+	#else
+	(void)path;
+	return false;
+	#endif
+}
+
+// loads and frees everything loadMedia does, through the pack when asked
+bool loadAllMedia(bool usePack)
+{
+	if (usePack && !gPack.open(PACK_FILE))
+	{
+		return false;
+	}
+
+	SDL_Surface* prompt = IMG_Load_RW(gPack.openAsset("media/prompt.png"), 1);
+	TTF_Font* font = TTF_OpenFontRW(gPack.openAsset("media/lazy.ttf"), 1, 56);
+	Mix_Music* music = Mix_LoadMUS_RW(gPack.openAsset("media/beat.wav"), 1);
+	Mix_Chunk* scratch = Mix_LoadWAV_RW(gPack.openAsset("media/scratch.wav"), 1);
+	Mix_Chunk* high = Mix_LoadWAV_RW(gPack.openAsset("media/high.wav"), 1);
+	Mix_Chunk* medium = Mix_LoadWAV_RW(gPack.openAsset("media/medium.wav"), 1);
+	Mix_Chunk* low = Mix_LoadWAV_RW(gPack.openAsset("media/low.wav"), 1);
+	bool success = prompt != NULL && font != NULL && music != NULL && scratch != NULL && high != NULL && medium != NULL && low != NULL;
+
+	SDL_FreeSurface(prompt);
+	TTF_CloseFont(font);
+	Mix_FreeMusic(music);
+	Mix_FreeChunk(scratch);
+	Mix_FreeChunk(high);
+	Mix_FreeChunk(medium);
+	Mix_FreeChunk(low);
+	gPack.close();
+
+	return success;
+}
+
+void runPackBenchmark()
+{
+	const char* media[] = {"media/prompt.png", "media/lazy.ttf", "media/beat.wav", "media/scratch.wav", "media/high.wav", "media/medium.wav", "media/low.wav"};
+	const int MEDIA = sizeof(media) / sizeof(media[0]);
+
+	for (int usePack = 0; usePack < 2; ++usePack)
+	{
+		// make sure the files are there and get them in the page cache
+		if (!loadAllMedia(usePack))
+		{
+			printf("Unable to load the %s, run --build-pack first\n", usePack ? "pack" : "loose media");
+			return;
+		}
+
+		for (int cold = 1; cold >= 0; --cold)
+		{
+			// without a way to drop the page cache a cold run would just be another warm one
+			if (cold && !evictFromPageCache(usePack ? PACK_FILE : media[0]))
+			{
+				printf("%-5s cold startup: skipped, this OS can't drop files from the page cache\n", usePack ? "pack" : "loose");
+				continue;
+			}
+
+			double totalMs = 0.0;
+			for (int round = 0; round < PACK_BENCH_ROUNDS; ++round)
+			{
+				// only the files this run reads need dropping
+				if (cold && usePack)
+				{
+					evictFromPageCache(PACK_FILE);
+				}
+				else if (cold)
+				{
+					for (int i = 0; i < MEDIA; ++i)
+					{
+						evictFromPageCache(media[i]);
+					}
+				}
+
+				Uint64 start = SDL_GetPerformanceCounter();
+				loadAllMedia(usePack);
+				totalMs += (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+			}
+
+			printf("%-5s %-4s startup: %.3f ms\n", usePack ? "pack" : "loose", cold ? "cold" : "warm", totalMs / PACK_BENCH_ROUNDS);
+		}
+	}
+}
+
+void runTextureCacheBenchmark()
+{
+	// a large sprite sheet alongside the real media: a gradient with cyan holes for the key
+	SDL_Surface* sheet = SDL_CreateRGBSurfaceWithFormat(0, TEXTURE_CACHE_BENCH_WIDTH, TEXTURE_CACHE_BENCH_HEIGHT, 32, SDL_PIXELFORMAT_RGB888);
+	if (sheet == NULL)
+	{
+		printf("Unable to create the benchmark image! SDL Error: %s\n", SDL_GetError());
+		return;
+	}
+	for (int y = 0; y < sheet->h; ++y)
+	{
+		Uint32* row = (Uint32*)((Uint8*)sheet->pixels + y * sheet->pitch);
+		for (int x = 0; x < sheet->w; ++x)
+		{
+			bool keyed = (x / 64 + y / 64) % 3 == 0;
+			row[x] = keyed ? SDL_MapRGB(sheet->format, 0, 0xFF, 0xFF) : SDL_MapRGB(sheet->format, x * 255 / sheet->w, y * 255 / sheet->h, (x ^ y) & 0xFF);
+		}
+	}
+	bool saved = IMG_SavePNG(sheet, "cache_bench.png") == 0;
+	SDL_FreeSurface(sheet);
+	if (!saved)
+	{
+		printf("Unable to save the benchmark image! SDL_image Error: %s\n", IMG_GetError());
+		return;
+	}
+
+	const char* images[] = {"media/prompt.png", "cache_bench.png"};
+	const int IMAGES = sizeof(images) / sizeof(images[0]);
+	const char* modeNames[3] = {"no cache", "cold", "warm"};
+	std::vector<SDL_Surface*> reference(IMAGES, (SDL_Surface*)NULL);
+
+	// no cache decodes every time, cold decodes and writes the entries, warm only reads them back
+	for (int mode = 0; mode < 3; ++mode)
+	{
+		if (mode == 0)
+		{
+			gTextureCache.close();
+		}
+		else if (!gTextureCache.open(TEXTURE_CACHE_DIR))
+		{
+			return;
+		}
+
+		double loadMs = 0.0;
+		double uploadMs = 0.0;
+		for (int round = 0; round < TEXTURE_CACHE_BENCH_ROUNDS; ++round)
+		{
+			if (mode == 1)
+			{
+				gTextureCache.clear();
+			}
+
+			for (int i = 0; i < IMAGES; ++i)
+			{
+				Uint64 start = SDL_GetPerformanceCounter();
+				SDL_Surface* surface = gTextureCache.load(images[i]);
+				Uint64 loaded = SDL_GetPerformanceCounter();
+				SDL_Texture* texture = surface != NULL ? SDL_CreateTextureFromSurface(gRenderer, surface) : NULL;
+				Uint64 uploaded = SDL_GetPerformanceCounter();
+				loadMs += (loaded - start) * 1000.0 / SDL_GetPerformanceFrequency();
+				uploadMs += (uploaded - loaded) * 1000.0 / SDL_GetPerformanceFrequency();
+				if (texture == NULL)
+				{
+					printf("Unable to load %s!\n", images[i]);
+					SDL_FreeSurface(surface);
+					return;
+				}
+				SDL_DestroyTexture(texture);
+
+				// whatever comes out of the cache has to match a fresh decode
+				if (reference[i] == NULL)
+				{
+					reference[i] = surface;
+					continue;
+				}
+				for (int y = 0; y < surface->h; ++y)
+				{
+					if (memcmp((Uint8*)surface->pixels + y * surface->pitch, (Uint8*)reference[i]->pixels + y * reference[i]->pitch, surface->w * 4) != 0)
+					{
+						printf("%s from the %s cache doesn't match the decoded image!\n", images[i], modeNames[mode]);
+						break;
+					}
+				}
+				SDL_FreeSurface(surface);
+			}
+		}
+
+		printf("%-8s: %.3f ms to keyed pixels, %.3f ms to upload, %.3f ms startup for %d images\n", modeNames[mode],
+			loadMs / TEXTURE_CACHE_BENCH_ROUNDS, uploadMs / TEXTURE_CACHE_BENCH_ROUNDS, (loadMs + uploadMs) / TEXTURE_CACHE_BENCH_ROUNDS, IMAGES);
+	}
+
+	gTextureCache.printStats();
+	for (int i = 0; i < IMAGES; ++i)
+	{
+		SDL_FreeSurface(reference[i]);
+	}
+}
+
+// CPU time of this thread, so the mixer benchmark isn't skewed by whatever else runs
+double getThreadCpuMs()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+void runMixerBenchmark()
+{
+	// long noise sounds so no voice runs out before the end
+	int frames = MIXER_BENCH_FRAMES * MIXER_BENCH_BUFFERS;
+	std::vector<Sint16> noiseS16(frames * 2);
+	std::vector<float> noiseF32(frames * 2);
+	srand(18);
+	for (int i = 0; i < frames * 2; ++i)
+	{
+		noiseS16[i] = rand() % 65536 - 32768;
+		noiseF32[i] = noiseS16[i] / 32768.f;
+	}
+	LSound sounds[2] = {{&noiseS16[0], false, frames, 0}, {&noiseF32[0], true, frames, 0}};
+
+	Uint16 formats[2] = {AUDIO_S16SYS, AUDIO_F32SYS};
+	const char* formatNames[2] = {"S16", "F32"};
+	double audioMs = frames * 1000.0 / 44100;
+	std::vector<Uint8> output(MIXER_BENCH_FRAMES * 2 * sizeof(float));
+	std::vector<Uint8> reference(output.size());
+
+	for (int format = 0; format < 2; ++format)
+	{
+		for (int source = 0; source < 2; ++source)
+		{
+			for (int simd = MIXER_SIMD_SCALAR; simd <= LMixer::getBestSimd(); ++simd)
+			{
+				// quiet enough that hundreds of voices don't clip, spread across the stereo field
+				LMixer mixer;
+				mixer.configure(MIXER_BENCH_VOICES, 44100, formats[format]);
+				mixer.setSimd((LMixerSimd)simd);
+				for (int voice = 0; voice < MIXER_BENCH_VOICES; ++voice)
+				{
+					mixer.play(&sounds[source], 4.f / MIXER_BENCH_VOICES, (voice % 9 - 4) / 4.f);
+				}
+
+				double start = getThreadCpuMs();
+				for (int buffer = 0; buffer < MIXER_BENCH_BUFFERS; ++buffer)
+				{
+					memset(&output[0], 0, output.size());
+					mixer.mix(&output[0], output.size() / (formats[format] == AUDIO_F32SYS ? 1 : 2));
+
+					// every path has to come out the same as the scalar one
+					if (buffer == 0 && simd == MIXER_SIMD_SCALAR)
+					{
+						reference = output;
+					}
+					else if (buffer == 0 && memcmp(&reference[0], &output[0], output.size()) != 0)
+					{
+						printf("%s doesn't match the scalar mix!\n", LMixer::getSimdName((LMixerSimd)simd));
+					}
+				}
+				double cpuMs = getThreadCpuMs() - start;
+
+				printf("%s voices to %s output, %-6s: %d voices x %.0f ms of audio in %.2f ms of CPU, %.0f voice buffers/ms, %.0f voices in real time\n",
+					formatNames[source], formatNames[format], LMixer::getSimdName((LMixerSimd)simd), MIXER_BENCH_VOICES, audioMs, cpuMs,
+					MIXER_BENCH_VOICES * (double)MIXER_BENCH_BUFFERS / cpuMs, MIXER_BENCH_VOICES * audioMs / cpuMs);
+			}
+		}
+	}
+
+	// bursts: far more triggers than voices, of different lengths, caps, priorities and loudness
+	LSound burstSounds[4] = {
+		{&noiseS16[0], false, MIXER_BENCH_FRAMES / 2, 4},
+		{&noiseS16[0], false, MIXER_BENCH_FRAMES * 4, 8},
+		{&noiseS16[0], false, MIXER_BENCH_FRAMES * 16, 16},
+		{&noiseS16[0], false, MIXER_BENCH_FRAMES * 64, 0}};
+	const char* policyNames[2] = {"oldest", "quietest"};
+	double triggersPerSecond = MIXER_BURST_TRIGGERS * 44100.0 / MIXER_BENCH_FRAMES;
+
+	for (int policy = MIXER_STEAL_OLDEST; policy <= MIXER_STEAL_QUIETEST; ++policy)
+	{
+		LMixer mixer;
+		mixer.configure(MIXER_DEFAULT_VOICES, 44100, AUDIO_S16SYS);
+		mixer.setStealPolicy((LMixerSteal)policy);
+		srand(18);
+
+		double totalMs = 0.0;
+		double worstMs = 0.0;
+		for (int buffer = 0; buffer < MIXER_BENCH_BUFFERS; ++buffer)
+		{
+			// as if they were scattered up to 32 reference distances away
+			for (int trigger = 0; trigger < MIXER_BURST_TRIGGERS; ++trigger)
+			{
+				float distance = MIXER_REFERENCE_DISTANCE * 32.f * rand() / RAND_MAX;
+				float gain = LMixer::getDistanceGain(distance) * 0.1f;
+				mixer.play(&burstSounds[rand() % 4], gain, rand() * 2.f / RAND_MAX - 1.f, rand() % 4);
+			}
+
+			// the callback runs the commands and mixes, so that's what's timed
+			double start = getThreadCpuMs();
+			mixer.mix(&output[0], MIXER_BENCH_FRAMES * 2 * sizeof(Sint16));
+			double cpuMs = getThreadCpuMs() - start;
+			totalMs += cpuMs;
+			worstMs = std::max(worstMs, cpuMs);
+		}
+
+		printf("burst of %.0f triggers/s into %d voices, steal %-8s: %.3f ms average, %.3f ms worst callback of %.1f ms\n",
+			triggersPerSecond, MIXER_DEFAULT_VOICES, policyNames[policy], totalMs / MIXER_BENCH_BUFFERS, worstMs, MIXER_BENCH_FRAMES * 1000.0 / 44100);
+		mixer.printStats();
+	}
+}
+
+void printLatencies(const char* name, std::vector<double>& latencies)
+{
+	if (latencies.empty())
+	{
+		printf("%s: no samples\n", name);
+		return;
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	int count = latencies.size();
+	printf("%s: min %.2f ms, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms over %d presses\n", name,
+		latencies[0], latencies[count / 2], latencies[count * 9 / 10], latencies[count * 99 / 100], latencies[count - 1], count);
+}
+
+void runLatencyBenchmark()
+{
+	int frequency = 0;
+	Uint16 format = 0;
+	int channels = 0;
+	Mix_QuerySpec(&frequency, &format, &channels);
+	double tickMs = 1000.0 / SDL_GetPerformanceFrequency();
+
+	std::vector<double> toCallback;
+	std::vector<double> toAudible;
+	srand(18);
+
+	for (int press = 0; press <= LATENCY_BENCH_PRESSES; ++press)
+	{
+		// collect whatever the callback started since the last press
+		LLatencySample sample;
+		while (gMixer.popLatency(&sample))
+		{
+			// the buffer the callback filled goes out after the one playing now
+			double callbackMs = (sample.callback - sample.triggered) * tickMs;
+			toCallback.push_back(callbackMs);
+			toAudible.push_back(callbackMs + sample.callbackFrames * 1000.0 / frequency);
+		}
+		if (press == LATENCY_BENCH_PRESSES)
+		{
+			break;
+		}
+
+		// a key goes down somewhere in the middle of a frame
+		SDL_Event key;
+		memset(&key, 0, sizeof(key));
+		key.type = SDL_KEYDOWN;
+		key.key.timestamp = SDL_GetTicks();
+		key.key.keysym.sym = SDLK_1;
+		Uint64 pressed = SDL_GetPerformanceCounter();
+		SDL_PushEvent(&key);
+		int untilPoll = rand() % LATENCY_FRAME_MS;
+		SDL_Delay(untilPoll);
+
+		// the game polls at the top of the next frame and plays it the same way the main loop does
+		SDL_Event e;
+		while (SDL_PollEvent(&e) != 0)
+		{
+			if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_1)
+			{
+				gMixer.play(&gHighSound, 1.f, 0.f, 0, pressed);
+			}
+		}
+
+		// a few frames for the callback to pick it up before the next press
+		SDL_Delay(LATENCY_FRAME_MS - untilPoll + 3 * LATENCY_FRAME_MS);
+	}
+
+	printf("%d Hz, %d frame callbacks (%.1f ms)\n", frequency, gMixer.getCallbackFrames(), gMixer.getCallbackFrames() * 1000.0 / frequency);
+	printLatencies("key to callback", toCallback);
+	printLatencies("key to audible ", toAudible);
+	if ((int)toCallback.size() < LATENCY_BENCH_PRESSES)
+	{
+		printf("%d presses were never picked up by the callback\n", LATENCY_BENCH_PRESSES - (int)toCallback.size());
+	}
+}
+
 int main( int argc, char* args[])
 { 
- 	// start up SDL and create the window
-	if (!init())
+	// --build-pack packs media/ into the pack file and exits
+	if (argc > 1 && strcmp(args[1], "--build-pack") == 0)
+	{
+		return LPackFile::build("media", PACK_FILE) ? 0 : 1;
+	}
+
+	// --mixer-bench mixes offline and exits
+	if (argc > 1 && strcmp(args[1], "--mixer-bench") == 0)
+	{
+		runMixerBenchmark();
+		return 0;
+	}
+
+	// Mixer and audio options: --voices <count> --audio-rate <hz> --audio-buffer <frames> --audio-format s16|f32
+	int mixerVoices = MIXER_DEFAULT_VOICES;
+	int audioRate = AUDIO_DEFAULT_RATE;
+	int audioBuffer = AUDIO_DEFAULT_BUFFER;
+	Uint16 audioFormat = AUDIO_S16SYS;
+	for (int i = 1; i + 1 < argc; ++i)
+	{
+		if (strcmp(args[i], "--voices") == 0 && atoi(args[i + 1]) > 0)
+		{
+			mixerVoices = atoi(args[i + 1]);
+		}
+		else if (strcmp(args[i], "--audio-rate") == 0 && atoi(args[i + 1]) > 0)
+		{
+			audioRate = atoi(args[i + 1]);
+		}
+		else if (strcmp(args[i], "--audio-buffer") == 0 && atoi(args[i + 1]) > 0)
+		{
+			audioBuffer = atoi(args[i + 1]);
+		}
+		else if (strcmp(args[i], "--audio-format") == 0)
+		{
+			audioFormat = strcmp(args[i + 1], "f32") == 0 ? AUDIO_F32SYS : AUDIO_S16SYS;
+		}
+	}
+
+	// --latency-bench runs headless, on the dummy drivers unless some other audio driver is asked for
+	bool latencyBench = argc > 1 && strcmp(args[1], "--latency-bench") == 0;
+	if (latencyBench)
+	{
+		SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+		SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+	}
+
+ 	// start up SDL and create the window, the dummy driver only has the software renderer
+	if (!init(mixerVoices, audioRate, audioFormat, audioBuffer, latencyBench))
 	{
 		printf("Failed to initialize!\n");
 	}
+	else if (argc > 1 && strcmp(args[1], "--pack-bench") == 0)
+	{
+		runPackBenchmark();
+	}
+	else if (argc > 1 && strcmp(args[1], "--cache-bench") == 0)
+	{
+		runTextureCacheBenchmark();
+	}
 	else 
 	{
+		// read from the pack when there is one
+		if (gPack.open(PACK_FILE))
+		{
+			printf("Loading media from %s\n", PACK_FILE);
+		}
+
+		// keep decoded images for the next run unless --no-texture-cache; --load-bench times real decodes so it goes without
+		bool useTextureCache = !(argc > 1 && strcmp(args[1], "--load-bench") == 0);
+		for (int i = 1; i < argc; ++i)
+		{
+			if (strcmp(args[i], "--no-texture-cache") == 0)
+			{
+				useTextureCache = false;
+			}
+		}
+		if (useTextureCache)
+		{
+			gTextureCache.open(TEXTURE_CACHE_DIR);
+		}
+
 		// load media 
 		if (!loadMedia())
 		{
 			printf("Failed to load media!\n");
 		}
+		else if (argc > 1 && strcmp(args[1], "--load-bench") == 0)
+		{
+			runLoadBenchmark();
+			close();
+			return 0;
+		}
+		else if (latencyBench)
+		{
+			runLatencyBenchmark();
+			close();
+			return 0;
+		}
 		
 		// main loop
 		bool quit = false;
@@ -586,49 +3565,36 @@ int main( int argc, char* args[])
 					{
 						// play high sound effect
 						case SDLK_1:
-						Mix_PlayChannel(-1, gHigh, 0);
+						gMixer.play(&gHighSound);
 						break;
 
 						case SDLK_2:
-						Mix_PlayChannel(-1, gMedium, 0);
+						gMixer.play(&gMediumSound);
 						break;
 
 						case SDLK_3:
-						Mix_PlayChannel(-1, gLow, 0);
+						gMixer.play(&gLowSound);
 						break;
 
 						case SDLK_4:
-						Mix_PlayChannel(-1, gScratch, 0);
+						gMixer.play(&gScratchSound);
 						break;
 
 						case SDLK_9:
-						// if there is no music playing
-						if (Mix_PlayingMusic() == 0)
+						// play or resume the music, or pause it if it's playing
+						if (gMusic.getState() == MUSIC_PLAYING)
 						{
-							// play the music
-							Mix_PlayMusic(gMusic, -1);
+							gMusic.pause();
 						}
-						// if the music is being played
-						else 
+						else
 						{
-							// if the music is paused
-							if (Mix_PausedMusic() == 1) 
-							{
-								// resume the music
-								Mix_ResumeMusic();
-							}
-							// if the music is playing
-							else 
-							{
-								// pause the music
-								Mix_PauseMusic();
-							}
+							gMusic.play();
 						}
 						break;
 
 						case SDLK_0:
-						// stop the music
-						Mix_HaltMusic();
+						// stop the music, it starts over on the next play
+						gMusic.stop();
 						break;
 					}
 				}
@@ -5,12 +5,33 @@
 #include <stdio.h>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+// the color key kernel's SIMD paths are SSE2/AVX2 on x86 and NEON on AArch64, everything else keys with the scalar code
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEY_X86 1
+#else
+#define KEY_X86 0
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define KEY_NEON 1
+#else
+#define KEY_NEON 0
+#endif
 
 // ========================== Constants and Enums ==========================
 // screen constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 
+// Timer benchmark constants
+const int TIMER_BENCH_CALLS = 10000000;
+const int TIMER_BENCH_SAMPLES = 1000000;
+
 // Button constants
 const int BUTTON_WIDTH = 300; 
 const int BUTTON_HEIGHT = 200;
@@ -25,6 +46,15 @@ enum LButtonSprite
 	BUTTON_SPRITE_TOTAL
 };
 
+// the color key kernel code paths, best one picked at runtime
+enum LKeySimd
+{
+	KEY_SIMD_SCALAR,
+	KEY_SIMD_SSE2,
+	KEY_SIMD_AVX2,
+	KEY_SIMD_NEON
+};
+
 // ========================== Button Wrapper Class ==========================
 class LButton
 {
@@ -62,6 +92,16 @@ class LTexture
         // Loads image at specified path
         bool loadFromFile(std::string path);
 
+        // Loads an image as ARGB8888 with the cyan color key pixels already transparent, the caller frees it
+        static SDL_Surface* loadKeyedSurface(std::string path);
+
+        // Makes every color key pixel of an ARGB8888 surface transparent black in place, and has it blend
+        static void keySurface(SDL_Surface* surface, LKeySimd simd);
+
+        // the color key code paths
+        static LKeySimd getBestKeySimd();
+        static const char* getKeySimdName(LKeySimd simd);
+
 		#if defined(SDL_TTF_MAJOR_VERSION)
 		// Loads image from font string
 		bool loadFromRenderedText(std::string textureText, SDL_Color textColor);
@@ -95,15 +135,94 @@ class LTexture
         int mHeight;
 };
 
+// ========================== Glyph Atlas Class ==========================
+// Glyphs rasterized per font (printable ASCII)
+const int GLYPH_FIRST = 32;
+const int GLYPH_COUNT = 95;
+
+// Width of the atlas texture, its height grows to fit
+const int GLYPH_ATLAS_WIDTH = 512;
+
+class LGlyphAtlas
+{
+	public:
+		// initializes variables
+		LGlyphAtlas();
+
+		// Deallocates memory
+		~LGlyphAtlas();
+
+		// rasterizes the glyphs of a font, returns its index or -1
+		int addFont(TTF_Font* font);
+
+		// packs the glyphs of every added font into one texture
+		bool build();
+
+		// queues a string with its top left corner at the given point
+		void renderText(int font, int x, int y, const char* text, SDL_Color color);
+
+		// measures a string without drawing it
+		int getTextWidth(int font, const char* text);
+		int getLineHeight(int font);
+
+		// draws everything queued with a single call
+		void flush();
+
+		// deallocates the texture and the added fonts
+		void free();
+
+	private:
+		// where a glyph lives in the atlas and how far it moves the pen
+		struct Glyph
+		{
+			SDL_Rect clip;
+			int advance;
+		};
+
+		// one font size worth of glyphs
+		struct Font
+		{
+			TTF_Font* font;
+			int lineHeight;
+			Glyph glyphs[GLYPH_COUNT];
+
+			// rasterized glyphs waiting for build()
+			SDL_Surface* surfaces[GLYPH_COUNT];
+
+			// kerning between every pair of glyphs, looked up by previous * GLYPH_COUNT + current
+			std::vector<int> kerning;
+		};
+
+		// walks a string, queueing its quads when draw is set, and returns its width
+		int layoutText(int font, int x, int y, const char* text, SDL_Color color, bool draw);
+
+		// the atlas texture
+		SDL_Texture* mTexture;
+
+		// atlas dimensions
+		int mWidth;
+		int mHeight;
+
+		// every added font
+		std::vector<Font> mFonts;
+
+		// queued quads, reused between frames
+		std::vector<SDL_Vertex> mVertices;
+		std::vector<int> mIndices;
+};
+
 // ========================== Timer Class (with implementation) ==========================
 class LTimer
 {
 	private:
-		// The clock time when the timer started
-		Uint32 mStartTicks;
+		// The performance counter value when the timer started
+		Uint64 mStartCounter;
+
+		// The counts stored when the timer was paused
+		Uint64 mPausedCounts;
 
-		// The ticks stored when the timer was paused
-		Uint32 mPausedTicks;
+		// Performance counter ticks per second
+		Uint64 mFrequency;
 
 		// The timer status
 		bool mPaused;
@@ -114,8 +233,9 @@ class LTimer
 		LTimer()
 		{
 			// initialize the varaibles
-			mStartTicks = 0;
-			mPausedTicks = 0;
+			mStartCounter = 0;
+			mPausedCounts = 0;
+			mFrequency = SDL_GetPerformanceFrequency();
 
 			mPaused = false;
 			mStarted = false;
@@ -130,8 +250,8 @@ class LTimer
 			mPaused = false;
 
 			// get the current clock time
-			mStartTicks = SDL_GetTicks();
-			mPausedTicks = 0;
+			mStartCounter = SDL_GetPerformanceCounter();
+			mPausedCounts = 0;
 		}
 
 		void stop()
@@ -142,9 +262,9 @@ class LTimer
 			// Unpause the timer
 			mPaused = false;
 
-			// clear the tick vars
-			mStartTicks = 0;
-			mPausedTicks = 0;
+			// clear the counter vars
+			mStartCounter = 0;
+			mPausedCounts = 0;
 		}
 
 		void pause()
@@ -155,9 +275,9 @@ class LTimer
 				// pause the timer
 				mPaused = true;
 
-				// calculate the paused ticks
-				mPausedTicks = SDL_GetTicks() - mStartTicks;
-				mStartTicks = 0;
+				// calculate the paused counts
+				mPausedCounts = SDL_GetPerformanceCounter() - mStartCounter;
+				mStartCounter = 0;
 			}
 		}
 
@@ -169,19 +289,19 @@ class LTimer
 				// unpause the timer
 				mPaused = false;
 
-				// reset the starting ticks
-				mStartTicks = SDL_GetTicks() - mPausedTicks;
+				// reset the starting counter
+				mStartCounter = SDL_GetPerformanceCounter() - mPausedCounts;
 				
-				// reset the paused ticks
-				mPausedTicks = 0;
+				// reset the paused counts
+				mPausedCounts = 0;
 			}
 		}
 
-		// Gets the timer's time
-		Uint32 getTicks()
+		// Gets the timer's time in raw performance counter units
+		Uint64 getCounts()
 		{
 			// the actual timer time
-			Uint32 time = 0;
+			Uint64 counts = 0;
 
 			// if the timer is running
 			if (mStarted)
@@ -189,17 +309,37 @@ class LTimer
 				// if the timer is paused
 				if (mPaused)
 				{
-					// return the number of ticks when the timer was paused
-					time = mPausedTicks;
+					// return the number of counts when the timer was paused
+					counts = mPausedCounts;
 				}
 				else 
 				{
-					// return the currrent time minus the start time
-					time = SDL_GetTicks() - mStartTicks;
+					// return the currrent counter minus the start counter
+					counts = SDL_GetPerformanceCounter() - mStartCounter;
 				}
 			}
 
-			return time;
+			return counts;
+		}
+
+		// Gets the timer's time in nanoseconds
+		Uint64 getNanos()
+		{
+			// split into whole seconds and the rest so counts * 1e9 can't overflow
+			Uint64 counts = getCounts();
+			return (counts / mFrequency) * 1000000000 + (counts % mFrequency) * 1000000000 / mFrequency;
+		}
+
+		// Gets the timer's time in seconds
+		double getSeconds()
+		{
+			return getCounts() / (double)mFrequency;
+		}
+
+		// Gets the timer's time in milliseconds
+		Uint32 getTicks()
+		{
+			return (Uint32)(getNanos() / 1000000);
 		}
 
 		// Checks the status of the timer
@@ -225,8 +365,11 @@ SDL_Renderer* gRenderer = NULL;
 // globally used font
 TTF_Font* gFont = NULL;
 
-// Time texture and prompt textures 
-LTexture gTimeTexture;
+// glyphs of every font, for text that changes each frame
+LGlyphAtlas gGlyphAtlas;
+int gFontGlyphs = -1;
+
+// Prompt textures
 LTexture gStartPromptTexture;
 LTexture gPausePromptTexture;
 
@@ -323,6 +466,144 @@ void LButton::render()
 }
 
 // ========================== Texture Wrapper Class Function Definitions ==========================
+// The kernels clear every pixel of an ARGB8888 row whose color matches the key, alpha ignored the way SDL
+// compares it. Cleared pixels are transparent black, which reads the same straight or premultiplied.
+void keyRowScalar(Uint32* pixels, int width, Uint32 key)
+{
+	for (int x = 0; x < width; ++x)
+	{
+		if ((pixels[x] & 0x00FFFFFF) == key)
+		{
+			pixels[x] = 0;
+		}
+	}
+}
+
+#if KEY_X86
+__attribute__((target("sse2")))
+void keyRowSse2(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step: compare the color bits, then and the matches away
+	const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+	const __m128i keyColor = _mm_set1_epi32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		__m128i color = _mm_loadu_si128((const __m128i*)(pixels + x));
+		__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(color, colorMask), keyColor);
+		_mm_storeu_si128((__m128i*)(pixels + x), _mm_andnot_si128(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+
+__attribute__((target("avx2")))
+void keyRowAvx2(Uint32* pixels, int width, Uint32 key)
+{
+	// eight pixels a step
+	const __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+	const __m256i keyColor = _mm256_set1_epi32(key);
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		__m256i color = _mm256_loadu_si256((const __m256i*)(pixels + x));
+		__m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(color, colorMask), keyColor);
+		_mm256_storeu_si256((__m256i*)(pixels + x), _mm256_andnot_si256(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+#if KEY_NEON
+void keyRowNeon(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step, NEON is always there on AArch64
+	const uint32x4_t colorMask = vdupq_n_u32(0x00FFFFFF);
+	const uint32x4_t keyColor = vdupq_n_u32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		uint32x4_t color = vld1q_u32(pixels + x);
+		uint32x4_t keyed = vceqq_u32(vandq_u32(color, colorMask), keyColor);
+		vst1q_u32(pixels + x, vbicq_u32(color, keyed));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+SDL_Surface* LTexture::loadKeyedSurface(std::string path)
+{
+	SDL_Surface* loadedSurface = IMG_Load(path.c_str());
+	if (loadedSurface == NULL)
+	{
+		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		return NULL;
+	}
+
+	// one conversion to the format the kernels work on, which SDL would have done making the texture anyway
+	SDL_Surface* keyedSurface = SDL_ConvertSurfaceFormat(loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(loadedSurface);
+	if (keyedSurface == NULL)
+	{
+		printf("Unable to convert image %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+		return NULL;
+	}
+
+	// and one pass to key it
+	keySurface(keyedSurface, getBestKeySimd());
+	return keyedSurface;
+}
+
+void LTexture::keySurface(SDL_Surface* surface, LKeySimd simd)
+{
+	Uint32 key = SDL_MapRGB(surface->format, 0, 0xFF, 0xFF) & 0x00FFFFFF;
+	for (int y = 0; y < surface->h; ++y)
+	{
+		Uint32* row = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch);
+		switch (simd)
+		{
+			#if KEY_X86
+			case KEY_SIMD_AVX2: keyRowAvx2(row, surface->w, key); break;
+			case KEY_SIMD_SSE2: keyRowSse2(row, surface->w, key); break;
+			#endif
+			#if KEY_NEON
+			case KEY_SIMD_NEON: keyRowNeon(row, surface->w, key); break;
+			#endif
+			default: keyRowScalar(row, surface->w, key); break;
+		}
+	}
+
+	// converted RGB images start out unblended, and the keyed pixels only vanish when the texture blends
+	SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_BLEND);
+}
+
+LKeySimd LTexture::getBestKeySimd()
+{
+	#if KEY_X86
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return KEY_SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return KEY_SIMD_SSE2;
+	}
+	#elif KEY_NEON
+	return KEY_SIMD_NEON;
+	#endif
+	return KEY_SIMD_SCALAR;
+}
+
+const char* LTexture::getKeySimdName(LKeySimd simd)
+{
+	switch (simd)
+	{
+		case KEY_SIMD_AVX2: return "avx2";
+		case KEY_SIMD_SSE2: return "sse2";
+		case KEY_SIMD_NEON: return "neon";
+		default: return "scalar";
+	}
+}
+
 LTexture::LTexture()
 {
 	// initialize
@@ -345,17 +626,14 @@ bool LTexture::loadFromFile(std::string path)
 	// create the texture
 	SDL_Texture* newTexture = NULL;
 
-	// first create a surface 
-	SDL_Surface* newSurface= IMG_Load(path.c_str());
+	// first create a surface, with the color key already turned into alpha
+	SDL_Surface* newSurface = loadKeyedSurface(path);
 	if (newSurface == NULL)
 	{
-		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		printf("Could not load image %s!\n", path.c_str()); 
 	}
 	else
 	{
-		// color key the image we load
-		SDL_SetColorKey(newSurface, SDL_TRUE, SDL_MapRGB(newSurface->format, 0, 0xFF, 0xFF));
-
 		// create texture from surface pixels
 		newTexture = SDL_CreateTextureFromSurface(gRenderer, newSurface);
 		if (newTexture == NULL) 
@@ -470,6 +748,291 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
+// ========================== Glyph Atlas Class Function Definitions ==========================
+LGlyphAtlas::LGlyphAtlas()
+{
+	// initialize
+	mTexture = NULL;
+	mWidth = 0;
+	mHeight = 0;
+}
+
+LGlyphAtlas::~LGlyphAtlas()
+{
+	// deallocate
+	free();
+}
+
+int LGlyphAtlas::addFont(TTF_Font* font)
+{
+	if (font == NULL)
+	{
+		return -1;
+	}
+
+	Font newFont;
+	newFont.font = font;
+	newFont.lineHeight = TTF_FontLineSkip(font);
+	newFont.kerning.resize(GLYPH_COUNT * GLYPH_COUNT);
+
+	// glyphs are rendered white so any color can be applied at draw time
+	SDL_Color white = {0xFF, 0xFF, 0xFF, 0xFF};
+	for (int i = 0; i < GLYPH_COUNT; ++i)
+	{
+		Uint16 ch = GLYPH_FIRST + i;
+
+		// pen advance of the glyph
+		int minX, maxX, minY, maxY, advance;
+		newFont.glyphs[i].advance = 0;
+		if (TTF_GlyphMetrics(font, ch, &minX, &maxX, &minY, &maxY, &advance) == 0)
+		{
+			newFont.glyphs[i].advance = advance;
+		}
+
+		// blended so the edges end up in the alpha channel
+		newFont.surfaces[i] = TTF_RenderGlyph_Blended(font, ch, white);
+		newFont.glyphs[i].clip.x = 0;
+		newFont.glyphs[i].clip.y = 0;
+		newFont.glyphs[i].clip.w = 0;
+		newFont.glyphs[i].clip.h = 0;
+
+		// kerning against every glyph that can come before this one
+		for (int j = 0; j < GLYPH_COUNT; ++j)
+		{
+			newFont.kerning[j * GLYPH_COUNT + i] = TTF_GetFontKerningSizeGlyphs(font, GLYPH_FIRST + j, ch);
+		}
+	}
+
+	mFonts.push_back(newFont);
+	return mFonts.size() - 1;
+}
+
+bool LGlyphAtlas::build()
+{
+	// get rid of the old atlas, keeping the fonts
+	if (mTexture != NULL)
+	{
+		SDL_DestroyTexture(mTexture);
+		mTexture = NULL;
+	}
+
+	// place glyphs left to right on shelves, starting a new shelf when a row is full
+	int x = 0, y = 0, shelfHeight = 0;
+	for (int f = 0; f < (int)mFonts.size(); ++f)
+	{
+		for (int i = 0; i < GLYPH_COUNT; ++i)
+		{
+			SDL_Surface* surface = mFonts[f].surfaces[i];
+			if (surface == NULL)
+			{
+				continue;
+			}
+
+			if (x + surface->w > GLYPH_ATLAS_WIDTH)
+			{
+				x = 0;
+				y += shelfHeight + 1;
+				shelfHeight = 0;
+			}
+
+			SDL_Rect& clip = mFonts[f].glyphs[i].clip;
+			clip.x = x;
+			clip.y = y;
+			clip.w = surface->w;
+			clip.h = surface->h;
+
+			// leave a pixel between glyphs so filtering doesn't bleed
+			x += surface->w + 1;
+			if (surface->h > shelfHeight)
+			{
+				shelfHeight = surface->h;
+			}
+		}
+	}
+
+	// the atlas surface starts out fully transparent
+	SDL_Surface* atlasSurface = SDL_CreateRGBSurfaceWithFormat(0, GLYPH_ATLAS_WIDTH, y + shelfHeight, 32, SDL_PIXELFORMAT_RGBA32);
+	if (atlasSurface == NULL)
+	{
+		printf("Unable to create glyph atlas surface! SDL Error: %s\n", SDL_GetError());
+		return false;
+	}
+	SDL_FillRect(atlasSurface, NULL, 0);
+
+	// copy every glyph into its slot
+	for (int f = 0; f < (int)mFonts.size(); ++f)
+	{
+		for (int i = 0; i < GLYPH_COUNT; ++i)
+		{
+			SDL_Surface* surface = mFonts[f].surfaces[i];
+			if (surface == NULL)
+			{
+				continue;
+			}
+
+			// copy the alpha instead of blending it with the empty atlas
+			SDL_Rect destination = mFonts[f].glyphs[i].clip;
+			SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+			SDL_BlitSurface(surface, NULL, atlasSurface, &destination);
+
+			// the atlas holds it now
+			SDL_FreeSurface(surface);
+			mFonts[f].surfaces[i] = NULL;
+		}
+	}
+
+	// create texture from atlas pixels
+	mTexture = SDL_CreateTextureFromSurface(gRenderer, atlasSurface);
+	if (mTexture == NULL)
+	{
+		printf("Unable to create glyph atlas texture! SDL Error: %s\n", SDL_GetError());
+	}
+	else
+	{
+		SDL_SetTextureBlendMode(mTexture, SDL_BLENDMODE_BLEND);
+		mWidth = atlasSurface->w;
+		mHeight = atlasSurface->h;
+	}
+
+	// get rid of the atlas surface
+	SDL_FreeSurface(atlasSurface);
+
+	return mTexture != NULL;
+}
+
+int LGlyphAtlas::layoutText(int font, int x, int y, const char* text, SDL_Color color, bool draw)
+{
+	if (font < 0 || font >= (int)mFonts.size())
+	{
+		return 0;
+	}
+	Font& current = mFonts[font];
+
+	int penX = x;
+	int previous = -1;
+	for (const char* c = text; *c != '\0'; ++c)
+	{
+		// only printable ASCII is in the atlas
+		int index = (unsigned char)*c - GLYPH_FIRST;
+		if (index < 0 || index >= GLYPH_COUNT)
+		{
+			continue;
+		}
+
+		// pull the pair together (or apart) before placing the glyph
+		if (previous >= 0)
+		{
+			penX += current.kerning[previous * GLYPH_COUNT + index];
+		}
+
+		Glyph& glyph = current.glyphs[index];
+		if (draw && glyph.clip.w > 0)
+		{
+			// texture coordinates of the glyph
+			float u0 = glyph.clip.x / (float)mWidth;
+			float v0 = glyph.clip.y / (float)mHeight;
+			float u1 = (glyph.clip.x + glyph.clip.w) / (float)mWidth;
+			float v1 = (glyph.clip.y + glyph.clip.h) / (float)mHeight;
+
+			// corners in top left, top right, bottom right, bottom left order
+			float cornerX[4] = {(float)penX, (float)(penX + glyph.clip.w), (float)(penX + glyph.clip.w), (float)penX};
+			float cornerY[4] = {(float)y, (float)y, (float)(y + glyph.clip.h), (float)(y + glyph.clip.h)};
+			float cornerU[4] = {u0, u1, u1, u0};
+			float cornerV[4] = {v0, v0, v1, v1};
+			for (int i = 0; i < 4; ++i)
+			{
+				SDL_Vertex vertex;
+				vertex.position.x = cornerX[i];
+				vertex.position.y = cornerY[i];
+				vertex.color = color;
+				vertex.tex_coord.x = cornerU[i];
+				vertex.tex_coord.y = cornerV[i];
+				mVertices.push_back(vertex);
+			}
+		}
+
+		penX += glyph.advance;
+		previous = index;
+	}
+
+	return penX - x;
+}
+
+void LGlyphAtlas::renderText(int font, int x, int y, const char* text, SDL_Color color)
+{
+	layoutText(font, x, y, text, color, true);
+}
+
+int LGlyphAtlas::getTextWidth(int font, const char* text)
+{
+	SDL_Color unused = {0, 0, 0, 0};
+	return layoutText(font, 0, 0, text, unused, false);
+}
+
+int LGlyphAtlas::getLineHeight(int font)
+{
+	if (font < 0 || font >= (int)mFonts.size())
+	{
+		return 0;
+	}
+	return mFonts[font].lineHeight;
+}
+
+void LGlyphAtlas::flush()
+{
+	// nothing queued
+	if (mVertices.empty() || mTexture == NULL)
+	{
+		mVertices.clear();
+		return;
+	}
+
+	// make sure the index pattern covers every queued quad
+	int quads = mVertices.size() / 4;
+	while ((int)mIndices.size() < quads * 6)
+	{
+		int base = mIndices.size() / 6 * 4;
+		mIndices.push_back(base);
+		mIndices.push_back(base + 1);
+		mIndices.push_back(base + 2);
+		mIndices.push_back(base + 2);
+		mIndices.push_back(base + 3);
+		mIndices.push_back(base);
+	}
+
+	// every queued string in one call
+	SDL_RenderGeometry(gRenderer, mTexture, &mVertices[0], mVertices.size(), &mIndices[0], quads * 6);
+
+	// keep the allocation for the next frame
+	mVertices.clear();
+}
+
+void LGlyphAtlas::free()
+{
+	// free the texture if it exists
+	if (mTexture != NULL)
+	{
+		SDL_DestroyTexture(mTexture);
+		mTexture = NULL;
+		mWidth = 0;
+		mHeight = 0;
+	}
+
+	// free glyphs that never made it into an atlas
+	for (int f = 0; f < (int)mFonts.size(); ++f)
+	{
+		for (int i = 0; i < GLYPH_COUNT; ++i)
+		{
+			if (mFonts[f].surfaces[i] != NULL)
+			{
+				SDL_FreeSurface(mFonts[f].surfaces[i]);
+			}
+		}
+	}
+	mFonts.clear();
+	mVertices.clear();
+}
+
 // ========================== Function Delcarations ==========================
 // loads up SDL and creates window
 bool init();
@@ -483,6 +1046,9 @@ void close();
 // Loads individual image
 SDL_Texture* loadTexture(std::string path);
 
+// Measures the timer's own call cost and the spread between back to back reads
+void runTimerBenchmark();
+
 // ========================== Function Definitions ==========================
 bool init()
 {
@@ -572,6 +1138,14 @@ bool loadMedia()
 	}
 	#endif
 
+	// rasterize the font once for the text that changes every frame
+	gFontGlyphs = gGlyphAtlas.addFont(gFont);
+	if (gFontGlyphs < 0 || !gGlyphAtlas.build())
+	{
+		printf("Failed to build glyph atlas!\n");
+		success = false;
+	}
+
 	return success;
 }
 
@@ -583,7 +1157,7 @@ void close()
 	// weren't global resources 
 	gPausePromptTexture.free();
 	gStartPromptTexture.free();
-	gTimeTexture.free();
+	gGlyphAtlas.free();
 
 	// Free the global font
 	TTF_CloseFont(gFont);
@@ -613,8 +1187,81 @@ SDL_Texture* loadTexture(std::string path)
 	return newTexture;
 }
 
+void runTimerBenchmark()
+{
+	LTimer timer;
+	timer.start();
+
+	// cost of a read, summed so the calls can't be optimized out
+	Uint64 sink = 0;
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < TIMER_BENCH_CALLS; ++i)
+	{
+		sink += timer.getNanos();
+	}
+	double nanosPerCall = (SDL_GetPerformanceCounter() - start) * 1000000000.0 / SDL_GetPerformanceFrequency() / TIMER_BENCH_CALLS;
+
+	// the old millisecond clock for comparison
+	start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < TIMER_BENCH_CALLS; ++i)
+	{
+		sink += SDL_GetTicks();
+	}
+	double nanosPerTicksCall = (SDL_GetPerformanceCounter() - start) * 1000000000.0 / SDL_GetPerformanceFrequency() / TIMER_BENCH_CALLS;
+
+	printf("LTimer::getNanos: %.1f ns/call\n", nanosPerCall);
+	printf("SDL_GetTicks:     %.1f ns/call\n", nanosPerTicksCall);
+
+	// gaps between consecutive reads show resolution and jitter
+	std::vector<Uint64> deltas(TIMER_BENCH_SAMPLES);
+	Uint64 previous = timer.getNanos();
+	for (int i = 0; i < TIMER_BENCH_SAMPLES; ++i)
+	{
+		Uint64 now = timer.getNanos();
+		deltas[i] = now - previous;
+		previous = now;
+	}
+	std::sort(deltas.begin(), deltas.end());
+
+	// smallest step the clock can show
+	Uint64 resolution = 0;
+	for (int i = 0; i < TIMER_BENCH_SAMPLES && resolution == 0; ++i)
+	{
+		resolution = deltas[i];
+	}
+
+	printf("read-to-read ns: min %llu, p50 %llu, p99 %llu, p99.9 %llu, max %llu\n",
+		(unsigned long long)deltas[0],
+		(unsigned long long)deltas[TIMER_BENCH_SAMPLES / 2],
+		(unsigned long long)deltas[TIMER_BENCH_SAMPLES * 99 / 100],
+		(unsigned long long)deltas[TIMER_BENCH_SAMPLES * 999 / 1000],
+		(unsigned long long)deltas[TIMER_BENCH_SAMPLES - 1]);
+	printf("resolution: %llu ns (counter frequency %llu Hz)\n", (unsigned long long)resolution, (unsigned long long)SDL_GetPerformanceFrequency());
+
+	// a paused timer must hold still
+	timer.pause();
+	Uint64 pausedNanos = timer.getNanos();
+	SDL_Delay(5);
+	printf("paused timer %s\n", timer.getNanos() == pausedNanos ? "holds its time" : "DRIFTED");
+
+	// keep the sums alive
+	if (sink == 0)
+	{
+		printf("\n");
+	}
+}
+
 int main( int argc, char* args[])
 { 
+	// --bench measures the timer and exits, no window needed
+	if (argc > 1 && strcmp(args[1], "--bench") == 0)
+	{
+		SDL_Init(SDL_INIT_TIMER);
+		runTimerBenchmark();
+		SDL_Quit();
+		return 0;
+	}
+
  	// start up SDL and create the window
 	if (!init())
 	{
@@ -640,8 +1287,8 @@ int main( int argc, char* args[])
 		// the application timer (lives on the stack)
 		LTimer timer;
 
-		// In memory text stream
-		std::stringstream timeText;
+		// text buffer reused every frame
+		char timeText[64];
 
 		// The main loop of the game
 		while (!quit) 
@@ -685,14 +1332,7 @@ int main( int argc, char* args[])
 			}
 
 			// set text to be rendered
-			timeText.str("");
-			timeText << "Seconds since start time " << (timer.getTicks() / 1000.f);
-
-			// render text
-			if (!gTimeTexture.loadFromRenderedText(timeText.str().c_str(), textColor))
-			{
-				printf("Unable to render time texture!\n");
-			}
+			snprintf(timeText, sizeof(timeText), "Seconds since start time %.3f", timer.getSeconds());
 
 			// Clear the screen
 			SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
@@ -701,7 +1341,8 @@ int main( int argc, char* args[])
 			// render textures 
 			gStartPromptTexture.render((SCREEN_WIDTH - gStartPromptTexture.getWidth()) / 2, 0); 
 			gPausePromptTexture.render((SCREEN_WIDTH - gPausePromptTexture.getWidth()) / 2, gStartPromptTexture.getHeight()); 
-			gTimeTexture.render((SCREEN_WIDTH - gTimeTexture.getWidth()) / 2, (SCREEN_HEIGHT - gTimeTexture.getHeight()) / 2);
+			gGlyphAtlas.renderText(gFontGlyphs, (SCREEN_WIDTH - gGlyphAtlas.getTextWidth(gFontGlyphs, timeText)) / 2, (SCREEN_HEIGHT - gGlyphAtlas.getLineHeight(gFontGlyphs)) / 2, timeText, textColor);
+			gGlyphAtlas.flush();
 
 			// Update screen
 			SDL_RenderPresent(gRenderer);
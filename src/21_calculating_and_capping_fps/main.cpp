@@ -5,13 +5,53 @@
 #include <stdio.h>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+// the color key kernel's SIMD paths are SSE2/AVX2 on x86 and NEON on AArch64, everything else keys with the scalar code
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEY_X86 1
+#else
+#define KEY_X86 0
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define KEY_NEON 1
+#else
+#define KEY_NEON 0
+#endif
 
 // ========================== Constants and Enums ==========================
 // screen constants
 const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 480;
 const int SCREEN_FPS = 420;
-const int SCREEN_TICKS_PER_FRAME = 1000 / SCREEN_FPS;
+const Uint64 SCREEN_NANOS_PER_FRAME = 1000000000 / SCREEN_FPS;
+
+// Frame pacer constants
+const Uint64 PACER_SPIN_NANOS = 2000000;
+const Uint64 PACER_MIN_SPIN_NANOS = 250000;
+const Uint64 PACER_SPIN_DECAY = 8;
+const int PACER_HISTORY = 1024;
+
+// Frame statistics constants
+const int FRAME_STATS_LOG = 65536;
+const int FRAME_STATS_WINDOW = 600;
+const int FRAME_STATS_REFRESH = 60;
+const int FRAME_STATS_LINE = 96;
+
+// Parts of a frame that get timed separately
+enum LFramePhase
+{
+	FRAME_PHASE_EVENTS,
+	FRAME_PHASE_UPDATE,
+	FRAME_PHASE_RENDER,
+	FRAME_PHASE_PRESENT,
+	FRAME_PHASE_WAIT,
+	FRAME_PHASE_TOTAL
+};
 
 // Button constants
 const int BUTTON_WIDTH = 300; 
@@ -27,6 +67,15 @@ enum LButtonSprite
 	BUTTON_SPRITE_TOTAL
 };
 
+// the color key kernel code paths, best one picked at runtime
+enum LKeySimd
+{
+	KEY_SIMD_SCALAR,
+	KEY_SIMD_SSE2,
+	KEY_SIMD_AVX2,
+	KEY_SIMD_NEON
+};
+
 // ========================== Button Wrapper Class ==========================
 class LButton
 {
@@ -64,6 +113,16 @@ class LTexture
         // Loads image at specified path
         bool loadFromFile(std::string path);
 
+        // Loads an image as ARGB8888 with the cyan color key pixels already transparent, the caller frees it
+        static SDL_Surface* loadKeyedSurface(std::string path);
+
+        // Makes every color key pixel of an ARGB8888 surface transparent black in place, and has it blend
+        static void keySurface(SDL_Surface* surface, LKeySimd simd);
+
+        // the color key code paths
+        static LKeySimd getBestKeySimd();
+        static const char* getKeySimdName(LKeySimd simd);
+
 		#if defined(SDL_TTF_MAJOR_VERSION)
 		// Loads image from font string
 		bool loadFromRenderedText(std::string textureText, SDL_Color textColor);
@@ -97,15 +156,94 @@ class LTexture
         int mHeight;
 };
 
+// ========================== Glyph Atlas Class ==========================
+// Glyphs rasterized per font (printable ASCII)
+const int GLYPH_FIRST = 32;
+const int GLYPH_COUNT = 95;
+
+// Width of the atlas texture, its height grows to fit
+const int GLYPH_ATLAS_WIDTH = 512;
+
+class LGlyphAtlas
+{
+	public:
+		// initializes variables
+		LGlyphAtlas();
+
+		// Deallocates memory
+		~LGlyphAtlas();
+
+		// rasterizes the glyphs of a font, returns its index or -1
+		int addFont(TTF_Font* font);
+
+		// packs the glyphs of every added font into one texture
+		bool build();
+
+		// queues a string with its top left corner at the given point
+		void renderText(int font, int x, int y, const char* text, SDL_Color color);
+
+		// measures a string without drawing it
+		int getTextWidth(int font, const char* text);
+		int getLineHeight(int font);
+
+		// draws everything queued with a single call
+		void flush();
+
+		// deallocates the texture and the added fonts
+		void free();
+
+	private:
+		// where a glyph lives in the atlas and how far it moves the pen
+		struct Glyph
+		{
+			SDL_Rect clip;
+			int advance;
+		};
+
+		// one font size worth of glyphs
+		struct Font
+		{
+			TTF_Font* font;
+			int lineHeight;
+			Glyph glyphs[GLYPH_COUNT];
+
+			// rasterized glyphs waiting for build()
+			SDL_Surface* surfaces[GLYPH_COUNT];
+
+			// kerning between every pair of glyphs, looked up by previous * GLYPH_COUNT + current
+			std::vector<int> kerning;
+		};
+
+		// walks a string, queueing its quads when draw is set, and returns its width
+		int layoutText(int font, int x, int y, const char* text, SDL_Color color, bool draw);
+
+		// the atlas texture
+		SDL_Texture* mTexture;
+
+		// atlas dimensions
+		int mWidth;
+		int mHeight;
+
+		// every added font
+		std::vector<Font> mFonts;
+
+		// queued quads, reused between frames
+		std::vector<SDL_Vertex> mVertices;
+		std::vector<int> mIndices;
+};
+
 // ========================== Timer Class (with implementation) ==========================
 class LTimer
 {
 	private:
-		// The clock time when the timer started
-		Uint32 mStartTicks;
+		// The performance counter value when the timer started
+		Uint64 mStartCounter;
+
+		// The counts stored when the timer was paused
+		Uint64 mPausedCounts;
 
-		// The ticks stored when the timer was paused
-		Uint32 mPausedTicks;
+		// Performance counter ticks per second
+		Uint64 mFrequency;
 
 		// The timer status
 		bool mPaused;
@@ -116,8 +254,9 @@ class LTimer
 		LTimer()
 		{
 			// initialize the varaibles
-			mStartTicks = 0;
-			mPausedTicks = 0;
+			mStartCounter = 0;
+			mPausedCounts = 0;
+			mFrequency = SDL_GetPerformanceFrequency();
 
 			mPaused = false;
 			mStarted = false;
@@ -132,8 +271,8 @@ class LTimer
 			mPaused = false;
 
 			// get the current clock time
-			mStartTicks = SDL_GetTicks();
-			mPausedTicks = 0;
+			mStartCounter = SDL_GetPerformanceCounter();
+			mPausedCounts = 0;
 		}
 
 		void stop()
@@ -144,9 +283,9 @@ class LTimer
 			// Unpause the timer
 			mPaused = false;
 
-			// clear the tick vars
-			mStartTicks = 0;
-			mPausedTicks = 0;
+			// clear the counter vars
+			mStartCounter = 0;
+			mPausedCounts = 0;
 		}
 
 		void pause()
@@ -157,9 +296,9 @@ class LTimer
 				// pause the timer
 				mPaused = true;
 
-				// calculate the paused ticks
-				mPausedTicks = SDL_GetTicks() - mStartTicks;
-				mStartTicks = 0;
+				// calculate the paused counts
+				mPausedCounts = SDL_GetPerformanceCounter() - mStartCounter;
+				mStartCounter = 0;
 			}
 		}
 
@@ -171,19 +310,19 @@ class LTimer
 				// unpause the timer
 				mPaused = false;
 
-				// reset the starting ticks
-				mStartTicks = SDL_GetTicks() - mPausedTicks;
+				// reset the starting counter
+				mStartCounter = SDL_GetPerformanceCounter() - mPausedCounts;
 				
-				// reset the paused ticks
-				mPausedTicks = 0;
+				// reset the paused counts
+				mPausedCounts = 0;
 			}
 		}
 
-		// Gets the timer's time
-		Uint32 getTicks()
+		// Gets the timer's time in raw performance counter units
+		Uint64 getCounts()
 		{
 			// the actual timer time
-			Uint32 time = 0;
+			Uint64 counts = 0;
 
 			// if the timer is running
 			if (mStarted)
@@ -191,17 +330,37 @@ class LTimer
 				// if the timer is paused
 				if (mPaused)
 				{
-					// return the number of ticks when the timer was paused
-					time = mPausedTicks;
+					// return the number of counts when the timer was paused
+					counts = mPausedCounts;
 				}
 				else 
 				{
-					// return the currrent time minus the start time
-					time = SDL_GetTicks() - mStartTicks;
+					// return the currrent counter minus the start counter
+					counts = SDL_GetPerformanceCounter() - mStartCounter;
 				}
 			}
 
-			return time;
+			return counts;
+		}
+
+		// Gets the timer's time in nanoseconds
+		Uint64 getNanos()
+		{
+			// split into whole seconds and the rest so counts * 1e9 can't overflow
+			Uint64 counts = getCounts();
+			return (counts / mFrequency) * 1000000000 + (counts % mFrequency) * 1000000000 / mFrequency;
+		}
+
+		// Gets the timer's time in seconds
+		double getSeconds()
+		{
+			return getCounts() / (double)mFrequency;
+		}
+
+		// Gets the timer's time in milliseconds
+		Uint32 getTicks()
+		{
+			return (Uint32)(getNanos() / 1000000);
 		}
 
 		// Checks the status of the timer
@@ -217,6 +376,213 @@ class LTimer
 			return mPaused;
 		}
 };
+// ========================== Frame Pacer Class (with implementation) ==========================
+class LFramePacer
+{
+	private:
+		// Performance counter ticks per second
+		Uint64 mFrequency;
+
+		// Target frame period
+		Uint64 mPeriodNanos;
+
+		// Counter value the schedule is measured from and frames paced since then
+		Uint64 mBaseCounter;
+		Uint64 mFrames;
+
+		// How much of the wait is spun instead of slept, jumps to an oversleep and eases back down after it,
+		// never more than half a period so the pacer always gets to sleep
+		Uint64 mSpinCounts;
+		Uint64 mMinSpinCounts;
+		Uint64 mMaxSpinCounts;
+
+		// Counter value when the last frame was released
+		Uint64 mLastCounter;
+
+		// Achieved periods of the most recent frames, in nanoseconds
+		std::vector<Uint64> mHistory;
+		int mHistoryIndex;
+		int mHistoryCount;
+
+		// How late the last frame was released relative to the ideal schedule
+		Sint64 mDriftNanos;
+
+		// Frames that missed their deadline and forced a new schedule
+		int mMissedFrames;
+
+		// Converts between performance counter units and nanoseconds
+		Uint64 toCounts(Uint64 nanos)
+		{
+			return (nanos / 1000000000) * mFrequency + (nanos % 1000000000) * mFrequency / 1000000000;
+		}
+
+		Uint64 toNanos(Uint64 counts)
+		{
+			return (counts / mFrequency) * 1000000000 + (counts % mFrequency) * 1000000000 / mFrequency;
+		}
+
+		// Counter value frame number frame is due at
+		Uint64 deadline(Uint64 frame)
+		{
+			return mBaseCounter + toCounts(frame * mPeriodNanos);
+		}
+
+	public:
+		// inits variables
+		LFramePacer(Uint64 periodNanos = SCREEN_NANOS_PER_FRAME, Uint64 spinNanos = PACER_SPIN_NANOS)
+		{
+			mFrequency = SDL_GetPerformanceFrequency();
+			mPeriodNanos = periodNanos;
+			mBaseCounter = 0;
+			mFrames = 0;
+			mMinSpinCounts = toCounts(std::min(PACER_MIN_SPIN_NANOS, periodNanos / 2));
+			mMaxSpinCounts = toCounts(periodNanos / 2);
+			mSpinCounts = std::max(std::min(toCounts(spinNanos), mMaxSpinCounts), mMinSpinCounts);
+			mLastCounter = 0;
+
+			mHistory.resize(PACER_HISTORY);
+			mHistoryIndex = 0;
+			mHistoryCount = 0;
+
+			mDriftNanos = 0;
+			mMissedFrames = 0;
+		}
+
+		void start()
+		{
+			// the schedule starts now
+			mBaseCounter = SDL_GetPerformanceCounter();
+			mLastCounter = mBaseCounter;
+			mFrames = 0;
+
+			mHistoryIndex = 0;
+			mHistoryCount = 0;
+			mDriftNanos = 0;
+			mMissedFrames = 0;
+		}
+
+		// Blocks until the next frame is due, call once at the end of every frame
+		void wait()
+		{
+			Uint64 due = deadline(mFrames + 1);
+			Uint64 now = SDL_GetPerformanceCounter();
+
+			if (now < due)
+			{
+				// sleep through the bulk of the wait, the OS can't be trusted with the last slice
+				if (due - now > mSpinCounts)
+				{
+					Uint32 sleepMs = (Uint32)((due - now - mSpinCounts) * 1000 / mFrequency);
+					if (sleepMs > 0)
+					{
+						Uint64 wake = now + sleepMs * mFrequency / 1000;
+						SDL_Delay(sleepMs);
+
+						// cover an oversleep straight away, then decay back towards what the OS really does
+						now = SDL_GetPerformanceCounter();
+						Uint64 overslept = now > wake ? now - wake : 0;
+						if (overslept > mSpinCounts)
+						{
+							mSpinCounts = overslept;
+						}
+						else
+						{
+							mSpinCounts -= (mSpinCounts - overslept) / PACER_SPIN_DECAY;
+						}
+						mSpinCounts = std::max(std::min(mSpinCounts, mMaxSpinCounts), mMinSpinCounts);
+					}
+				}
+
+				// spin out the rest
+				while (now < due)
+				{
+					now = SDL_GetPerformanceCounter();
+				}
+				++mFrames;
+			}
+			else if (now - due > toCounts(mPeriodNanos))
+			{
+				// more than a whole frame late, start a fresh schedule instead of rushing frames out to catch up
+				mBaseCounter = now;
+				mFrames = 0;
+				due = now;
+				++mMissedFrames;
+			}
+			else
+			{
+				// a little late, the next deadline absorbs it
+				++mFrames;
+			}
+
+			// remember how long this frame really took
+			mHistory[mHistoryIndex] = toNanos(now - mLastCounter);
+			mHistoryIndex = (mHistoryIndex + 1) % PACER_HISTORY;
+			if (mHistoryCount < PACER_HISTORY)
+			{
+				++mHistoryCount;
+			}
+			mLastCounter = now;
+
+			// how far off the ideal schedule this frame went out
+			mDriftNanos = now >= due ? (Sint64)toNanos(now - due) : -(Sint64)toNanos(due - now);
+		}
+
+		// Gets a percentile (0 to 100) of the recent achieved frame periods
+		Uint64 getPeriodPercentileNanos(double percentile)
+		{
+			if (mHistoryCount == 0)
+			{
+				return 0;
+			}
+
+			std::vector<Uint64> sorted(mHistory.begin(), mHistory.begin() + mHistoryCount);
+			std::sort(sorted.begin(), sorted.end());
+
+			int index = (int)(percentile / 100.0 * (mHistoryCount - 1) + 0.5);
+			return sorted[index];
+		}
+
+		// Gets the mean of the recent achieved frame periods
+		double getAveragePeriodNanos()
+		{
+			if (mHistoryCount == 0)
+			{
+				return 0.0;
+			}
+
+			double total = 0.0;
+			for (int i = 0; i < mHistoryCount; ++i)
+			{
+				total += mHistory[i];
+			}
+			return total / mHistoryCount;
+		}
+
+		Sint64 getDriftNanos()
+		{
+			return mDriftNanos;
+		}
+
+		int getMissedFrames()
+		{
+			return mMissedFrames;
+		}
+
+		Uint64 getPeriodNanos()
+		{
+			return mPeriodNanos;
+		}
+
+		// Prints target vs achieved period and the jitter around it
+		void printReport()
+		{
+			double average = getAveragePeriodNanos();
+			printf("frame pacer: target %.3f ms, achieved %.3f ms (%.2f FPS) over the last %d frames\n", mPeriodNanos / 1000000.0, average / 1000000.0, average > 0 ? 1000000000.0 / average : 0.0, mHistoryCount);
+			printf("period ms: p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n", getPeriodPercentileNanos(50) / 1000000.0, getPeriodPercentileNanos(95) / 1000000.0, getPeriodPercentileNanos(99) / 1000000.0, getPeriodPercentileNanos(100) / 1000000.0);
+			printf("drift %.3f ms, spin slice %.3f ms, %d missed deadlines\n", mDriftNanos / 1000000.0, toNanos(mSpinCounts) / 1000000.0, mMissedFrames);
+		}
+};
+
 // ========================== Global Variables ==========================
 // The window we are going to render to
 SDL_Window* gWindow = NULL;
@@ -227,8 +593,14 @@ SDL_Renderer* gRenderer = NULL;
 // globally used font
 TTF_Font* gFont = NULL;
 
-// Time texture and prompt textures 
-LTexture gTimeTexture;
+// glyphs of every font, for text that changes each frame
+LGlyphAtlas gGlyphAtlas;
+int gFontGlyphs = -1;
+
+// smaller size of the same font, packed into the same atlas
+TTF_Font* gSmallFont = NULL;
+int gSmallFontGlyphs = -1;
+
 
 // Global key textures
 LTexture gUpTexture;
@@ -242,6 +614,169 @@ LTexture gButtonSpriteSheetTexture;
 SDL_Rect gButtonClips[TOTAL_BUTTONS];
 LButton gButtons[TOTAL_BUTTONS];
 
+// ========================== Frame Statistics Class (with implementation) ==========================
+class LFrameStats
+{
+	private:
+		// Nanoseconds spent in each phase of one frame, the last slot is the whole frame
+		struct Record
+		{
+			Uint64 nanos[FRAME_PHASE_TOTAL + 1];
+		};
+
+		// Performance counter ticks per second
+		Uint64 mFrequency;
+
+		// Counter values when the frame and the current phase began
+		Uint64 mFrameStart;
+		Uint64 mPhaseStart;
+
+		// The frame being timed
+		Record mCurrent;
+
+		// Ring of the most recent frames, written at mFrames % FRAME_STATS_LOG
+		std::vector<Record> mRecords;
+		Uint64 mFrames;
+
+		// Reused when picking percentiles so queries don't allocate
+		std::vector<Uint64> mScratch;
+
+		// Overlay text and the frame it was last built on
+		char mOverlay[FRAME_PHASE_TOTAL + 1][FRAME_STATS_LINE];
+		Uint64 mOverlayFrame;
+
+		Uint64 toNanos(Uint64 counts)
+		{
+			return (counts / mFrequency) * 1000000000 + (counts % mFrequency) * 1000000000 / mFrequency;
+		}
+
+	public:
+		// inits variables
+		LFrameStats()
+		{
+			mFrequency = SDL_GetPerformanceFrequency();
+			mFrameStart = 0;
+			mPhaseStart = 0;
+			memset(&mCurrent, 0, sizeof(mCurrent));
+
+			mRecords.resize(FRAME_STATS_LOG);
+			mFrames = 0;
+			mScratch.reserve(FRAME_STATS_WINDOW);
+
+			memset(mOverlay, 0, sizeof(mOverlay));
+			mOverlayFrame = 0;
+		}
+
+		void start()
+		{
+			// the first frame begins now
+			mFrameStart = SDL_GetPerformanceCounter();
+			mPhaseStart = mFrameStart;
+			memset(&mCurrent, 0, sizeof(mCurrent));
+			mFrames = 0;
+			mOverlayFrame = 0;
+		}
+
+		// Charges the time since the last mark to a phase
+		void mark(LFramePhase phase)
+		{
+			Uint64 now = SDL_GetPerformanceCounter();
+			mCurrent.nanos[phase] += toNanos(now - mPhaseStart);
+			mPhaseStart = now;
+		}
+
+		// Records the frame and starts timing the next one
+		void endFrame()
+		{
+			Uint64 now = SDL_GetPerformanceCounter();
+			mCurrent.nanos[FRAME_PHASE_TOTAL] = toNanos(now - mFrameStart);
+
+			mRecords[mFrames % FRAME_STATS_LOG] = mCurrent;
+			++mFrames;
+
+			memset(&mCurrent, 0, sizeof(mCurrent));
+			mFrameStart = now;
+			mPhaseStart = now;
+		}
+
+		// Gets a percentile (0 to 100) of a phase, or of whole frames with FRAME_PHASE_TOTAL, over the recent window
+		Uint64 getPercentileNanos(int phase, double percentile)
+		{
+			int count = mFrames < FRAME_STATS_WINDOW ? (int)mFrames : FRAME_STATS_WINDOW;
+			if (count == 0)
+			{
+				return 0;
+			}
+
+			// copy the window out, newest frames last
+			mScratch.clear();
+			for (Uint64 frame = mFrames - count; frame < mFrames; ++frame)
+			{
+				mScratch.push_back(mRecords[frame % FRAME_STATS_LOG].nanos[phase]);
+			}
+
+			// only the requested rank has to end up in place
+			int index = (int)(percentile / 100.0 * (count - 1) + 0.5);
+			std::nth_element(mScratch.begin(), mScratch.begin() + index, mScratch.end());
+			return mScratch[index];
+		}
+
+		Uint64 getFrameCount()
+		{
+			return mFrames;
+		}
+
+		// Draws p50/p95/p99/max of every phase with the small font, rebuilding the text now and then so it stays readable
+		void renderOverlay(int x, int y, SDL_Color color)
+		{
+			static const char* names[FRAME_PHASE_TOTAL + 1] = {"events", "update", "render", "present", "wait", "frame"};
+
+			if (mOverlay[0][0] == '\0' || mFrames - mOverlayFrame >= FRAME_STATS_REFRESH)
+			{
+				for (int phase = 0; phase <= FRAME_PHASE_TOTAL; ++phase)
+				{
+					snprintf(mOverlay[phase], FRAME_STATS_LINE, "%-8s p50 %6.3f  p95 %6.3f  p99 %6.3f  max %6.3f ms", names[phase],
+						getPercentileNanos(phase, 50) / 1000000.0, getPercentileNanos(phase, 95) / 1000000.0,
+						getPercentileNanos(phase, 99) / 1000000.0, getPercentileNanos(phase, 100) / 1000000.0);
+				}
+				mOverlayFrame = mFrames;
+			}
+
+			int lineHeight = gGlyphAtlas.getLineHeight(gSmallFontGlyphs);
+			for (int phase = 0; phase <= FRAME_PHASE_TOTAL; ++phase)
+			{
+				gGlyphAtlas.renderText(gSmallFontGlyphs, x, y + phase * lineHeight, mOverlay[phase], color);
+			}
+		}
+
+		// Writes every logged frame, oldest first, as milliseconds per phase
+		bool dumpCSV(const char* path)
+		{
+			FILE* file = fopen(path, "w");
+			if (file == NULL)
+			{
+				printf("Unable to open %s for frame statistics!\n", path);
+				return false;
+			}
+
+			fprintf(file, "frame,events_ms,update_ms,render_ms,present_ms,wait_ms,total_ms\n");
+			Uint64 first = mFrames > FRAME_STATS_LOG ? mFrames - FRAME_STATS_LOG : 0;
+			for (Uint64 frame = first; frame < mFrames; ++frame)
+			{
+				Record& record = mRecords[frame % FRAME_STATS_LOG];
+				fprintf(file, "%llu", (unsigned long long)frame);
+				for (int phase = 0; phase <= FRAME_PHASE_TOTAL; ++phase)
+				{
+					fprintf(file, ",%.6f", record.nanos[phase] / 1000000.0);
+				}
+				fprintf(file, "\n");
+			}
+
+			fclose(file);
+			return true;
+		}
+};
+
 // ========================== Button Wrapper Class Function Definitions ==========================
 LButton::LButton()
 {
@@ -323,6 +858,144 @@ void LButton::render()
 }
 
 // ========================== Texture Wrapper Class Function Definitions ==========================
+// The kernels clear every pixel of an ARGB8888 row whose color matches the key, alpha ignored the way SDL
+// compares it. Cleared pixels are transparent black, which reads the same straight or premultiplied.
+void keyRowScalar(Uint32* pixels, int width, Uint32 key)
+{
+	for (int x = 0; x < width; ++x)
+	{
+		if ((pixels[x] & 0x00FFFFFF) == key)
+		{
+			pixels[x] = 0;
+		}
+	}
+}
+
+#if KEY_X86
+__attribute__((target("sse2")))
+void keyRowSse2(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step: compare the color bits, then and the matches away
+	const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+	const __m128i keyColor = _mm_set1_epi32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		__m128i color = _mm_loadu_si128((const __m128i*)(pixels + x));
+		__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(color, colorMask), keyColor);
+		_mm_storeu_si128((__m128i*)(pixels + x), _mm_andnot_si128(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+
+__attribute__((target("avx2")))
+void keyRowAvx2(Uint32* pixels, int width, Uint32 key)
+{
+	// eight pixels a step
+	const __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+	const __m256i keyColor = _mm256_set1_epi32(key);
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		__m256i color = _mm256_loadu_si256((const __m256i*)(pixels + x));
+		__m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(color, colorMask), keyColor);
+		_mm256_storeu_si256((__m256i*)(pixels + x), _mm256_andnot_si256(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+#if KEY_NEON
+void keyRowNeon(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step, NEON is always there on AArch64
+	const uint32x4_t colorMask = vdupq_n_u32(0x00FFFFFF);
+	const uint32x4_t keyColor = vdupq_n_u32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		uint32x4_t color = vld1q_u32(pixels + x);
+		uint32x4_t keyed = vceqq_u32(vandq_u32(color, colorMask), keyColor);
+		vst1q_u32(pixels + x, vbicq_u32(color, keyed));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+SDL_Surface* LTexture::loadKeyedSurface(std::string path)
+{
+	SDL_Surface* loadedSurface = IMG_Load(path.c_str());
+	if (loadedSurface == NULL)
+	{
+		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		return NULL;
+	}
+
+	// one conversion to the format the kernels work on, which SDL would have done making the texture anyway
+	SDL_Surface* keyedSurface = SDL_ConvertSurfaceFormat(loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(loadedSurface);
+	if (keyedSurface == NULL)
+	{
+		printf("Unable to convert image %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+		return NULL;
+	}
+
+	// and one pass to key it
+	keySurface(keyedSurface, getBestKeySimd());
+	return keyedSurface;
+}
+
+void LTexture::keySurface(SDL_Surface* surface, LKeySimd simd)
+{
+	Uint32 key = SDL_MapRGB(surface->format, 0, 0xFF, 0xFF) & 0x00FFFFFF;
+	for (int y = 0; y < surface->h; ++y)
+	{
+		Uint32* row = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch);
+		switch (simd)
+		{
+			#if KEY_X86
+			case KEY_SIMD_AVX2: keyRowAvx2(row, surface->w, key); break;
+			case KEY_SIMD_SSE2: keyRowSse2(row, surface->w, key); break;
+			#endif
+			#if KEY_NEON
+			case KEY_SIMD_NEON: keyRowNeon(row, surface->w, key); break;
+			#endif
+			default: keyRowScalar(row, surface->w, key); break;
+		}
+	}
+
+	// converted RGB images start out unblended, and the keyed pixels only vanish when the texture blends
+	SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_BLEND);
+}
+
+LKeySimd LTexture::getBestKeySimd()
+{
+	#if KEY_X86
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return KEY_SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return KEY_SIMD_SSE2;
+	}
+	#elif KEY_NEON
+	return KEY_SIMD_NEON;
+	#endif
+	return KEY_SIMD_SCALAR;
+}
+
+const char* LTexture::getKeySimdName(LKeySimd simd)
+{
+	switch (simd)
+	{
+		case KEY_SIMD_AVX2: return "avx2";
+		case KEY_SIMD_SSE2: return "sse2";
+		case KEY_SIMD_NEON: return "neon";
+		default: return "scalar";
+	}
+}
+
 LTexture::LTexture()
 {
 	// initialize
@@ -345,17 +1018,14 @@ bool LTexture::loadFromFile(std::string path)
 	// create the texture
 	SDL_Texture* newTexture = NULL;
 
-	// first create a surface 
-	SDL_Surface* newSurface= IMG_Load(path.c_str());
+	// first create a surface, with the color key already turned into alpha
+	SDL_Surface* newSurface = loadKeyedSurface(path);
 	if (newSurface == NULL)
 	{
-		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		printf("Could not load image %s!\n", path.c_str()); 
 	}
 	else
 	{
-		// color key the image we load
-		SDL_SetColorKey(newSurface, SDL_TRUE, SDL_MapRGB(newSurface->format, 0, 0xFF, 0xFF));
-
 		// create texture from surface pixels
 		newTexture = SDL_CreateTextureFromSurface(gRenderer, newSurface);
 		if (newTexture == NULL) 
@@ -470,6 +1140,291 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
+// ========================== Glyph Atlas Class Function Definitions ==========================
+LGlyphAtlas::LGlyphAtlas()
+{
+	// initialize
+	mTexture = NULL;
+	mWidth = 0;
+	mHeight = 0;
+}
+
+LGlyphAtlas::~LGlyphAtlas()
+{
+	// deallocate
+	free();
+}
+
+int LGlyphAtlas::addFont(TTF_Font* font)
+{
+	if (font == NULL)
+	{
+		return -1;
+	}
+
+	Font newFont;
+	newFont.font = font;
+	newFont.lineHeight = TTF_FontLineSkip(font);
+	newFont.kerning.resize(GLYPH_COUNT * GLYPH_COUNT);
+
+	// glyphs are rendered white so any color can be applied at draw time
+	SDL_Color white = {0xFF, 0xFF, 0xFF, 0xFF};
+	for (int i = 0; i < GLYPH_COUNT; ++i)
+	{
+		Uint16 ch = GLYPH_FIRST + i;
+
+		// pen advance of the glyph
+		int minX, maxX, minY, maxY, advance;
+		newFont.glyphs[i].advance = 0;
+		if (TTF_GlyphMetrics(font, ch, &minX, &maxX, &minY, &maxY, &advance) == 0)
+		{
+			newFont.glyphs[i].advance = advance;
+		}
+
+		// blended so the edges end up in the alpha channel
+		newFont.surfaces[i] = TTF_RenderGlyph_Blended(font, ch, white);
+		newFont.glyphs[i].clip.x = 0;
+		newFont.glyphs[i].clip.y = 0;
+		newFont.glyphs[i].clip.w = 0;
+		newFont.glyphs[i].clip.h = 0;
+
+		// kerning against every glyph that can come before this one
+		for (int j = 0; j < GLYPH_COUNT; ++j)
+		{
+			newFont.kerning[j * GLYPH_COUNT + i] = TTF_GetFontKerningSizeGlyphs(font, GLYPH_FIRST + j, ch);
+		}
+	}
+
+	mFonts.push_back(newFont);
+	return mFonts.size() - 1;
+}
+
+bool LGlyphAtlas::build()
+{
+	// get rid of the old atlas, keeping the fonts
+	if (mTexture != NULL)
+	{
+		SDL_DestroyTexture(mTexture);
+		mTexture = NULL;
+	}
+
+	// place glyphs left to right on shelves, starting a new shelf when a row is full
+	int x = 0, y = 0, shelfHeight = 0;
+	for (int f = 0; f < (int)mFonts.size(); ++f)
+	{
+		for (int i = 0; i < GLYPH_COUNT; ++i)
+		{
+			SDL_Surface* surface = mFonts[f].surfaces[i];
+			if (surface == NULL)
+			{
+				continue;
+			}
+
+			if (x + surface->w > GLYPH_ATLAS_WIDTH)
+			{
+				x = 0;
+				y += shelfHeight + 1;
+				shelfHeight = 0;
+			}
+
+			SDL_Rect& clip = mFonts[f].glyphs[i].clip;
+			clip.x = x;
+			clip.y = y;
+			clip.w = surface->w;
+			clip.h = surface->h;
+
+			// leave a pixel between glyphs so filtering doesn't bleed
+			x += surface->w + 1;
+			if (surface->h > shelfHeight)
+			{
+				shelfHeight = surface->h;
+			}
+		}
+	}
+
+	// the atlas surface starts out fully transparent
+	SDL_Surface* atlasSurface = SDL_CreateRGBSurfaceWithFormat(0, GLYPH_ATLAS_WIDTH, y + shelfHeight, 32, SDL_PIXELFORMAT_RGBA32);
+	if (atlasSurface == NULL)
+	{
+		printf("Unable to create glyph atlas surface! SDL Error: %s\n", SDL_GetError());
+		return false;
+	}
+	SDL_FillRect(atlasSurface, NULL, 0);
+
+	// copy every glyph into its slot
+	for (int f = 0; f < (int)mFonts.size(); ++f)
+	{
+		for (int i = 0; i < GLYPH_COUNT; ++i)
+		{
+			SDL_Surface* surface = mFonts[f].surfaces[i];
+			if (surface == NULL)
+			{
+				continue;
+			}
+
+			// copy the alpha instead of blending it with the empty atlas
+			SDL_Rect destination = mFonts[f].glyphs[i].clip;
+			SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+			SDL_BlitSurface(surface, NULL, atlasSurface, &destination);
+
+			// the atlas holds it now
+			SDL_FreeSurface(surface);
+			mFonts[f].surfaces[i] = NULL;
+		}
+	}
+
+	// create texture from atlas pixels
+	mTexture = SDL_CreateTextureFromSurface(gRenderer, atlasSurface);
+	if (mTexture == NULL)
+	{
+		printf("Unable to create glyph atlas texture! SDL Error: %s\n", SDL_GetError());
+	}
+	else
+	{
+		SDL_SetTextureBlendMode(mTexture, SDL_BLENDMODE_BLEND);
+		mWidth = atlasSurface->w;
+		mHeight = atlasSurface->h;
+	}
+
+	// get rid of the atlas surface
+	SDL_FreeSurface(atlasSurface);
+
+	return mTexture != NULL;
+}
+
+int LGlyphAtlas::layoutText(int font, int x, int y, const char* text, SDL_Color color, bool draw)
+{
+	if (font < 0 || font >= (int)mFonts.size())
+	{
+		return 0;
+	}
+	Font& current = mFonts[font];
+
+	int penX = x;
+	int previous = -1;
+	for (const char* c = text; *c != '\0'; ++c)
+	{
+		// only printable ASCII is in the atlas
+		int index = (unsigned char)*c - GLYPH_FIRST;
+		if (index < 0 || index >= GLYPH_COUNT)
+		{
+			continue;
+		}
+
+		// pull the pair together (or apart) before placing the glyph
+		if (previous >= 0)
+		{
+			penX += current.kerning[previous * GLYPH_COUNT + index];
+		}
+
+		Glyph& glyph = current.glyphs[index];
+		if (draw && glyph.clip.w > 0)
+		{
+			// texture coordinates of the glyph
+			float u0 = glyph.clip.x / (float)mWidth;
+			float v0 = glyph.clip.y / (float)mHeight;
+			float u1 = (glyph.clip.x + glyph.clip.w) / (float)mWidth;
+			float v1 = (glyph.clip.y + glyph.clip.h) / (float)mHeight;
+
+			// corners in top left, top right, bottom right, bottom left order
+			float cornerX[4] = {(float)penX, (float)(penX + glyph.clip.w), (float)(penX + glyph.clip.w), (float)penX};
+			float cornerY[4] = {(float)y, (float)y, (float)(y + glyph.clip.h), (float)(y + glyph.clip.h)};
+			float cornerU[4] = {u0, u1, u1, u0};
+			float cornerV[4] = {v0, v0, v1, v1};
+			for (int i = 0; i < 4; ++i)
+			{
+				SDL_Vertex vertex;
+				vertex.position.x = cornerX[i];
+				vertex.position.y = cornerY[i];
+				vertex.color = color;
+				vertex.tex_coord.x = cornerU[i];
+				vertex.tex_coord.y = cornerV[i];
+				mVertices.push_back(vertex);
+			}
+		}
+
+		penX += glyph.advance;
+		previous = index;
+	}
+
+	return penX - x;
+}
+
+void LGlyphAtlas::renderText(int font, int x, int y, const char* text, SDL_Color color)
+{
+	layoutText(font, x, y, text, color, true);
+}
+
+int LGlyphAtlas::getTextWidth(int font, const char* text)
+{
+	SDL_Color unused = {0, 0, 0, 0};
+	return layoutText(font, 0, 0, text, unused, false);
+}
+
+int LGlyphAtlas::getLineHeight(int font)
+{
+	if (font < 0 || font >= (int)mFonts.size())
+	{
+		return 0;
+	}
+	return mFonts[font].lineHeight;
+}
+
+void LGlyphAtlas::flush()
+{
+	// nothing queued
+	if (mVertices.empty() || mTexture == NULL)
+	{
+		mVertices.clear();
+		return;
+	}
+
+	// make sure the index pattern covers every queued quad
+	int quads = mVertices.size() / 4;
+	while ((int)mIndices.size() < quads * 6)
+	{
+		int base = mIndices.size() / 6 * 4;
+		mIndices.push_back(base);
+		mIndices.push_back(base + 1);
+		mIndices.push_back(base + 2);
+		mIndices.push_back(base + 2);
+		mIndices.push_back(base + 3);
+		mIndices.push_back(base);
+	}
+
+	// every queued string in one call
+	SDL_RenderGeometry(gRenderer, mTexture, &mVertices[0], mVertices.size(), &mIndices[0], quads * 6);
+
+	// keep the allocation for the next frame
+	mVertices.clear();
+}
+
+void LGlyphAtlas::free()
+{
+	// free the texture if it exists
+	if (mTexture != NULL)
+	{
+		SDL_DestroyTexture(mTexture);
+		mTexture = NULL;
+		mWidth = 0;
+		mHeight = 0;
+	}
+
+	// free glyphs that never made it into an atlas
+	for (int f = 0; f < (int)mFonts.size(); ++f)
+	{
+		for (int i = 0; i < GLYPH_COUNT; ++i)
+		{
+			if (mFonts[f].surfaces[i] != NULL)
+			{
+				SDL_FreeSurface(mFonts[f].surfaces[i]);
+			}
+		}
+	}
+	mFonts.clear();
+	mVertices.clear();
+}
+
 // ========================== Function Delcarations ==========================
 // loads up SDL and creates window
 bool init();
@@ -552,8 +1507,25 @@ bool loadMedia()
 		printf("Failed to load lazy font! SDL_ttf Error: %s\n", TTF_GetError());
 		success = false;
 	}
+
+	// Open the small font
+	gSmallFont = TTF_OpenFont("media/lazy.ttf", 16);
+	if (gSmallFont == NULL)
+	{
+		printf("Failed to load small lazy font! SDL_ttf Error: %s\n", TTF_GetError());
+		success = false;
+	}
 	#endif
 
+	// rasterize both sizes once, the counter is drawn from the atlas every frame
+	gFontGlyphs = gGlyphAtlas.addFont(gFont);
+	gSmallFontGlyphs = gGlyphAtlas.addFont(gSmallFont);
+	if (gFontGlyphs < 0 || gSmallFontGlyphs < 0 || !gGlyphAtlas.build())
+	{
+		printf("Failed to build glyph atlas!\n");
+		success = false;
+	}
+
 	return success;
 }
 
@@ -563,11 +1535,13 @@ void close()
 	// they go out of scope and the destructor is automatically called, which is dope
 	// the only reason these are listed here is because they should be freed if they 
 	// weren't global resources 
-	gTimeTexture.free();
+	gGlyphAtlas.free();
 
-	// Free the global font
+	// Free the global fonts
 	TTF_CloseFont(gFont);
 	gFont = NULL;
+	TTF_CloseFont(gSmallFont);
+	gSmallFont = NULL;
 
 	// Destroy the window
 	SDL_DestroyRenderer(gRenderer);
@@ -595,6 +1569,21 @@ SDL_Texture* loadTexture(std::string path)
 
 int main( int argc, char* args[])
 { 
+	// --csv <file> dumps the logged frame times on exit, --uncapped runs without the pacer to measure the frame itself
+	const char* csvPath = NULL;
+	bool uncapped = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(args[i], "--csv") == 0 && i + 1 < argc)
+		{
+			csvPath = args[i + 1];
+		}
+		else if (strcmp(args[i], "--uncapped") == 0)
+		{
+			uncapped = true;
+		}
+	}
+
  	// start up SDL and create the window
 	if (!init())
 	{
@@ -617,25 +1606,24 @@ int main( int argc, char* args[])
 		// set text color as black
 		SDL_Color textColor = {0,0,0,255};
 
-		// frames per second timer 
-		LTimer fpsTimer;
+		// per frame timings and their percentiles
+		LFrameStats stats;
 
-		// the frames per second cap timer
-		LTimer capTimer;
+		// keeps the frames evenly spaced at the cap
+		LFramePacer pacer;
 
-		// In memory text stream
-		std::stringstream timeText;
+		// text buffers reused every frame
+		char timeText[64];
+		char frameText[64];
 
-		// start counting frames per second
+		// start counting frames
 		int countedFrames = 0;
-		fpsTimer.start();
+		stats.start();
+		pacer.start();
 
 		// The main loop of the game
 		while (!quit) 
 		{
-			// start the cap timer
-			capTimer.start();
-
 			// handle events on the queue
 			while (SDL_PollEvent(&e) != 0) 
 			{
@@ -645,42 +1633,55 @@ int main( int argc, char* args[])
 					quit = true;
 				}
 			}
+			stats.mark(FRAME_PHASE_EVENTS);
 
-			// Calculate and correct fps
-			float avgFps = countedFrames / (fpsTimer.getTicks() / 1000.f);
-			if (avgFps > 2000000)
-			{
-				avgFps = 0;
-			}
+			// frames per second from the median recent frame, so one slow frame can't hide in a lifetime average
+			Uint64 medianNanos = stats.getPercentileNanos(FRAME_PHASE_TOTAL, 50);
+			double fps = medianNanos > 0 ? 1000000000.0 / medianNanos : 0.0;
 
 			// set text to be rendered
-			timeText.str("");
-			timeText << "Average frames per second (with cap) " << avgFps; 
-
-			// render text
-			if (!gTimeTexture.loadFromRenderedText(timeText.str().c_str(), textColor))
-			{
-				printf("Unable to render time texture!\n");
-			}
+			snprintf(timeText, sizeof(timeText), "Frames per second (with cap) %.1f", fps);
+			snprintf(frameText, sizeof(frameText), "Frames rendered: %d", countedFrames);
+			stats.mark(FRAME_PHASE_UPDATE);
 
 			// Clear the screen
 			SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
 			SDL_RenderClear(gRenderer);
 
 			// render textures 
-			gTimeTexture.render((SCREEN_WIDTH - gTimeTexture.getWidth()) / 2, (SCREEN_HEIGHT - gTimeTexture.getHeight()) / 2);
+			int timeY = (SCREEN_HEIGHT - gGlyphAtlas.getLineHeight(gFontGlyphs)) / 2;
+			gGlyphAtlas.renderText(gFontGlyphs, (SCREEN_WIDTH - gGlyphAtlas.getTextWidth(gFontGlyphs, timeText)) / 2, timeY, timeText, textColor);
+			gGlyphAtlas.renderText(gSmallFontGlyphs, (SCREEN_WIDTH - gGlyphAtlas.getTextWidth(gSmallFontGlyphs, frameText)) / 2, timeY + gGlyphAtlas.getLineHeight(gFontGlyphs), frameText, textColor);
+			stats.renderOverlay(4, 4, textColor);
+
+			// every string goes out in one call, no textures created
+			gGlyphAtlas.flush();
+			stats.mark(FRAME_PHASE_RENDER);
 
 			// Update screen
 			SDL_RenderPresent(gRenderer);
 			++countedFrames;
+			stats.mark(FRAME_PHASE_PRESENT);
 
-			// if the frame finished early
-			int frameTicks = capTimer.getTicks();
-			if (frameTicks < SCREEN_TICKS_PER_FRAME)
+			// wait until the next frame is due
+			if (!uncapped)
 			{
-				// wait the remaining time
-				SDL_Delay(SCREEN_TICKS_PER_FRAME - frameTicks);
+				pacer.wait();
 			}
+			stats.mark(FRAME_PHASE_WAIT);
+			stats.endFrame();
+		}
+
+		// how well the cap held
+		if (!uncapped)
+		{
+			pacer.printReport();
+		}
+
+		// every logged frame for offline analysis
+		if (csvPath != NULL && stats.dumpCSV(csvPath))
+		{
+			printf("Wrote %llu frames of statistics to %s\n", (unsigned long long)SDL_min(stats.getFrameCount(), (Uint64)FRAME_STATS_LOG), csvPath);
 		}
 	}
 
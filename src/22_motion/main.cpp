@@ -4,7 +4,30 @@
 #include "SDL2/SDL_ttf.h"
 #include <stdio.h>
 #include <string>
+#include <string.h>
+#include <stdlib.h>
 #include <sstream>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+// the dot system's and the color key kernel's SSE2/AVX2 paths are x86 only, everything else uses the scalar code
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DOTS_X86 1
+#define KEY_X86 1
+#else
+#define DOTS_X86 0
+#define KEY_X86 0
+#endif
+
+// the color key kernel also has a NEON path, always there on AArch64
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define KEY_NEON 1
+#else
+#define KEY_NEON 0
+#endif
 
 // ========================== Constants and Enums ==========================
 // screen constants
@@ -13,6 +36,27 @@ const int SCREEN_HEIGHT = 480;
 const int SCREEN_FPS = 60;
 const int SCREEN_TICKS_PER_FRAME = 1000 / SCREEN_FPS;
 
+// Simulation constants
+const int SIMULATION_TICK_RATE = 120;
+const int MAX_CATCH_UP_TICKS = 8;
+
+// Headless throughput run constants
+const int HEADLESS_TICKS = 10000;
+const int HEADLESS_DOTS = 10000;
+
+// Dot system constants, arrays are padded to whole AVX vectors
+const int DOT_SIMD_WIDTH = 8;
+const int DOT_BENCH_COUNT = 1000000;
+const int DOT_BENCH_TICKS = 200;
+
+// Job system constants, in AVX vectors of dots
+const int DOT_JOB_GRAIN = 2048;
+
+// Input log constants
+const char INPUT_LOG_MAGIC[4] = {'L', 'R', 'E', 'C'};
+const Uint32 INPUT_LOG_VERSION = 1;
+const Uint32 INPUT_RECORD_TICKS = 0;
+
 // Button constants
 const int BUTTON_WIDTH = 300; 
 const int BUTTON_HEIGHT = 200;
@@ -27,6 +71,15 @@ enum LButtonSprite
 	BUTTON_SPRITE_TOTAL
 };
 
+// the color key kernel code paths, best one picked at runtime
+enum LKeySimd
+{
+	KEY_SIMD_SCALAR,
+	KEY_SIMD_SSE2,
+	KEY_SIMD_AVX2,
+	KEY_SIMD_NEON
+};
+
 // ========================== Button Wrapper Class ==========================
 class LButton
 {
@@ -64,6 +117,16 @@ class LTexture
         // Loads image at specified path
         bool loadFromFile(std::string path);
 
+        // Loads an image as ARGB8888 with the cyan color key pixels already transparent, the caller frees it
+        static SDL_Surface* loadKeyedSurface(std::string path);
+
+        // Makes every color key pixel of an ARGB8888 surface transparent black in place, and has it blend
+        static void keySurface(SDL_Surface* surface, LKeySimd simd);
+
+        // the color key code paths
+        static LKeySimd getBestKeySimd();
+        static const char* getKeySimdName(LKeySimd simd);
+
 		#if defined(SDL_TTF_MAJOR_VERSION)
 		// Loads image from font string
 		bool loadFromRenderedText(std::string textureText, SDL_Color textColor);
@@ -88,6 +151,9 @@ class LTexture
         int getWidth();
         int getHeight();
 
+        // the texture itself, for drawing it outside of render
+        SDL_Texture* getTexture();
+
     private:
         // the actual texture hardware
         SDL_Texture* mTexture;
@@ -101,11 +167,14 @@ class LTexture
 class LTimer
 {
 	private:
-		// The clock time when the timer started
-		Uint32 mStartTicks;
+		// The performance counter value when the timer started
+		Uint64 mStartCounter;
+
+		// The counts stored when the timer was paused
+		Uint64 mPausedCounts;
 
-		// The ticks stored when the timer was paused
-		Uint32 mPausedTicks;
+		// Performance counter ticks per second
+		Uint64 mFrequency;
 
 		// The timer status
 		bool mPaused;
@@ -116,8 +185,9 @@ class LTimer
 		LTimer()
 		{
 			// initialize the varaibles
-			mStartTicks = 0;
-			mPausedTicks = 0;
+			mStartCounter = 0;
+			mPausedCounts = 0;
+			mFrequency = SDL_GetPerformanceFrequency();
 
 			mPaused = false;
 			mStarted = false;
@@ -132,8 +202,8 @@ class LTimer
 			mPaused = false;
 
 			// get the current clock time
-			mStartTicks = SDL_GetTicks();
-			mPausedTicks = 0;
+			mStartCounter = SDL_GetPerformanceCounter();
+			mPausedCounts = 0;
 		}
 
 		void stop()
@@ -144,9 +214,9 @@ class LTimer
 			// Unpause the timer
 			mPaused = false;
 
-			// clear the tick vars
-			mStartTicks = 0;
-			mPausedTicks = 0;
+			// clear the counter vars
+			mStartCounter = 0;
+			mPausedCounts = 0;
 		}
 
 		void pause()
@@ -157,9 +227,9 @@ class LTimer
 				// pause the timer
 				mPaused = true;
 
-				// calculate the paused ticks
-				mPausedTicks = SDL_GetTicks() - mStartTicks;
-				mStartTicks = 0;
+				// calculate the paused counts
+				mPausedCounts = SDL_GetPerformanceCounter() - mStartCounter;
+				mStartCounter = 0;
 			}
 		}
 
@@ -171,19 +241,19 @@ class LTimer
 				// unpause the timer
 				mPaused = false;
 
-				// reset the starting ticks
-				mStartTicks = SDL_GetTicks() - mPausedTicks;
+				// reset the starting counter
+				mStartCounter = SDL_GetPerformanceCounter() - mPausedCounts;
 				
-				// reset the paused ticks
-				mPausedTicks = 0;
+				// reset the paused counts
+				mPausedCounts = 0;
 			}
 		}
 
-		// Gets the timer's time
-		Uint32 getTicks()
+		// Gets the timer's time in raw performance counter units
+		Uint64 getCounts()
 		{
 			// the actual timer time
-			Uint32 time = 0;
+			Uint64 counts = 0;
 
 			// if the timer is running
 			if (mStarted)
@@ -191,17 +261,37 @@ class LTimer
 				// if the timer is paused
 				if (mPaused)
 				{
-					// return the number of ticks when the timer was paused
-					time = mPausedTicks;
+					// return the number of counts when the timer was paused
+					counts = mPausedCounts;
 				}
 				else 
 				{
-					// return the currrent time minus the start time
-					time = SDL_GetTicks() - mStartTicks;
+					// return the currrent counter minus the start counter
+					counts = SDL_GetPerformanceCounter() - mStartCounter;
 				}
 			}
 
-			return time;
+			return counts;
+		}
+
+		// Gets the timer's time in nanoseconds
+		Uint64 getNanos()
+		{
+			// split into whole seconds and the rest so counts * 1e9 can't overflow
+			Uint64 counts = getCounts();
+			return (counts / mFrequency) * 1000000000 + (counts % mFrequency) * 1000000000 / mFrequency;
+		}
+
+		// Gets the timer's time in seconds
+		double getSeconds()
+		{
+			return getCounts() / (double)mFrequency;
+		}
+
+		// Gets the timer's time in milliseconds
+		Uint32 getTicks()
+		{
+			return (Uint32)(getNanos() / 1000000);
 		}
 
 		// Checks the status of the timer
@@ -217,6 +307,638 @@ class LTimer
 			return mPaused;
 		}
 };
+// ========================== Fixed Timestep Class (with implementation) ==========================
+class LFixedTimestep
+{
+	private:
+		// Performance counter frequency, the length of one second
+		Uint64 mFrequency;
+
+		// The counter value at the last advance
+		Uint64 mLastCounter;
+
+		// Unsimulated time, in counter units times the tick rate so a tick is exactly mFrequency
+		Uint64 mAccumulator;
+
+		// Ticks per second and the most ticks a single frame may run
+		int mTickRate;
+		int mMaxCatchUpTicks;
+
+		// Ticks thrown away because a frame fell too far behind
+		Uint64 mDroppedTicks;
+
+	public:
+		// inits variables
+		LFixedTimestep(int tickRate = SIMULATION_TICK_RATE, int maxCatchUpTicks = MAX_CATCH_UP_TICKS)
+		{
+			mFrequency = SDL_GetPerformanceFrequency();
+			mLastCounter = 0;
+			mAccumulator = 0;
+
+			mTickRate = tickRate;
+			mMaxCatchUpTicks = maxCatchUpTicks;
+
+			mDroppedTicks = 0;
+		}
+
+		void start()
+		{
+			// start counting from now with nothing owed
+			mLastCounter = SDL_GetPerformanceCounter();
+			mAccumulator = 0;
+			mDroppedTicks = 0;
+		}
+
+		// Adds the time since the last call and returns how many ticks to simulate this frame
+		int advance()
+		{
+			Uint64 now = SDL_GetPerformanceCounter();
+			mAccumulator += (now - mLastCounter) * mTickRate;
+			mLastCounter = now;
+
+			// whole ticks owed
+			Uint64 ticks = mAccumulator / mFrequency;
+			mAccumulator -= ticks * mFrequency;
+
+			// a long stall shouldn't make the simulation spiral trying to catch up
+			if (ticks > (Uint64)mMaxCatchUpTicks)
+			{
+				mDroppedTicks += ticks - mMaxCatchUpTicks;
+				ticks = mMaxCatchUpTicks;
+			}
+
+			return (int)ticks;
+		}
+
+		// How far between the previous and current tick we are, from 0 to 1
+		float getAlpha()
+		{
+			return mAccumulator / (float)mFrequency;
+		}
+
+		// Simulated time per tick
+		float getTickSeconds()
+		{
+			return 1.f / mTickRate;
+		}
+
+		int getTickRate()
+		{
+			return mTickRate;
+		}
+
+		Uint64 getDroppedTicks()
+		{
+			return mDroppedTicks;
+		}
+};
+
+// ========================== Input Recorder Class (with implementation) ==========================
+// log layout: the header, then one record per event and one per frame with the ticks it simulated
+struct LInputHeader
+{
+	char magic[4];
+	Uint32 version;
+	Uint32 tickRate;
+};
+
+struct LInputRecord
+{
+	// the frame the event was polled on
+	Uint32 frame;
+
+	// the SDL event type, or INPUT_RECORD_TICKS
+	Uint32 type;
+
+	// the fields the event type needs, see pack()
+	Sint32 data[5];
+};
+
+class LInputRecorder
+{
+	private:
+		// the log being written, or everything read back from one
+		FILE* mFile;
+		std::vector<LInputRecord> mRecords;
+		int mNext;
+
+		bool mRecording;
+		bool mReplaying;
+
+		// frames since recording or replay started
+		Uint32 mFrame;
+
+		// how long each replayed frame took
+		std::vector<Uint64> mFrameCounts;
+		Uint64 mFrameStart;
+
+		// only input worth replaying goes in the log, the rest is window noise
+		static bool pack(const SDL_Event& e, LInputRecord& record)
+		{
+			memset(record.data, 0, sizeof(record.data));
+			record.type = e.type;
+			switch (e.type)
+			{
+				case SDL_KEYDOWN:
+				case SDL_KEYUP:
+				record.data[0] = e.key.keysym.sym;
+				record.data[1] = e.key.keysym.scancode;
+				record.data[2] = e.key.keysym.mod;
+				record.data[3] = e.key.repeat;
+				record.data[4] = e.key.state;
+				return true;
+
+				case SDL_MOUSEMOTION:
+				record.data[0] = e.motion.x;
+				record.data[1] = e.motion.y;
+				record.data[2] = e.motion.xrel;
+				record.data[3] = e.motion.yrel;
+				record.data[4] = e.motion.state;
+				return true;
+
+				case SDL_MOUSEBUTTONDOWN:
+				case SDL_MOUSEBUTTONUP:
+				record.data[0] = e.button.x;
+				record.data[1] = e.button.y;
+				record.data[2] = e.button.button;
+				record.data[3] = e.button.state;
+				record.data[4] = e.button.clicks;
+				return true;
+
+				case SDL_QUIT:
+				return true;
+			}
+
+			return false;
+		}
+
+		static void unpack(const LInputRecord& record, SDL_Event& e)
+		{
+			memset(&e, 0, sizeof(e));
+			e.type = record.type;
+			switch (record.type)
+			{
+				case SDL_KEYDOWN:
+				case SDL_KEYUP:
+				e.key.keysym.sym = record.data[0];
+				e.key.keysym.scancode = (SDL_Scancode)record.data[1];
+				e.key.keysym.mod = record.data[2];
+				e.key.repeat = record.data[3];
+				e.key.state = record.data[4];
+				break;
+
+				case SDL_MOUSEMOTION:
+				e.motion.x = record.data[0];
+				e.motion.y = record.data[1];
+				e.motion.xrel = record.data[2];
+				e.motion.yrel = record.data[3];
+				e.motion.state = record.data[4];
+				break;
+
+				case SDL_MOUSEBUTTONDOWN:
+				case SDL_MOUSEBUTTONUP:
+				e.button.x = record.data[0];
+				e.button.y = record.data[1];
+				e.button.button = record.data[2];
+				e.button.state = record.data[3];
+				e.button.clicks = record.data[4];
+				break;
+			}
+		}
+
+	public:
+		// inits variables
+		LInputRecorder()
+		{
+			mFile = NULL;
+			mNext = 0;
+			mRecording = false;
+			mReplaying = false;
+			mFrame = 0;
+			mFrameStart = 0;
+		}
+
+		~LInputRecorder()
+		{
+			stop();
+		}
+
+		// starts logging every polled event to a file
+		bool startRecording(std::string path, int tickRate)
+		{
+			stop();
+
+			mFile = fopen(path.c_str(), "wb");
+			if (mFile == NULL)
+			{
+				printf("Unable to write input log %s!\n", path.c_str());
+				return false;
+			}
+
+			LInputHeader header;
+			memcpy(header.magic, INPUT_LOG_MAGIC, sizeof(header.magic));
+			header.version = INPUT_LOG_VERSION;
+			header.tickRate = tickRate;
+			fwrite(&header, sizeof(header), 1, mFile);
+
+			mRecording = true;
+			mFrame = 0;
+			return true;
+		}
+
+		// loads a log to feed back in, returns the tick rate it was recorded at
+		int startReplay(std::string path)
+		{
+			stop();
+
+			FILE* file = fopen(path.c_str(), "rb");
+			if (file == NULL)
+			{
+				printf("Unable to read input log %s!\n", path.c_str());
+				return 0;
+			}
+
+			LInputHeader header;
+			if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, INPUT_LOG_MAGIC, sizeof(header.magic)) != 0 || header.version != INPUT_LOG_VERSION)
+			{
+				printf("%s is not an input log!\n", path.c_str());
+				fclose(file);
+				return 0;
+			}
+
+			LInputRecord record;
+			while (fread(&record, sizeof(record), 1, file) == 1)
+			{
+				mRecords.push_back(record);
+			}
+			fclose(file);
+
+			mReplaying = true;
+			mNext = 0;
+			mFrame = 0;
+			mFrameCounts.clear();
+			mFrameStart = SDL_GetPerformanceCounter();
+			return header.tickRate;
+		}
+
+		// closes the log
+		void stop()
+		{
+			if (mFile != NULL)
+			{
+				fclose(mFile);
+				mFile = NULL;
+			}
+			mRecords.clear();
+			mRecording = false;
+			mReplaying = false;
+		}
+
+		// call before polling, a replay pushes this frame's events into the queue
+		void beginFrame()
+		{
+			while (mReplaying && mNext < (int)mRecords.size() && mRecords[mNext].frame == mFrame && mRecords[mNext].type != INPUT_RECORD_TICKS)
+			{
+				SDL_Event e;
+				unpack(mRecords[mNext++], e);
+				SDL_PushEvent(&e);
+			}
+		}
+
+		// logs a polled event
+		void record(const SDL_Event& e)
+		{
+			LInputRecord record;
+			if (mRecording && pack(e, record))
+			{
+				record.frame = mFrame;
+				fwrite(&record, sizeof(record), 1, mFile);
+			}
+		}
+
+		// the ticks to simulate this frame: logs the live count, or hands back the logged one on a replay
+		int syncTicks(int ticks)
+		{
+			if (mRecording)
+			{
+				LInputRecord record;
+				memset(&record, 0, sizeof(record));
+				record.frame = mFrame;
+				record.type = INPUT_RECORD_TICKS;
+				record.data[0] = ticks;
+				fwrite(&record, sizeof(record), 1, mFile);
+			}
+			else if (mReplaying)
+			{
+				ticks = 0;
+				if (mNext < (int)mRecords.size() && mRecords[mNext].frame == mFrame && mRecords[mNext].type == INPUT_RECORD_TICKS)
+				{
+					ticks = mRecords[mNext++].data[0];
+				}
+			}
+
+			return ticks;
+		}
+
+		// call after presenting
+		void endFrame()
+		{
+			if (mReplaying)
+			{
+				Uint64 now = SDL_GetPerformanceCounter();
+				mFrameCounts.push_back(now - mFrameStart);
+				mFrameStart = now;
+			}
+			++mFrame;
+		}
+
+		bool isReplaying()
+		{
+			return mReplaying;
+		}
+
+		// every logged record has been played back
+		bool isFinished()
+		{
+			return mReplaying && mNext >= (int)mRecords.size();
+		}
+
+		// frame times of the replay so far, to compare between builds
+		void printReplayStats()
+		{
+			if (mFrameCounts.empty())
+			{
+				return;
+			}
+
+			std::vector<Uint64> sorted(mFrameCounts);
+			std::sort(sorted.begin(), sorted.end());
+			Uint64 total = 0;
+			for (int i = 0; i < (int)sorted.size(); ++i)
+			{
+				total += sorted[i];
+			}
+
+			double toMs = 1000.0 / SDL_GetPerformanceFrequency();
+			printf("replayed %d frames in %.3f s: mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", (int)sorted.size(), total * toMs / 1000.0,
+				total * toMs / sorted.size(), sorted[sorted.size() / 2] * toMs, sorted[sorted.size() * 99 / 100] * toMs, sorted.back() * toMs);
+		}
+};
+
+// ========================== Job System Class (with implementation) ==========================
+// runs items [begin, end) of a parallel for
+typedef void (*LJobFunction)(void* data, int begin, int end);
+
+class LJobSystem
+{
+	private:
+		// a range of a parallel for, split in half until it's no bigger than the grain
+		struct Job
+		{
+			LJobFunction function;
+			void* data;
+			int begin;
+			int end;
+			int grain;
+			SDL_atomic_t* remaining;
+		};
+
+		// every thread owns a deque, it pushes and pops at the back and the others steal from the front
+		struct Worker
+		{
+			LJobSystem* system;
+			int index;
+			SDL_Thread* thread;
+			SDL_mutex* lock;
+			std::deque<Job> jobs;
+
+			// ranges this thread ran, and how many of them it took from someone else
+			SDL_atomic_t executed;
+			SDL_atomic_t stolen;
+		};
+
+		// worker 0 is whoever calls parallelFor, it has no thread of its own
+		std::vector<Worker*> mWorkers;
+
+		// posted for every range pushed, idle workers sleep on it
+		SDL_sem* mWake;
+		SDL_atomic_t mQuit;
+
+		void push(int index, const Job& job)
+		{
+			Worker* worker = mWorkers[index];
+			SDL_LockMutex(worker->lock);
+			worker->jobs.push_back(job);
+			SDL_UnlockMutex(worker->lock);
+			SDL_SemPost(mWake);
+		}
+
+		// newest first off our own deque, it's the one still in cache
+		bool pop(int index, Job* job)
+		{
+			Worker* worker = mWorkers[index];
+			SDL_LockMutex(worker->lock);
+			bool found = !worker->jobs.empty();
+			if (found)
+			{
+				*job = worker->jobs.back();
+				worker->jobs.pop_back();
+			}
+			SDL_UnlockMutex(worker->lock);
+			return found;
+		}
+
+		// oldest first off someone else's, it's the biggest range they have
+		bool steal(int index, Job* job)
+		{
+			int count = mWorkers.size();
+			for (int i = 1; i < count; ++i)
+			{
+				Worker* victim = mWorkers[(index + i) % count];
+				SDL_LockMutex(victim->lock);
+				bool found = !victim->jobs.empty();
+				if (found)
+				{
+					*job = victim->jobs.front();
+					victim->jobs.pop_front();
+				}
+				SDL_UnlockMutex(victim->lock);
+				if (found)
+				{
+					SDL_AtomicAdd(&mWorkers[index]->stolen, 1);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// hands the back half of the range out until what's left is small enough to run here
+		void run(int index, Job job)
+		{
+			while (job.end - job.begin > job.grain)
+			{
+				Job half = job;
+				half.begin = job.begin + (job.end - job.begin) / 2;
+				job.end = half.begin;
+				push(index, half);
+			}
+
+			job.function(job.data, job.begin, job.end);
+			SDL_AtomicAdd(&mWorkers[index]->executed, 1);
+			SDL_AtomicAdd(job.remaining, job.begin - job.end);
+		}
+
+		static int workerMain(void* data)
+		{
+			Worker* worker = (Worker*)data;
+			LJobSystem* system = worker->system;
+
+			while (SDL_AtomicGet(&system->mQuit) == 0)
+			{
+				Job job;
+				if (system->pop(worker->index, &job) || system->steal(worker->index, &job))
+				{
+					system->run(worker->index, job);
+				}
+				else
+				{
+					SDL_SemWait(system->mWake);
+				}
+			}
+
+			return 0;
+		}
+
+	public:
+		// inits variables
+		LJobSystem()
+		{
+			mWake = NULL;
+			SDL_AtomicSet(&mQuit, 0);
+		}
+
+		// Joins the workers
+		~LJobSystem()
+		{
+			stop();
+		}
+
+		// Starts threads - 1 workers to go with the calling thread, one per core when it's 0
+		bool start(int threads = 0)
+		{
+			stop();
+
+			if (threads <= 0)
+			{
+				threads = SDL_GetCPUCount();
+			}
+			mWake = SDL_CreateSemaphore(0);
+			if (mWake == NULL)
+			{
+				printf("Unable to create job semaphore! SDL Error: %s\n", SDL_GetError());
+				return false;
+			}
+			SDL_AtomicSet(&mQuit, 0);
+
+			for (int i = 0; i < threads; ++i)
+			{
+				Worker* worker = new Worker();
+				worker->system = this;
+				worker->index = i;
+				worker->thread = NULL;
+				worker->lock = SDL_CreateMutex();
+				SDL_AtomicSet(&worker->executed, 0);
+				SDL_AtomicSet(&worker->stolen, 0);
+				mWorkers.push_back(worker);
+			}
+
+			// only start the threads once every deque exists to steal from
+			for (int i = 1; i < threads; ++i)
+			{
+				mWorkers[i]->thread = SDL_CreateThread(workerMain, "JobWorker", mWorkers[i]);
+				if (mWorkers[i]->thread == NULL)
+				{
+					printf("Unable to create job worker! SDL Error: %s\n", SDL_GetError());
+					stop();
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		// Finishes the worker threads, only call it with no parallel for running
+		void stop()
+		{
+			SDL_AtomicSet(&mQuit, 1);
+			for (int i = 1; i < (int)mWorkers.size(); ++i)
+			{
+				SDL_SemPost(mWake);
+			}
+			for (int i = 0; i < (int)mWorkers.size(); ++i)
+			{
+				if (mWorkers[i]->thread != NULL)
+				{
+					SDL_WaitThread(mWorkers[i]->thread, NULL);
+				}
+				SDL_DestroyMutex(mWorkers[i]->lock);
+				delete mWorkers[i];
+			}
+			mWorkers.clear();
+
+			if (mWake != NULL)
+			{
+				SDL_DestroySemaphore(mWake);
+				mWake = NULL;
+			}
+		}
+
+		// Runs function over [0, count) in ranges of up to grain items across every thread and returns when they're all done
+		// the calling thread works through ranges too, don't call it from inside a job
+		void parallelFor(int count, int grain, LJobFunction function, void* data)
+		{
+			if (count <= 0)
+			{
+				return;
+			}
+
+			// no workers, nothing to split for
+			if (mWorkers.size() <= 1)
+			{
+				function(data, 0, count);
+				return;
+			}
+
+			SDL_atomic_t remaining;
+			SDL_AtomicSet(&remaining, count);
+			Job job = {function, data, 0, count, std::max(grain, 1), &remaining};
+			run(0, job);
+
+			// help out until the last range is done, which may be on another thread
+			while (SDL_AtomicGet(&remaining) > 0)
+			{
+				if (pop(0, &job) || steal(0, &job))
+				{
+					run(0, job);
+				}
+			}
+		}
+
+		// threads parallelFor runs on, including the caller
+		int getThreadCount()
+		{
+			return std::max((int)mWorkers.size(), 1);
+		}
+
+		void printStats()
+		{
+			for (int i = 0; i < (int)mWorkers.size(); ++i)
+			{
+				printf("job thread %d: %d ranges run, %d stolen\n", i, SDL_AtomicGet(&mWorkers[i]->executed), SDL_AtomicGet(&mWorkers[i]->stolen));
+			}
+		}
+};
+
 // ========================== Global Variables ==========================
 // The window we are going to render to
 SDL_Window* gWindow = NULL;
@@ -249,86 +971,377 @@ LButton gButtons[TOTAL_BUTTONS];
 class Dot {
   private:
     // X and Y offsets of the dot
-    int mPosX, mPosY;
+    float mPosX, mPosY;
+
+    // Offsets as of the previous tick, for interpolating between ticks
+    float mPrevPosX, mPrevPosY;
     
     // Dot velocity
     int mVelX, mVelY;
 
-  public:
-    // The dot dimensions
-    static const int DOT_WIDTH = 20;
-    static const int DOT_HEIGHT = 20;
+  public:
+    // The dot dimensions
+    static const int DOT_WIDTH = 20;
+    static const int DOT_HEIGHT = 20;
+
+    // Maximum axis velocity of the dot in pixels per second
+    static const int DOT_VEL = 600;
+
+    // Constructor
+    Dot()
+    {
+      // Init offsets
+      mPosX = 0;
+      mPosY = 0;
+      mPrevPosX = 0;
+      mPrevPosY = 0;
+
+      // Init velocity
+      mVelX = 0;
+      mVelY = 0;
+    }
+
+    // Puts the dot somewhere without it having moved there
+    void setPosition(float x, float y)
+    {
+      mPosX = mPrevPosX = x;
+      mPosY = mPrevPosY = y;
+    }
+
+    void handleEvent(SDL_Event& e) 
+    {
+      // if a key was pressed
+      if (e.type == SDL_KEYDOWN && e.key.repeat == 0) 
+      { 
+        // adjust the velocity
+        switch (e.key.keysym.sym)
+        {
+          case SDLK_UP: mVelY -= DOT_VEL; break;
+          case SDLK_DOWN: mVelY += DOT_VEL; break;
+          case SDLK_LEFT: mVelX -= DOT_VEL; break;
+          case SDLK_RIGHT: mVelX += DOT_VEL; break;
+        }
+      }
+      else if (e.type == SDL_KEYUP && e.key.repeat == 0)
+      {
+        switch (e.key.keysym.sym)
+        {
+          case SDLK_UP: mVelY += DOT_VEL; break;
+          case SDLK_DOWN: mVelY -= DOT_VEL; break;
+          case SDLK_LEFT: mVelX += DOT_VEL; break;
+          case SDLK_RIGHT: mVelX -= DOT_VEL; break;
+        }
+      }
+    }
+
+    // Advances the dot by one simulation tick
+    void move(float seconds) 
+    {
+      // remember where the tick started
+      mPrevPosX = mPosX;
+      mPrevPosY = mPosY;
+
+      // move the dot left or right
+      mPosX += mVelX * seconds;
+
+      // if the dot went too far to the left or right
+      if (mPosX < 0)
+      {
+        // Stop at the edge
+        mPosX = 0;
+      }
+      else if (mPosX + DOT_WIDTH > SCREEN_WIDTH)
+      {
+        mPosX = SCREEN_WIDTH - DOT_WIDTH;
+      }
+      
+      // move the dot up or down 
+      mPosY += mVelY * seconds;
+
+      // if the dot went too far up or down
+      if (mPosY < 0)
+      {
+        // Stop at the edge
+        mPosY = 0;
+      }
+      else if (mPosY + DOT_HEIGHT > SCREEN_HEIGHT)
+      {
+        mPosY = SCREEN_HEIGHT - DOT_HEIGHT;
+      }
+    }
+
+    // Shows the dot alpha of the way from the previous tick to the current one
+    void render(float alpha) 
+    {
+      float x = mPrevPosX + (mPosX - mPrevPosX) * alpha;
+      float y = mPrevPosY + (mPosY - mPrevPosY) * alpha;
+
+      // show the dot
+      gDotTexture.render((int)(x + 0.5f), (int)(y + 0.5f));
+    }
+
+};
+
+// ========================== Dot System Class (with implementation) ==========================
+// the update code paths, best one picked at runtime
+enum LDotSimd
+{
+	DOT_SIMD_SCALAR,
+	DOT_SIMD_SSE,
+	DOT_SIMD_AVX,
+	DOT_SIMD_TOTAL
+};
+
+class DotSystem
+{
+	private:
+		// positions as of the last two ticks, flipped every update instead of copied
+		std::vector<float> mPosX[2];
+		std::vector<float> mPosY[2];
+		int mCurrent;
+
+		// velocities in pixels per second
+		std::vector<float> mVelX;
+		std::vector<float> mVelY;
+
+		// dots in use, and that rounded up to whole AVX vectors (the rest never move)
+		int mCount;
+		int mCapacity;
+
+		LDotSimd mSimd;
+
+		// one quad per dot, the colors and texture coordinates never change
+		std::vector<SDL_Vertex> mVertices;
+		std::vector<int> mIndices;
+
+		// moves and clamps dots [begin, end) from the previous positions into the current ones
+		static void updateScalar(const float* prevX, const float* prevY, float* posX, float* posY, const float* velX, const float* velY, int begin, int end, float seconds)
+		{
+			const float maxX = SCREEN_WIDTH - Dot::DOT_WIDTH;
+			const float maxY = SCREEN_HEIGHT - Dot::DOT_HEIGHT;
+			for (int i = begin; i < end; ++i)
+			{
+				posX[i] = std::min(std::max(prevX[i] + velX[i] * seconds, 0.f), maxX);
+				posY[i] = std::min(std::max(prevY[i] + velY[i] * seconds, 0.f), maxY);
+			}
+		}
+
+		#if DOTS_X86
+		static void updateSse(const float* prevX, const float* prevY, float* posX, float* posY, const float* velX, const float* velY, int begin, int end, float seconds)
+		{
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 maxX = _mm_set1_ps(SCREEN_WIDTH - Dot::DOT_WIDTH);
+			const __m128 maxY = _mm_set1_ps(SCREEN_HEIGHT - Dot::DOT_HEIGHT);
+			const __m128 step = _mm_set1_ps(seconds);
+			for (int i = begin; i < end; i += 4)
+			{
+				__m128 x = _mm_add_ps(_mm_loadu_ps(prevX + i), _mm_mul_ps(_mm_loadu_ps(velX + i), step));
+				__m128 y = _mm_add_ps(_mm_loadu_ps(prevY + i), _mm_mul_ps(_mm_loadu_ps(velY + i), step));
+				_mm_storeu_ps(posX + i, _mm_min_ps(_mm_max_ps(x, zero), maxX));
+				_mm_storeu_ps(posY + i, _mm_min_ps(_mm_max_ps(y, zero), maxY));
+			}
+		}
+
+		__attribute__((target("avx")))
+		static void updateAvx(const float* prevX, const float* prevY, float* posX, float* posY, const float* velX, const float* velY, int begin, int end, float seconds)
+		{
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 maxX = _mm256_set1_ps(SCREEN_WIDTH - Dot::DOT_WIDTH);
+			const __m256 maxY = _mm256_set1_ps(SCREEN_HEIGHT - Dot::DOT_HEIGHT);
+			const __m256 step = _mm256_set1_ps(seconds);
+			for (int i = begin; i < end; i += 8)
+			{
+				__m256 x = _mm256_add_ps(_mm256_loadu_ps(prevX + i), _mm256_mul_ps(_mm256_loadu_ps(velX + i), step));
+				__m256 y = _mm256_add_ps(_mm256_loadu_ps(prevY + i), _mm256_mul_ps(_mm256_loadu_ps(velY + i), step));
+				_mm256_storeu_ps(posX + i, _mm256_min_ps(_mm256_max_ps(x, zero), maxX));
+				_mm256_storeu_ps(posY + i, _mm256_min_ps(_mm256_max_ps(y, zero), maxY));
+			}
+		}
+		#endif
+
+		// the tick a parallel update is running, the jobs only get a pointer to the system
+		float mJobSeconds;
+
+		// a parallel for job over [begin, end) in vectors of dots
+		static void updateJob(void* data, int begin, int end)
+		{
+			DotSystem* dots = (DotSystem*)data;
+			dots->updateRange(begin * DOT_SIMD_WIDTH, end * DOT_SIMD_WIDTH, dots->mJobSeconds);
+		}
+
+		// moves dots [begin, end) with the current code path, begin and end on DOT_SIMD_WIDTH boundaries
+		void updateRange(int begin, int end, float seconds)
+		{
+			int previous = 1 - mCurrent;
+			const float* prevX = &mPosX[previous][0];
+			const float* prevY = &mPosY[previous][0];
+			float* posX = &mPosX[mCurrent][0];
+			float* posY = &mPosY[mCurrent][0];
+			switch (mSimd)
+			{
+				#if DOTS_X86
+				case DOT_SIMD_AVX: updateAvx(prevX, prevY, posX, posY, &mVelX[0], &mVelY[0], begin, end, seconds); break;
+				case DOT_SIMD_SSE: updateSse(prevX, prevY, posX, posY, &mVelX[0], &mVelY[0], begin, end, seconds); break;
+				#endif
+				default: updateScalar(prevX, prevY, posX, posY, &mVelX[0], &mVelY[0], begin, end, seconds); break;
+			}
+		}
+
+	public:
+		// inits variables
+		DotSystem()
+		{
+			mCurrent = 0;
+			mCount = 0;
+			mCapacity = 0;
+			mSimd = getBestSimd();
+			mJobSeconds = 0.f;
+		}
+
+		// scatters dots across the screen heading off at random velocities up to Dot::DOT_VEL
+		void spawn(int count, unsigned int seed)
+		{
+			mCount = count;
+			mCapacity = (count + DOT_SIMD_WIDTH - 1) / DOT_SIMD_WIDTH * DOT_SIMD_WIDTH;
+			mCurrent = 0;
+			for (int i = 0; i < 2; ++i)
+			{
+				mPosX[i].assign(mCapacity, 0.f);
+				mPosY[i].assign(mCapacity, 0.f);
+			}
+			mVelX.assign(mCapacity, 0.f);
+			mVelY.assign(mCapacity, 0.f);
+
+			srand(seed);
+			for (int i = 0; i < count; ++i)
+			{
+				mPosX[0][i] = mPosX[1][i] = (float)(rand() % (SCREEN_WIDTH - Dot::DOT_WIDTH));
+				mPosY[0][i] = mPosY[1][i] = (float)(rand() % (SCREEN_HEIGHT - Dot::DOT_HEIGHT));
+				mVelX[i] = (float)(rand() % (2 * Dot::DOT_VEL + 1) - Dot::DOT_VEL);
+				mVelY[i] = (float)(rand() % (2 * Dot::DOT_VEL + 1) - Dot::DOT_VEL);
+			}
+
+			// the quads, only the corners move from frame to frame
+			SDL_Vertex corner;
+			corner.position.x = 0.f;
+			corner.position.y = 0.f;
+			corner.color.r = corner.color.g = corner.color.b = corner.color.a = 0xFF;
+			mVertices.assign(count * 4, corner);
+			mIndices.resize(count * 6);
+			for (int i = 0; i < count; ++i)
+			{
+				for (int j = 0; j < 4; ++j)
+				{
+					mVertices[i * 4 + j].tex_coord.x = (float)(j & 1);
+					mVertices[i * 4 + j].tex_coord.y = (float)(j >> 1);
+				}
+				int quad[6] = {0, 1, 2, 1, 3, 2};
+				for (int j = 0; j < 6; ++j)
+				{
+					mIndices[i * 6 + j] = i * 4 + quad[j];
+				}
+			}
+		}
+
+		// Advances every dot by one simulation tick
+		void update(float seconds)
+		{
+			if (mCapacity == 0)
+			{
+				return;
+			}
+			mCurrent = 1 - mCurrent;
+			updateRange(0, mCapacity, seconds);
+		}
+
+		// The same, split across the job system's threads, the dots don't touch each other so any split works
+		void update(float seconds, LJobSystem* jobs)
+		{
+			if (mCapacity == 0)
+			{
+				return;
+			}
+			mCurrent = 1 - mCurrent;
+			mJobSeconds = seconds;
+			jobs->parallelFor(mCapacity / DOT_SIMD_WIDTH, DOT_JOB_GRAIN, updateJob, this);
+		}
+
+		// Shows every dot alpha of the way from the previous tick to the current one, in one draw
+		void render(SDL_Texture* texture, float alpha)
+		{
+			if (mCount == 0)
+			{
+				return;
+			}
 
-    // Maximum axis velocity of the dot
-    static const int DOT_VEL = 10;
+			const float* posX = &mPosX[mCurrent][0];
+			const float* posY = &mPosY[mCurrent][0];
+			const float* prevX = &mPosX[1 - mCurrent][0];
+			const float* prevY = &mPosY[1 - mCurrent][0];
+			for (int i = 0; i < mCount; ++i)
+			{
+				float x = prevX[i] + (posX[i] - prevX[i]) * alpha;
+				float y = prevY[i] + (posY[i] - prevY[i]) * alpha;
+				SDL_Vertex* quad = &mVertices[i * 4];
+				quad[0].position.x = x;
+				quad[0].position.y = y;
+				quad[1].position.x = x + Dot::DOT_WIDTH;
+				quad[1].position.y = y;
+				quad[2].position.x = x;
+				quad[2].position.y = y + Dot::DOT_HEIGHT;
+				quad[3].position.x = x + Dot::DOT_WIDTH;
+				quad[3].position.y = y + Dot::DOT_HEIGHT;
+			}
 
-    // Constructor
-    Dot()
-    {
-      // Init offsets
-      mPosX = 0;
-      mPosY = 0;
+			SDL_RenderGeometry(gRenderer, texture, &mVertices[0], mVertices.size(), &mIndices[0], mIndices.size());
+		}
 
-      // Init velocity
-      mVelX = 0;
-      mVelY = 0;
-    }
+		// where dot i is as of the last tick
+		float getX(int i)
+		{
+			return mPosX[mCurrent][i];
+		}
 
-    void handleEvent(SDL_Event& e) 
-    {
-      // if a key was pressed
-      if (e.type == SDL_KEYDOWN && e.key.repeat == 0) 
-      { 
-        // adjust the velocity
-        switch (e.key.keysym.sym)
-        {
-          case SDLK_UP: mVelY -= DOT_VEL; break;
-          case SDLK_DOWN: mVelY += DOT_VEL; break;
-          case SDLK_LEFT: mVelX -= DOT_VEL; break;
-          case SDLK_RIGHT: mVelX += DOT_VEL; break;
-        }
-      }
-      else if (e.type == SDL_KEYUP && e.key.repeat == 0)
-      {
-        switch (e.key.keysym.sym)
-        {
-          case SDLK_UP: mVelY += DOT_VEL; break;
-          case SDLK_DOWN: mVelY -= DOT_VEL; break;
-          case SDLK_LEFT: mVelX += DOT_VEL; break;
-          case SDLK_RIGHT: mVelX -= DOT_VEL; break;
-        }
-      }
-    }
+		float getY(int i)
+		{
+			return mPosY[mCurrent][i];
+		}
 
-    void move() 
-    {
-      // move the dot left or right
-      mPosX += mVelX;
+		int getCount()
+		{
+			return mCount;
+		}
 
-      // if the dot went too far to the left or right
-      if ((mPosX < 0) || (mPosX + DOT_WIDTH > SCREEN_WIDTH))
-      {
-        // Move back
-        mPosX -= mVelX;
-      }
-      
-      // move the dot up or down 
-      mPosY += mVelY;
+		// the code path update() uses, lowered for the benchmark
+		LDotSimd getSimd()
+		{
+			return mSimd;
+		}
 
-      // if the dot went too far to the left or right
-      if ((mPosY < 0) || (mPosY + DOT_HEIGHT > SCREEN_HEIGHT))
-      {
-        // Move back
-        mPosY -= mVelY;
-      }
-    }
+		void setSimd(LDotSimd simd)
+		{
+			// never above what the CPU can run
+			mSimd = std::min(simd, getBestSimd());
+		}
 
-    void render() 
-    {
-      // show the dot
-      gDotTexture.render(mPosX, mPosY);
-    }
+		static LDotSimd getBestSimd()
+		{
+			#if DOTS_X86
+			if (__builtin_cpu_supports("avx"))
+			{
+				return DOT_SIMD_AVX;
+			}
+			return DOT_SIMD_SSE;
+			#else
+			return DOT_SIMD_SCALAR;
+			#endif
+		}
 
+		static const char* getSimdName(LDotSimd simd)
+		{
+			const char* names[DOT_SIMD_TOTAL] = {"scalar", "SSE", "AVX"};
+			return names[simd];
+		}
 };
 
 // ========================== Button Wrapper Class Function Definitions ==========================
@@ -412,6 +1425,144 @@ void LButton::render()
 }
 
 // ========================== Texture Wrapper Class Function Definitions ==========================
+// The kernels clear every pixel of an ARGB8888 row whose color matches the key, alpha ignored the way SDL
+// compares it. Cleared pixels are transparent black, which reads the same straight or premultiplied.
+void keyRowScalar(Uint32* pixels, int width, Uint32 key)
+{
+	for (int x = 0; x < width; ++x)
+	{
+		if ((pixels[x] & 0x00FFFFFF) == key)
+		{
+			pixels[x] = 0;
+		}
+	}
+}
+
+#if KEY_X86
+__attribute__((target("sse2")))
+void keyRowSse2(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step: compare the color bits, then and the matches away
+	const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+	const __m128i keyColor = _mm_set1_epi32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		__m128i color = _mm_loadu_si128((const __m128i*)(pixels + x));
+		__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(color, colorMask), keyColor);
+		_mm_storeu_si128((__m128i*)(pixels + x), _mm_andnot_si128(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+
+__attribute__((target("avx2")))
+void keyRowAvx2(Uint32* pixels, int width, Uint32 key)
+{
+	// eight pixels a step
+	const __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+	const __m256i keyColor = _mm256_set1_epi32(key);
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		__m256i color = _mm256_loadu_si256((const __m256i*)(pixels + x));
+		__m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(color, colorMask), keyColor);
+		_mm256_storeu_si256((__m256i*)(pixels + x), _mm256_andnot_si256(keyed, color));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+#if KEY_NEON
+void keyRowNeon(Uint32* pixels, int width, Uint32 key)
+{
+	// four pixels a step, NEON is always there on AArch64
+	const uint32x4_t colorMask = vdupq_n_u32(0x00FFFFFF);
+	const uint32x4_t keyColor = vdupq_n_u32(key);
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		uint32x4_t color = vld1q_u32(pixels + x);
+		uint32x4_t keyed = vceqq_u32(vandq_u32(color, colorMask), keyColor);
+		vst1q_u32(pixels + x, vbicq_u32(color, keyed));
+	}
+	keyRowScalar(pixels + x, width - x, key);
+}
+#endif
+
+SDL_Surface* LTexture::loadKeyedSurface(std::string path)
+{
+	SDL_Surface* loadedSurface = IMG_Load(path.c_str());
+	if (loadedSurface == NULL)
+	{
+		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		return NULL;
+	}
+
+	// one conversion to the format the kernels work on, which SDL would have done making the texture anyway
+	SDL_Surface* keyedSurface = SDL_ConvertSurfaceFormat(loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(loadedSurface);
+	if (keyedSurface == NULL)
+	{
+		printf("Unable to convert image %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+		return NULL;
+	}
+
+	// and one pass to key it
+	keySurface(keyedSurface, getBestKeySimd());
+	return keyedSurface;
+}
+
+void LTexture::keySurface(SDL_Surface* surface, LKeySimd simd)
+{
+	Uint32 key = SDL_MapRGB(surface->format, 0, 0xFF, 0xFF) & 0x00FFFFFF;
+	for (int y = 0; y < surface->h; ++y)
+	{
+		Uint32* row = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch);
+		switch (simd)
+		{
+			#if KEY_X86
+			case KEY_SIMD_AVX2: keyRowAvx2(row, surface->w, key); break;
+			case KEY_SIMD_SSE2: keyRowSse2(row, surface->w, key); break;
+			#endif
+			#if KEY_NEON
+			case KEY_SIMD_NEON: keyRowNeon(row, surface->w, key); break;
+			#endif
+			default: keyRowScalar(row, surface->w, key); break;
+		}
+	}
+
+	// converted RGB images start out unblended, and the keyed pixels only vanish when the texture blends
+	SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_BLEND);
+}
+
+LKeySimd LTexture::getBestKeySimd()
+{
+	#if KEY_X86
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return KEY_SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return KEY_SIMD_SSE2;
+	}
+	#elif KEY_NEON
+	return KEY_SIMD_NEON;
+	#endif
+	return KEY_SIMD_SCALAR;
+}
+
+const char* LTexture::getKeySimdName(LKeySimd simd)
+{
+	switch (simd)
+	{
+		case KEY_SIMD_AVX2: return "avx2";
+		case KEY_SIMD_SSE2: return "sse2";
+		case KEY_SIMD_NEON: return "neon";
+		default: return "scalar";
+	}
+}
+
 LTexture::LTexture()
 {
 	// initialize
@@ -434,17 +1585,14 @@ bool LTexture::loadFromFile(std::string path)
 	// create the texture
 	SDL_Texture* newTexture = NULL;
 
-	// first create a surface 
-	SDL_Surface* newSurface= IMG_Load(path.c_str());
+	// first create a surface, with the color key already turned into alpha
+	SDL_Surface* newSurface = loadKeyedSurface(path);
 	if (newSurface == NULL)
 	{
-		printf("Could not load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError()); 
+		printf("Could not load image %s!\n", path.c_str()); 
 	}
 	else
 	{
-		// color key the image we load
-		SDL_SetColorKey(newSurface, SDL_TRUE, SDL_MapRGB(newSurface->format, 0, 0xFF, 0xFF));
-
 		// create texture from surface pixels
 		newTexture = SDL_CreateTextureFromSurface(gRenderer, newSurface);
 		if (newTexture == NULL) 
@@ -559,9 +1707,14 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
+SDL_Texture* LTexture::getTexture()
+{
+	return mTexture;
+}
+
 // ========================== Function Delcarations ==========================
-// loads up SDL and creates window
-bool init();
+// loads up SDL and creates window (software renderer for replays on the dummy driver)
+bool init(bool softwareRenderer = false);
 
 // loads media
 bool loadMedia();
@@ -572,8 +1725,17 @@ void close();
 // Loads individual image
 SDL_Texture* loadTexture(std::string path);
 
+// Runs the dot simulation without a window as fast as possible and reports ticks per second
+void runHeadless(int ticks, int tickRate);
+
+// Times a tick of many dots as Dot objects and through each DotSystem code path
+void runDotBenchmark(int count, int tickRate);
+
+// Times a tick of many dots on the job system from one thread up to one per core
+void runJobBenchmark(int count, int tickRate, int maxThreads);
+
 // ========================== Function Definitions ==========================
-bool init()
+bool init(bool softwareRenderer)
 {
 	// Initialization flag
 	bool success = true;
@@ -596,7 +1758,12 @@ bool init()
 		else
 		{
 			// initialize the renderer for the window
-			gRenderer = SDL_CreateRenderer(gWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+			Uint32 rendererFlags = SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC;
+			if (softwareRenderer)
+			{
+				rendererFlags = SDL_RENDERER_SOFTWARE;
+			}
+			gRenderer = SDL_CreateRenderer(gWindow, -1, rendererFlags);
 			if (gRenderer == NULL)
 			{
 				printf("Renderer could not be initialized! SDL_Error: %s\n", SDL_GetError());
@@ -683,10 +1850,260 @@ SDL_Texture* loadTexture(std::string path)
 	return newTexture;
 }
 
+void runHeadless(int ticks, int tickRate)
+{
+	// a crowd of dots heading off in different directions
+	std::vector<Dot> dots(HEADLESS_DOTS);
+	SDL_Keycode directions[4] = {SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT};
+	for (int i = 0; i < HEADLESS_DOTS; ++i)
+	{
+		SDL_Event e;
+		e.type = SDL_KEYDOWN;
+		e.key.repeat = 0;
+		e.key.keysym.sym = directions[i % 4];
+		dots[i].handleEvent(e);
+	}
+
+	// every tick is the same length no matter how long it takes to compute
+	LFixedTimestep timestep(tickRate);
+	float seconds = timestep.getTickSeconds();
+
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int tick = 0; tick < ticks; ++tick)
+	{
+		for (int i = 0; i < HEADLESS_DOTS; ++i)
+		{
+			dots[i].move(seconds);
+		}
+	}
+	double elapsed = (SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+
+	printf("%d ticks of %d dots at %d Hz simulated in %.3f s\n", ticks, HEADLESS_DOTS, tickRate, elapsed);
+	printf("%.0f ticks/second (%.1fx real time)\n", ticks / elapsed, ticks / (double)tickRate / elapsed);
+}
+
+void runDotBenchmark(int count, int tickRate)
+{
+	float seconds = 1.f / tickRate;
+	double frequency = (double)SDL_GetPerformanceFrequency();
+
+	// the objects start where the system's dots do, each heading off in a random direction
+	std::vector<Dot> objects(count);
+	DotSystem reference;
+	reference.spawn(count, 22);
+	SDL_Keycode directions[4] = {SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT};
+	for (int i = 0; i < count; ++i)
+	{
+		objects[i].setPosition(reference.getX(i), reference.getY(i));
+		SDL_Event e;
+		e.type = SDL_KEYDOWN;
+		e.key.repeat = 0;
+		e.key.keysym.sym = directions[rand() % 4];
+		objects[i].handleEvent(e);
+	}
+
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int tick = 0; tick < DOT_BENCH_TICKS; ++tick)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			objects[i].move(seconds);
+		}
+	}
+	printf("%d Dot objects: %.3f ms per tick\n", count, (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / DOT_BENCH_TICKS);
+
+	// the scalar system is what the others have to match
+	reference.setSimd(DOT_SIMD_SCALAR);
+	for (int tick = 0; tick < DOT_BENCH_TICKS; ++tick)
+	{
+		reference.update(seconds);
+	}
+
+	for (int simd = DOT_SIMD_SCALAR; simd <= DotSystem::getBestSimd(); ++simd)
+	{
+		DotSystem dots;
+		dots.spawn(count, 22);
+		dots.setSimd((LDotSimd)simd);
+
+		start = SDL_GetPerformanceCounter();
+		for (int tick = 0; tick < DOT_BENCH_TICKS; ++tick)
+		{
+			dots.update(seconds);
+		}
+		double tickMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / DOT_BENCH_TICKS;
+
+		int mismatches = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			if (dots.getX(i) != reference.getX(i) || dots.getY(i) != reference.getY(i))
+			{
+				++mismatches;
+			}
+		}
+
+		printf("%d dots, DotSystem %-6s: %.3f ms per tick (%.0f M dots/s)%s\n", count, DotSystem::getSimdName((LDotSimd)simd), tickMs,
+			count / tickMs / 1000.0, mismatches == 0 ? "" : ", doesn't match scalar!");
+	}
+}
+
+void runJobBenchmark(int count, int tickRate, int maxThreads)
+{
+	float seconds = 1.f / tickRate;
+	double frequency = (double)SDL_GetPerformanceFrequency();
+
+	// one thread, no jobs, is what the rest have to match
+	DotSystem reference;
+	reference.spawn(count, 22);
+	for (int tick = 0; tick < DOT_BENCH_TICKS; ++tick)
+	{
+		reference.update(seconds);
+	}
+
+	double singleMs = 0.0;
+	for (int threads = 1; threads <= maxThreads; ++threads)
+	{
+		LJobSystem jobs;
+		if (!jobs.start(threads))
+		{
+			return;
+		}
+
+		DotSystem dots;
+		dots.spawn(count, 22);
+		Uint64 start = SDL_GetPerformanceCounter();
+		for (int tick = 0; tick < DOT_BENCH_TICKS; ++tick)
+		{
+			dots.update(seconds, &jobs);
+		}
+		double tickMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency / DOT_BENCH_TICKS;
+		if (threads == 1)
+		{
+			singleMs = tickMs;
+		}
+
+		int mismatches = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			if (dots.getX(i) != reference.getX(i) || dots.getY(i) != reference.getY(i))
+			{
+				++mismatches;
+			}
+		}
+
+		printf("%d dots on %2d threads (%s): %.3f ms per tick, %.2fx%s\n", count, threads, DotSystem::getSimdName(dots.getSimd()), tickMs,
+			singleMs / tickMs, mismatches == 0 ? "" : ", doesn't match one thread!");
+		if (threads == maxThreads)
+		{
+			jobs.printStats();
+		}
+	}
+}
+
 int main( int argc, char* args[])
 { 
- 	// start up SDL and create the window
-	if (!init())
+	// Simulation options: --tick-rate <hz>, --headless [ticks], --record <log>, --replay <log>, --dots <count>, --threads <count>,
+	// --dot-bench [count] and --job-bench [count] (from one thread up to --threads)
+	int tickRate = SIMULATION_TICK_RATE;
+	int headlessTicks = 0;
+	int dotCount = 0;
+	int dotBenchCount = 0;
+	int jobBenchCount = 0;
+	int jobThreads = 0;
+	const char* recordPath = NULL;
+	const char* replayPath = NULL;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(args[i], "--tick-rate") == 0 && i + 1 < argc)
+		{
+			tickRate = atoi(args[++i]);
+		}
+		else if (strcmp(args[i], "--record") == 0 && i + 1 < argc)
+		{
+			recordPath = args[++i];
+		}
+		else if (strcmp(args[i], "--replay") == 0 && i + 1 < argc)
+		{
+			replayPath = args[++i];
+		}
+		else if (strcmp(args[i], "--dots") == 0 && i + 1 < argc)
+		{
+			dotCount = atoi(args[++i]);
+		}
+		else if (strcmp(args[i], "--dot-bench") == 0)
+		{
+			dotBenchCount = DOT_BENCH_COUNT;
+			if (i + 1 < argc && atoi(args[i + 1]) > 0)
+			{
+				dotBenchCount = atoi(args[++i]);
+			}
+		}
+		else if (strcmp(args[i], "--job-bench") == 0)
+		{
+			jobBenchCount = DOT_BENCH_COUNT;
+			if (i + 1 < argc && atoi(args[i + 1]) > 0)
+			{
+				jobBenchCount = atoi(args[++i]);
+			}
+		}
+		else if (strcmp(args[i], "--threads") == 0 && i + 1 < argc)
+		{
+			jobThreads = atoi(args[++i]);
+		}
+		else if (strcmp(args[i], "--headless") == 0)
+		{
+			headlessTicks = HEADLESS_TICKS;
+			if (i + 1 < argc && atoi(args[i + 1]) > 0)
+			{
+				headlessTicks = atoi(args[++i]);
+			}
+		}
+	}
+	if (tickRate <= 0)
+	{
+		tickRate = SIMULATION_TICK_RATE;
+	}
+
+	// no window needed to measure the simulation
+	if (headlessTicks > 0)
+	{
+		SDL_Init(0);
+		runHeadless(headlessTicks, tickRate);
+		SDL_Quit();
+		return 0;
+	}
+	if (dotBenchCount > 0)
+	{
+		SDL_Init(0);
+		runDotBenchmark(dotBenchCount, tickRate);
+		SDL_Quit();
+		return 0;
+	}
+	if (jobBenchCount > 0)
+	{
+		SDL_Init(0);
+		runJobBenchmark(jobBenchCount, tickRate, jobThreads > 0 ? jobThreads : SDL_GetCPUCount());
+		SDL_Quit();
+		return 0;
+	}
+
+	// a replay runs at the tick rate it was recorded at, without a real display unless SDL_VIDEODRIVER says otherwise
+	LInputRecorder recorder;
+	if (replayPath != NULL)
+	{
+		tickRate = recorder.startReplay(replayPath);
+		if (tickRate <= 0)
+		{
+			return 1;
+		}
+		SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+	}
+	else if (recordPath != NULL && !recorder.startRecording(recordPath, tickRate))
+	{
+		return 1;
+	}
+
+ 	// start up SDL and create the window, the dummy driver only has the software renderer
+	if (!init(replayPath != NULL))
 	{
 		printf("Failed to initialize!\n");
 	}
@@ -707,12 +2124,31 @@ int main( int argc, char* args[])
     // The dot that will be moving around the screen
     Dot dot;
 
+    // and a crowd of them behind it when asked for, updated across every core
+    DotSystem crowd;
+    crowd.spawn(std::max(dotCount, 0), 22);
+    // no worker threads unless there is a crowd to split between them
+    LJobSystem jobs;
+    if (dotCount > 0)
+    {
+      jobs.start(jobThreads);
+    }
+
+    // Simulation runs in fixed ticks independent of the frame rate
+    LFixedTimestep timestep(tickRate);
+    timestep.start();
+
 		// The main loop of the game
 		while (!quit) 
 		{
+			// a replay queues up this frame's recorded input
+			recorder.beginFrame();
+
 			// handle events on the queue
 			while (SDL_PollEvent(&e) != 0) 
 			{
+				recorder.record(e);
+
 				// the user requests to quit
 				if (e.type == SDL_QUIT) 
 				{
@@ -723,20 +2159,36 @@ int main( int argc, char* args[])
         dot.handleEvent(e);
 			}
 
-      // Move the dot
-      dot.move();
+      // Move the dot by however many ticks of time have passed, or as many as the log says
+      int ticks = recorder.syncTicks(timestep.advance());
+      for (int i = 0; i < ticks; ++i)
+      {
+        dot.move(timestep.getTickSeconds());
+        crowd.update(timestep.getTickSeconds(), &jobs);
+      }
 
 			// Clear the screen
 			SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
 			SDL_RenderClear(gRenderer);
 
-      // render dot
-      dot.render();
+      // render the crowd in one draw, then the dot on top, between their last two ticks
+      crowd.render(gDotTexture.getTexture(), timestep.getAlpha());
+      dot.render(timestep.getAlpha());
 
 			// Update screen
 			SDL_RenderPresent(gRenderer);
+			recorder.endFrame();
+
+			// the log ran out
+			if (recorder.isFinished())
+			{
+				quit = true;
+			}
 		}
+
+		recorder.printReplayStats();
 	}
+	recorder.stop();
 
 	// close out resources and SDL
 	close();